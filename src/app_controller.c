@@ -2,8 +2,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <stdarg.h>
 #include "udp_io.h"
+#include "tcp_io.h"
+#include "script_vm.h"
+#include "log_queue.h"
+#include "event_log.h"
+#include "pcap_replay.h"
+#include "net_metrics.h"
+#include "rtt_probe.h"
 
 struct AppController {
     BackendAPI api;
@@ -12,19 +18,83 @@ struct AppController {
     ui_log_append_fn log_append;
     ui_script_state_fn script_state_set;
     ui_packet_append_fn pkt_append;
+    ui_metrics_fn metrics;
+
+    // per-second sampler feeding metrics and the optional CSV/JSON export
+    NetMeter* meter;
+    guint meter_timer;
 
     NetConfig last_cfg;
     UdpIo* udp;
+    TcpIo* tcp;
+    gint proto;             // NetProto of the applied config; read by the VM thread
+    ScriptVm* vm;
+    LogQueue* vm_logq;      // script output, coalesced per main-loop iteration
+    ScriptIncludeCache* includes;   // %include files, reused across runs
+    char* script_dir;       // directory of the last loaded/saved script, for %include
+
+    // pcap replay runs on its own thread until done or cancelled
+    GThread* replay_thread;
+    gint replay_running;
+    gint replay_cancel;
+
+    // RTT probe: one run at a time on its own thread; the probe itself lives
+    // as long as the controller because the UDP receive threads hold it
+    RttProbe* probe;
+    GThread* probe_thread;
+    ProbeConfig probe_cfg;
+    gint probe_running;
+    gint probe_cancel;
 };
 
-static void app_logf(AppController* c, const char* fmt, ...) {
-    if (!c || !c->log_append) return;
-    char buf[1024];
-    va_list ap;
-    va_start(ap, fmt);
-    vsnprintf(buf, sizeof(buf), fmt, ap);
-    va_end(ap);
-    c->log_append(c->ui_user, buf);
+typedef struct {
+    AppController* c;
+    char* path;
+    double speed;
+} ReplayJob;
+
+typedef struct {
+    AppController* c;
+    char* line;
+    ScriptState st;
+} CtrlUiTask;
+
+// script VM callbacks run on the VM thread; hop to the main loop before touching the UI
+static gboolean vm_state_idle_cb(gpointer data) {
+    CtrlUiTask* t = (CtrlUiTask*)data;
+    if (t->c->script_state_set) t->c->script_state_set(t->c->ui_user, t->st, t->line);
+    g_free(t->line);
+    g_free(t);
+    return G_SOURCE_REMOVE;
+}
+
+static void vm_host_log(void* user, const char* line) {
+    AppController* c = (AppController*)user;
+    log_queue_push(c->vm_logq, line);
+}
+
+static void vm_host_state(void* user, ScriptState st, const char* detail) {
+    CtrlUiTask* t = g_new0(CtrlUiTask, 1);
+    t->c = (AppController*)user;
+    if (t->c->udp) udp_io_send_raw_flush(t->c->udp);
+    t->st = st;
+    t->line = g_strdup(detail);
+    g_idle_add(vm_state_idle_cb, t);
+}
+
+// send through whichever transport the last applied config selected
+static gboolean ctrl_send(AppController* c, const uint8_t* data, size_t len, int is_hex_mode) {
+    if (g_atomic_int_get(&c->proto) == NET_PROTO_TCP) {
+        return c->tcp ? tcp_io_send(c->tcp, data, len, is_hex_mode) : FALSE;
+    }
+    return c->udp ? udp_io_send(c->udp, data, len, is_hex_mode) : FALSE;
+}
+
+// udp.send from the script: the raw path, with no per-datagram log line
+static gboolean vm_host_send(void* user, const uint8_t* data, size_t len) {
+    AppController* c = (AppController*)user;
+    if (g_atomic_int_get(&c->proto) == NET_PROTO_TCP) return c->tcp ? tcp_io_send(c->tcp, data, len, 0) : FALSE;
+    return c->udp ? udp_io_send_raw(c->udp, data, len) : FALSE;
 }
 
 static void api_apply_config(void* user, const NetConfig* cfg) {
@@ -32,63 +102,288 @@ static void api_apply_config(void* user, const NetConfig* cfg) {
     if (!cfg) return;
     c->last_cfg = *cfg;
 
-    app_logf(c, "[CFG] local=%s:%d target=%s:%d rx=%s tx=%s",
-         cfg->local_ip ? cfg->local_ip : "(null)", cfg->local_port,
-         cfg->target_ip ? cfg->target_ip : "(null)", cfg->target_port,
-         cfg->rx_hex ? "HEX" : "ASCII",
-         cfg->tx_hex ? "HEX" : "ASCII");
+    // EVLOG takes at most EVLOG_MAX_ARGS arguments, so the modes share one literal
+    static const char* const modes[] = {
+        "rx=ASCII tx=ASCII", "rx=ASCII tx=HEX", "rx=HEX tx=ASCII", "rx=HEX tx=HEX"
+    };
+    EVLOG("[CFG] %s local=%S:%d target=%S:%d %s",
+          EV_STR(cfg->proto == NET_PROTO_TCP ? (cfg->tcp_server ? "TCP server" : "TCP client") : "UDP"),
+          EV_DUP(cfg->local_ip ? cfg->local_ip : "(null)"), cfg->local_port,
+          EV_DUP(cfg->target_ip ? cfg->target_ip : "(null)"), cfg->target_port,
+          EV_STR(modes[(cfg->rx_hex ? 2 : 0) + (cfg->tx_hex ? 1 : 0)]));
 
-    if (c->udp) {
-        udp_io_apply_config(c->udp, cfg);
-        udp_io_open(c->udp);
+    g_atomic_int_set(&c->proto, cfg->proto);
+    if (cfg->proto == NET_PROTO_TCP) {
+        if (c->udp) udp_io_close(c->udp);
+        if (c->tcp) {
+            tcp_io_apply_config(c->tcp, cfg);
+            tcp_io_open(c->tcp);
+        }
+    } else {
+        if (c->tcp) tcp_io_close(c->tcp);
+        if (c->udp) {
+            udp_io_apply_config(c->udp, cfg);
+            udp_io_open(c->udp);
+        }
     }
 }
 
 static void api_close(void* user) {
     AppController* c = (AppController*)user;
-    app_logf(c, "[NET] close requested");
+    EVLOG("[NET] close requested");
     if (c->udp) udp_io_close(c->udp);
+    if (c->tcp) tcp_io_close(c->tcp);
 }
 
 static void api_send_manual(void* user, const uint8_t* data, size_t len, int is_hex_mode) {
     AppController* c = (AppController*)user;
-    if (c->udp) udp_io_send(c->udp, data, len, is_hex_mode);
-    else app_logf(c, "[SEND] UDP not initialized");
+    if (c->udp || c->tcp) ctrl_send(c, data, len, is_hex_mode);
+    else EVLOG("[SEND] transport not initialized");
 }
 
 static void api_script_run(void* user, const char* script_text) {
     AppController* c = (AppController*)user;
+    if (script_vm_resume(c->vm)) {
+        if (c->script_state_set) c->script_state_set(c->ui_user, SCRIPT_RUNNING, "resumed");
+        EVLOG("[SCRIPT] RESUME");
+        return;
+    }
+
+    char err[256];
+    ScriptProgram* prog = script_compile(script_text, c->script_dir, c->includes, err, sizeof(err));
+    if (!prog) {
+        if (c->script_state_set) c->script_state_set(c->ui_user, SCRIPT_ERROR, err);
+        EVLOG("[SCRIPT] compile error: %S", EV_DUP(err));
+        return;
+    }
     if (c->script_state_set) c->script_state_set(c->ui_user, SCRIPT_RUNNING, "running");
-    app_logf(c, "[SCRIPT] RUN (%u bytes)", (unsigned)(script_text ? strlen(script_text) : 0));
-    // TODO:  parser/VMʱ print/log  log_append
+    EVLOG("[SCRIPT] RUN (%zu bytes)", script_text ? strlen(script_text) : 0);
+    // a run still going is replaced: log its send totals before the new thread sends
+    script_vm_stop(c->vm);
+    if (c->udp) udp_io_send_raw_flush(c->udp);
+    script_vm_start(c->vm, prog);
 }
 
 static void api_script_pause(void* user) {
     AppController* c = (AppController*)user;
+    if (!script_vm_pause(c->vm)) return;
     if (c->script_state_set) c->script_state_set(c->ui_user, SCRIPT_PAUSED, "paused");
-    app_logf(c, "[SCRIPT] PAUSE");
+    EVLOG("[SCRIPT] PAUSE");
 }
 
 static void api_script_stop(void* user) {
     AppController* c = (AppController*)user;
+    script_vm_stop(c->vm);
+    // the VM thread has exited, so its send totals can be logged from here
+    if (c->udp) udp_io_send_raw_flush(c->udp);
     if (c->script_state_set) c->script_state_set(c->ui_user, SCRIPT_STOPPED, "stopped");
-    app_logf(c, "[SCRIPT] STOP");
+    EVLOG("[SCRIPT] STOP");
+}
+
+static void script_set_dir(AppController* c, const char* path) {
+    if (!path) return;
+    g_free(c->script_dir);
+    c->script_dir = g_path_get_dirname(path);
 }
 
 static void api_script_load(void* user, const char* path) {
     AppController* c = (AppController*)user;
-    app_logf(c, "[SCRIPT] load file: %s", path ? path : "(null)");
+    script_set_dir(c, path);
+    EVLOG("[SCRIPT] load file: %S", EV_DUP(path ? path : "(null)"));
 }
 
 static void api_script_save(void* user, const char* path, const char* script_text) {
     AppController* c = (AppController*)user;
-    app_logf(c, "[SCRIPT] save file: %s (%u bytes)", path ? path : "(null)",
-         (unsigned)(script_text ? strlen(script_text) : 0));
+    script_set_dir(c, path);
+    EVLOG("[SCRIPT] save file: %S (%zu bytes)", EV_DUP(path ? path : "(null)"),
+          script_text ? strlen(script_text) : 0);
 }
 
 static void api_clear_log(void* user) {
+    (void)user;
+    EVLOG("[UI] log cleared");
+}
+
+static int api_capture_start(void* user, const char* path) {
+    AppController* c = (AppController*)user;
+    if (!c->udp || !path) {
+        EVLOG("[CAP] UDP not initialized");
+        return 0;
+    }
+    GError* err = NULL;
+    if (!udp_io_capture_start(c->udp, path, &err)) {
+        EVLOG("[CAP] start failed: %S", EV_DUP(err ? err->message : path));
+        g_clear_error(&err);
+        return 0;
+    }
+    return 1;
+}
+
+static void api_capture_stop(void* user) {
+    AppController* c = (AppController*)user;
+    if (c->udp) udp_io_capture_stop(c->udp);
+}
+
+static int api_metrics_export_start(void* user, const char* path) {
+    AppController* c = (AppController*)user;
+    if (!path) return 0;
+    GError* err = NULL;
+    if (!net_meter_export_start(c->meter, path, &err)) {
+        EVLOG("[METRICS] export failed: %S", EV_DUP(err ? err->message : path));
+        g_clear_error(&err);
+        return 0;
+    }
+    EVLOG("[METRICS] exporting once per second to %S", EV_DUP(path));
+    return 1;
+}
+
+static void api_metrics_export_stop(void* user) {
+    AppController* c = (AppController*)user;
+    if (net_meter_export_stop(c->meter)) EVLOG("[METRICS] export stopped");
+}
+
+static void probe_log_report(const ProbeStats* st, int send_errno) {
+    EVLOG("[PROBE] %s: %zu/%zu replies, %zu duplicate, %zu stale",
+          EV_STR(send_errno ? "failed" : "done"), (size_t)st->received, (size_t)st->sent,
+          (size_t)st->duplicates, (size_t)st->stale);
+    if (st->received) {
+        EVLOG("[PROBE] rtt us: min %zu p50 %zu p99 %zu p99.9 %zu max %zu",
+              (size_t)(st->min_ns / 1000), (size_t)(st->p50_ns / 1000), (size_t)(st->p99_ns / 1000),
+              (size_t)(st->p999_ns / 1000), (size_t)(st->max_ns / 1000));
+        EVLOG("[PROBE] timestamps: %zu hardware, %zu kernel, %zu user-space",
+              (size_t)st->by_source[PROBE_TS_HARDWARE], (size_t)st->by_source[PROBE_TS_SOFTWARE],
+              (size_t)st->by_source[PROBE_TS_USER]);
+    }
+    if (send_errno) EVLOG("[PROBE] send failed: errno=%d", send_errno);
+}
+
+static gpointer probe_thread(gpointer data) {
+    AppController* c = (AppController*)data;
+    int err = 0;
+    rtt_probe_run(c->probe, c->udp, &c->probe_cfg, &c->probe_cancel, &err);
+    ProbeStats st;
+    rtt_probe_stats(c->probe, &st);
+    probe_log_report(&st, err);
+    g_atomic_int_set(&c->probe_running, 0);
+    return NULL;
+}
+
+static void probe_join(AppController* c) {
+    if (!c->probe_thread) return;
+    g_atomic_int_set(&c->probe_cancel, 1);
+    g_thread_join(c->probe_thread);
+    c->probe_thread = NULL;
+}
+
+static int api_probe_start(void* user, const ProbeConfig* cfg) {
     AppController* c = (AppController*)user;
-    app_logf(c, "[UI] clear log requested (UI should clear its view)");
+    if (!cfg || !c->udp || g_atomic_int_get(&c->proto) != NET_PROTO_UDP) {
+        EVLOG("[PROBE] needs an open UDP config");
+        return 0;
+    }
+    if (app_controller_probing(c)) {
+        EVLOG("[PROBE] already running; stop it first");
+        return 0;
+    }
+    probe_join(c);
+    c->probe_cfg = *cfg;
+    g_atomic_int_set(&c->probe_cancel, 0);
+    g_atomic_int_set(&c->probe_running, 1);
+    c->probe_thread = g_thread_new("rtt-probe", probe_thread, c);
+    return 1;
+}
+
+static void api_probe_stop(void* user) {
+    probe_join((AppController*)user);
+}
+
+static gboolean meter_tick(gpointer data) {
+    AppController* c = (AppController*)data;
+    NetTotals t;
+    unsigned conns = app_controller_totals(c, &t);
+    ProbeStats rtt;
+    rtt_probe_stats(c->probe, &rtt);
+    // set from the moment the run is requested, not when its thread gets going
+    rtt.running = app_controller_probing(c);
+    NetSample s;
+    net_meter_sample(c->meter, &t, conns, &rtt, &s);
+    if (c->metrics) c->metrics(c->ui_user, &s);
+    return G_SOURCE_CONTINUE;
+}
+
+static void replay_log_report(const PcapReplayReport* rep, guint total, gboolean paced) {
+    const char* what = rep->send_errno ? "failed" : rep->cancelled ? "cancelled" : "done";
+    EVLOG("[REPLAY] %s: %zu/%u datagrams, %zu bytes in %u ms; %zu pps achieved",
+          EV_STR(what), (size_t)rep->packets, total, (size_t)rep->bytes,
+          (unsigned)(rep->elapsed_ns / 1000000), (size_t)rep->achieved_pps);
+    if (paced) {
+        EVLOG("[REPLAY] requested %zu pps (%u ms); timing error mean %u us, max %u us, %zu late",
+              (size_t)rep->requested_pps, (unsigned)(rep->requested_ns / 1000000),
+              (unsigned)(rep->err_mean_ns / 1000), (unsigned)(rep->err_max_ns / 1000), (size_t)rep->late);
+    } else {
+        EVLOG("[REPLAY] unpaced (as fast as possible)");
+    }
+    if (rep->send_errno) EVLOG("[REPLAY] send failed: errno=%d", rep->send_errno);
+}
+
+static gpointer replay_thread(gpointer data) {
+    ReplayJob* j = (ReplayJob*)data;
+    AppController* c = j->c;
+
+    GError* err = NULL;
+    PcapReplay* r = pcap_replay_open(j->path, &err);
+    if (!r) {
+        EVLOG("[REPLAY] open failed: %S", EV_DUP(err ? err->message : j->path));
+        g_clear_error(&err);
+    } else {
+        EVLOG("[REPLAY] %S: %u datagrams (%u other packets skipped, %u truncated), span %u ms, %s",
+              EV_DUP(j->path), pcap_replay_count(r), pcap_replay_skipped(r), pcap_replay_truncated(r),
+              (unsigned)(pcap_replay_span_ns(r) / 1000000),
+              EV_STR(j->speed > 0 ? "paced" : "as fast as possible"));
+        PcapReplayReport rep;
+        pcap_replay_run(r, c->udp, j->speed, &c->replay_cancel, &rep);
+        replay_log_report(&rep, pcap_replay_count(r), j->speed > 0);
+        pcap_replay_free(r);
+    }
+
+    g_free(j->path);
+    g_free(j);
+    g_atomic_int_set(&c->replay_running, 0);
+    return NULL;
+}
+
+static void replay_join(AppController* c) {
+    if (!c->replay_thread) return;
+    g_atomic_int_set(&c->replay_cancel, 1);
+    g_thread_join(c->replay_thread);
+    c->replay_thread = NULL;
+}
+
+static void api_replay_start(void* user, const char* path, double speed) {
+    AppController* c = (AppController*)user;
+    if (!c->udp || !path) {
+        EVLOG("[REPLAY] UDP not initialized");
+        return;
+    }
+    if (g_atomic_int_get(&c->replay_running)) {
+        EVLOG("[REPLAY] already running; stop it first");
+        return;
+    }
+    replay_join(c);
+
+    ReplayJob* j = g_new0(ReplayJob, 1);
+    j->c = c;
+    j->path = g_strdup(path);
+    j->speed = speed;
+    g_atomic_int_set(&c->replay_cancel, 0);
+    g_atomic_int_set(&c->replay_running, 1);
+    c->replay_thread = g_thread_new("pcap-replay", replay_thread, j);
+}
+
+static void api_replay_stop(void* user) {
+    AppController* c = (AppController*)user;
+    if (!c->replay_thread) return;
+    replay_join(c);
 }
 
 AppController* app_controller_new(void) {
@@ -104,6 +399,14 @@ AppController* app_controller_new(void) {
     c->api.on_script_load_file = api_script_load;
     c->api.on_script_save_file = api_script_save;
     c->api.on_clear_log = api_clear_log;
+    c->api.on_capture_start = api_capture_start;
+    c->api.on_capture_stop = api_capture_stop;
+    c->api.on_replay_start = api_replay_start;
+    c->api.on_replay_stop = api_replay_stop;
+    c->api.on_metrics_export_start = api_metrics_export_start;
+    c->api.on_metrics_export_stop = api_metrics_export_stop;
+    c->api.on_probe_start = api_probe_start;
+    c->api.on_probe_stop = api_probe_stop;
 
     // Ĭãʾ
     c->last_cfg.local_ip = "127.0.0.1";
@@ -112,15 +415,33 @@ AppController* app_controller_new(void) {
     c->last_cfg.target_port = 9001;
     c->last_cfg.rx_hex = 1;
     c->last_cfg.tx_hex = 1;
+    c->last_cfg.tcp_clients = 1;
+    c->last_cfg.frame_delim = '\n';
 
     c->udp = NULL;
+    c->meter = net_meter_new();
+    c->probe = rtt_probe_new();
+
+    ScriptHost host = { vm_host_send, vm_host_log, vm_host_state, c };
+    c->vm = script_vm_new(&host);
+    c->includes = script_include_cache_new();
 
     return c;
 }
 
 void app_controller_free(AppController* c) {
     if (!c) return;
+    if (c->meter_timer) g_source_remove(c->meter_timer);
+    net_meter_free(c->meter);
+    replay_join(c);
+    probe_join(c);
+    script_vm_free(c->vm);
+    script_include_cache_free(c->includes);
+    g_free(c->script_dir);
+    log_queue_free(c->vm_logq);
     if (c->udp) udp_io_free(c->udp);
+    if (c->tcp) tcp_io_free(c->tcp);
+    rtt_probe_free(c->probe);
     free(c);
 }
 
@@ -135,15 +456,49 @@ void* app_controller_user(AppController* c) {
 void app_controller_bind_ui(AppController* c, void* ui_user,
                             ui_log_append_fn log_append,
                             ui_script_state_fn script_state_set,
-                            ui_packet_append_fn pkt_append) {
+                            ui_packet_append_fn pkt_append,
+                            ui_metrics_fn metrics) {
     if (!c) return;
     c->ui_user = ui_user;
     c->log_append = log_append;
     c->script_state_set = script_state_set;
     c->pkt_append = pkt_append;
+    c->metrics = metrics;
+    if (!c->meter_timer) c->meter_timer = g_timeout_add_seconds(1, meter_tick, c);
+
+    if (!c->vm_logq && log_append) c->vm_logq = log_queue_new(log_append, ui_user);
 
-    if (!c->udp && log_append) {
-        c->udp = udp_io_new(log_append, ui_user, pkt_append, ui_user);
+    if (!c->udp) {
+        c->udp = udp_io_new(pkt_append, ui_user);
+        udp_io_set_probe(c->udp, c->probe);
         udp_io_apply_config(c->udp, &c->last_cfg);
     }
+    if (!c->tcp) {
+        c->tcp = tcp_io_new(pkt_append, ui_user);
+        tcp_io_apply_config(c->tcp, &c->last_cfg);
+    }
+}
+
+unsigned app_controller_totals(AppController* c, NetTotals* out) {
+    if (!out) return 0;
+    memset(out, 0, sizeof(*out));
+    if (!c) return 0;
+    if (g_atomic_int_get(&c->proto) == NET_PROTO_TCP) {
+        tcp_io_counters(c->tcp, out);
+        return c->tcp ? tcp_io_conn_count(c->tcp) : 0;
+    }
+    udp_io_counters(c->udp, out, NULL, 0);
+    return 0;
+}
+
+int app_controller_replaying(AppController* c) {
+    return c ? g_atomic_int_get(&c->replay_running) : 0;
+}
+
+int app_controller_probing(AppController* c) {
+    return c ? g_atomic_int_get(&c->probe_running) : 0;
+}
+
+void app_controller_probe_stats(AppController* c, ProbeStats* out) {
+    rtt_probe_stats(c ? c->probe : NULL, out);
 }
@@ -18,12 +18,30 @@ void* app_controller_user(AppController* c);
 // controller -> UI ĻصUI ڴʱעᣩ
 typedef void (*ui_log_append_fn)(void* ui_user, const char* line);
 typedef void (*ui_script_state_fn)(void* ui_user, ScriptState st, const char* detail);
-typedef void (*ui_packet_append_fn)(void* ui_user, const uint8_t* data, size_t len);
+typedef void (*ui_packet_append_fn)(void* ui_user, const uint8_t* data, size_t len,
+                                    const UdpPeer* from, int64_t ts_us);
+// once per second on the main loop, while bound
+typedef void (*ui_metrics_fn)(void* ui_user, const NetSample* s);
 
 void app_controller_bind_ui(AppController* c, void* ui_user,
                             ui_log_append_fn log_append,
                             ui_script_state_fn script_state_set,
-                            ui_packet_append_fn pkt_append);
+                            ui_packet_append_fn pkt_append,
+                            ui_metrics_fn metrics);
+
+// traffic counters of the transport selected by the last applied config;
+// packets are datagrams (UDP) or framed messages (TCP). Returns the number of
+// open TCP connections (0 for UDP). Any thread; counters restart when the
+// config is applied again.
+unsigned app_controller_totals(AppController* c, NetTotals* out);
+
+// 1 while a pcap replay started through on_replay_start is still sending
+int app_controller_replaying(AppController* c);
+
+// 1 while an RTT probe run is sending or waiting for its last replies
+int app_controller_probing(AppController* c);
+// RTT distribution of the current or last probe run; any thread
+void app_controller_probe_stats(AppController* c, ProbeStats* out);
 
 #ifdef __cplusplus
 }
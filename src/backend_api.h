@@ -9,6 +9,21 @@ extern "C" {
 // UI -> Backend ġ/ͼӿڣ controller ʵ֣
 // ԰Щӳ䵽DSL parser/VM + UDP socket + timers
 
+typedef enum {
+    NET_PROTO_UDP = 0,
+    NET_PROTO_TCP
+} NetProto;
+
+// how a TCP byte stream is split into messages
+typedef enum {
+    NET_FRAME_NONE = 0,     // every read is one message; sends go out as-is
+    NET_FRAME_LEN32,        // 4-byte big-endian length prefix
+    NET_FRAME_DELIM         // terminated by frame_delim (added on send, stripped on receive)
+} NetFraming;
+
+// NetConfig.rx_shards upper bound
+#define NET_MAX_RX_SHARDS 64
+
 typedef struct {
     const char* local_ip;
     int         local_port;
@@ -18,8 +33,82 @@ typedef struct {
 
     int         rx_hex;     // 1=HEX, 0=ASCII
     int         tx_hex;     // 1=HEX, 0=ASCII
+
+    int         rx_batch;   // datagrams per receive syscall (0=default, 1=one at a time)
+    int         rx_shards;  // UDP sockets/threads sharing local_port via SO_REUSEPORT (0/1=one)
+    int         reflect;    // UDP: send every datagram back to its sender instead of showing it
+
+    NetProto    proto;
+    int         tcp_server;  // TCP: 1=listen on local_ip:local_port, 0=connect to target
+    int         tcp_clients; // TCP client: connections to open at once (0=1)
+    NetFraming  framing;     // TCP only
+    int         frame_delim; // delimiter byte for NET_FRAME_DELIM
 } NetConfig;
 
+// raw IPv4 peer (network byte order); formatted only when something shows it
+typedef struct {
+    uint32_t addr;
+    uint16_t port;
+} UdpPeer;
+
+// traffic counters of the active transport since it was last opened
+typedef struct {
+    uint64_t rx_packets;    // datagrams (UDP) or framed messages (TCP)
+    uint64_t rx_bytes;
+    uint64_t rx_truncated;  // larger than the receive buffer
+    uint64_t rx_dropped;    // display ring full (the data was received but not shown)
+    uint64_t rx_errors;
+    uint64_t tx_packets;
+    uint64_t tx_bytes;
+    uint64_t tx_dropped;    // TCP: send backlog full; UDP reflector: send buffer full
+    uint64_t tx_errors;
+} NetTotals;
+
+// UDP round-trip probe: sequence-numbered datagrams the target echoes back unchanged
+typedef struct {
+    unsigned rate;          // probes per second (0=100)
+    unsigned count;         // probes to send (0=until stopped)
+    unsigned size;          // datagram size in bytes (0 or less than the header=header only)
+} ProbeConfig;
+
+// which clocks an RTT sample was taken with, best first
+typedef enum {
+    PROBE_TS_HARDWARE = 0,  // NIC timestamps on both the probe and the reply
+    PROBE_TS_SOFTWARE,      // kernel timestamps (SO_TIMESTAMPING)
+    PROBE_TS_USER,          // clock_gettime() in the sender and the receive thread
+    PROBE_TS_COUNT
+} ProbeTsSource;
+
+// RTT distribution of the current or last probe run; latencies in nanoseconds
+typedef struct {
+    int      running;
+    uint64_t sent;
+    uint64_t received;
+    uint64_t duplicates;
+    uint64_t stale;         // replies for probes of an earlier run or already overwritten
+    uint64_t by_source[PROBE_TS_COUNT];
+    int64_t  min_ns;
+    int64_t  mean_ns;
+    int64_t  p50_ns;
+    int64_t  p90_ns;
+    int64_t  p99_ns;
+    int64_t  p999_ns;
+    int64_t  max_ns;
+} ProbeStats;
+
+// one per-second sample of the counters, pushed to the UI and the metrics export
+typedef struct {
+    int64_t   wall_us;      // g_get_real_time() when sampled
+    double    elapsed_s;    // since sampling began
+    NetTotals total;
+    double    rx_pps;
+    double    rx_bps;       // bits per second
+    double    tx_pps;
+    double    tx_bps;
+    unsigned  conns;        // TCP: connections open
+    ProbeStats rtt;         // latest RTT probe run (all zero before the first one)
+} NetSample;
+
 typedef enum {
     SCRIPT_STOPPED = 0,
     SCRIPT_RUNNING,
@@ -46,6 +135,22 @@ typedef struct BackendAPI {
 
     // --- ־ ---
     void (*on_clear_log)(void* user);
+
+    // --- pcapng capture of sent/received datagrams; start returns 0 on failure ---
+    int  (*on_capture_start)(void* user, const char* path);
+    void (*on_capture_stop)(void* user);
+
+    // --- replay a pcap/pcapng file to the target; speed 1=original timing, <=0=as fast as possible ---
+    void (*on_replay_start)(void* user, const char* path, double speed);
+    void (*on_replay_stop)(void* user);
+
+    // --- per-second traffic metrics to a .csv file (JSON Lines otherwise); start returns 0 on failure ---
+    int  (*on_metrics_export_start)(void* user, const char* path);
+    void (*on_metrics_export_stop)(void* user);
+
+    // --- UDP RTT probe to the target (which must echo); start returns 0 on failure ---
+    int  (*on_probe_start)(void* user, const ProbeConfig* cfg);
+    void (*on_probe_stop)(void* user);
 } BackendAPI;
 
 #ifdef __cplusplus
@@ -0,0 +1,591 @@
+#include "crc.h"
+#include "hexfmt.h"
+#include "rng.h"
+#include "event_log.h"
+#include "mono_clock.h"
+#include "script_highlight.h"
+#include "script_vm.h"
+#include "udp_io.h"
+#include "rtt_probe.h"
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+
+// Benchmark harness without GTK (make bench). Times the hot paths one by one,
+// prints the results as JSON (one result per line, so baselines diff well) and,
+// given --baseline, flags every result that got worse by more than its
+// tolerance. Exit status: 0 ok, 1 regression with --strict, 2 bad arguments.
+
+#define BENCH_ROUNDS 15                 // best of, so one quiet stretch is enough
+#define BENCH_MAX_RESULTS 32
+#define HL_SCRIPT_LINES 20000
+
+typedef struct {
+    const char* name;
+    const char* unit;
+    double value;
+    gboolean higher_better;
+    double tolerance;       // percent
+    double baseline;        // NAN when the baseline has no such result
+} BenchResult;
+
+typedef struct {
+    gboolean quick;
+    gint port;
+    char* filter;
+    gint64 round_ns;        // minimum length of one timing round
+
+    BenchResult res[BENCH_MAX_RESULTS];
+    int nres;
+} Bench;
+
+static gboolean bench_wanted(const Bench* b, const char* group) {
+    return !b->filter || strstr(group, b->filter) != NULL;
+}
+
+static void bench_add(Bench* b, const char* name, const char* unit, double value,
+                      gboolean higher_better, double tolerance) {
+    if (b->nres >= BENCH_MAX_RESULTS) return;
+    BenchResult* r = &b->res[b->nres++];
+    r->name = name;
+    r->unit = unit;
+    r->value = value;
+    r->higher_better = higher_better;
+    r->tolerance = tolerance;
+    r->baseline = NAN;
+    fprintf(stderr, "  %-28s %12.2f %s\n", name, value, unit);
+}
+
+// best-of-BENCH_ROUNDS nanoseconds per call of fn(arg)
+static double time_per_call(const Bench* b, void (*fn)(void*), void* arg) {
+    double best = 0;
+    for (int round = 0; round < BENCH_ROUNDS; ++round) {
+        guint64 calls = 0;
+        gint64 t0 = mono_clock_ns(), t;
+        do {
+            fn(arg);
+            calls++;
+            t = mono_clock_ns();
+        } while (t - t0 < b->round_ns);
+        double per = (double)(t - t0) / (double)calls;
+        if (round == 0 || per < best) best = per;
+    }
+    return best;
+}
+
+static double mb_per_s(size_t bytes, double ns) {
+    return ns > 0 ? (double)bytes / ns * 1e9 / (1024.0 * 1024.0) : 0;
+}
+
+// --- hex ---------------------------------------------------------------------------
+
+#define HEX_BYTES 65536
+
+typedef struct {
+    uint8_t* bin;
+    char* text;             // hex digits of bin, spaced ("de ad be ef ...") or dense
+    size_t text_len;
+    uint8_t* out;
+    char* dump;
+    size_t dump_cap;
+} HexJob;
+
+static void run_hex_decode(void* arg) {
+    HexJob* j = arg;
+    size_t n = 0, err = 0;
+    hex_decode(j->out, HEX_BYTES, j->text, j->text_len, &n, &err);
+}
+
+static void run_hex_encode(void* arg) {
+    HexJob* j = arg;
+    hex_encode(j->text, j->bin, HEX_BYTES, FALSE);
+}
+
+static void run_hexdump(void* arg) {
+    HexJob* j = arg;
+    hexdump_format(j->dump, j->dump_cap, j->bin, HEX_BYTES);
+}
+
+static void bench_hex(Bench* b) {
+    HexJob j;
+    j.bin = g_malloc(HEX_BYTES);
+    j.out = g_malloc(HEX_BYTES);
+    j.text = g_malloc(HEX_BYTES * 3);
+    j.dump_cap = HEXDUMP_SIZE(HEX_BYTES);
+    j.dump = g_malloc(j.dump_cap);
+    guint32 x = 2463534242u;
+    for (size_t i = 0; i < HEX_BYTES; ++i) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        j.bin[i] = (uint8_t)x;
+    }
+
+    // what people type into the send box
+    hex_encode(j.text, j.bin, HEX_BYTES, FALSE);
+    char* spaced = g_malloc(HEX_BYTES * 3);
+    for (size_t i = 0; i < HEX_BYTES; ++i) {
+        spaced[i * 3] = j.text[i * 2];
+        spaced[i * 3 + 1] = j.text[i * 2 + 1];
+        spaced[i * 3 + 2] = ' ';
+    }
+    char* dense = j.text;
+    j.text = spaced;
+    j.text_len = HEX_BYTES * 3 - 1;
+    bench_add(b, "hex_decode_spaced", "MB/s", mb_per_s(j.text_len, time_per_call(b, run_hex_decode, &j)), TRUE, 10);
+    j.text = dense;
+    j.text_len = HEX_BYTES * 2;
+    bench_add(b, "hex_decode_dense", "MB/s", mb_per_s(j.text_len, time_per_call(b, run_hex_decode, &j)), TRUE, 10);
+
+    bench_add(b, "hex_encode", "MB/s", mb_per_s(HEX_BYTES, time_per_call(b, run_hex_encode, &j)), TRUE, 10);
+    bench_add(b, "hexdump_format", "MB/s", mb_per_s(HEX_BYTES, time_per_call(b, run_hexdump, &j)), TRUE, 10);
+
+    g_free(spaced);
+    g_free(dense);
+    g_free(j.bin);
+    g_free(j.out);
+    g_free(j.dump);
+}
+
+// --- random payloads ---------------------------------------------------------------
+
+#define RNG_PAYLOAD 1400            // the preset script's largest rand_bytes()
+
+typedef struct {
+    Rng rng;
+    uint8_t* buf;
+    size_t len;
+} RngJob;
+
+static void run_rng_fill(void* arg) {
+    RngJob* j = arg;
+    rng_fill(&j->rng, j->buf, j->len);
+}
+
+static void bench_rng(Bench* b) {
+    RngJob j;
+    rng_seed(&j.rng, 1);
+    j.buf = g_malloc(HEX_BYTES);
+    j.len = RNG_PAYLOAD;
+    bench_add(b, "rng_fill_1400", "MB/s", mb_per_s(j.len, time_per_call(b, run_rng_fill, &j)), TRUE, 10);
+    j.len = HEX_BYTES;
+    bench_add(b, "rng_fill_64k", "MB/s", mb_per_s(j.len, time_per_call(b, run_rng_fill, &j)), TRUE, 10);
+    g_free(j.buf);
+}
+
+// --- checksums -----------------------------------------------------------------------
+
+typedef struct {
+    CrcKind kind;
+    const uint8_t* data;
+    size_t len;
+} CrcJob;
+
+static void run_crc(void* arg) {
+    CrcJob* j = arg;
+    volatile uint32_t sink = crc_compute(j->kind, j->data, j->len);
+    (void)sink;
+}
+
+static void bench_crc(Bench* b) {
+    static const struct { CrcKind kind; const char* name; } kinds[] = {
+        { CRC16_CCITT, "crc16_ccitt_1400" },
+        { CRC16_MODBUS, "crc16_modbus_1400" },
+        { CRC32_IEEE, "crc32_1400" },
+        { CRC32_C, "crc32c_1400" },
+    };
+    Rng rng;
+    uint8_t frame[RNG_PAYLOAD];
+    rng_seed(&rng, 2);
+    rng_fill(&rng, frame, sizeof(frame));
+    for (size_t i = 0; i < G_N_ELEMENTS(kinds); ++i) {
+        CrcJob j = { kinds[i].kind, frame, sizeof(frame) };
+        bench_add(b, kinds[i].name, "MB/s", mb_per_s(j.len, time_per_call(b, run_crc, &j)), TRUE, 10);
+    }
+}
+
+// --- script send loop ----------------------------------------------------------------
+
+#define SCRIPT_PACKETS 200000
+
+// the preset's loop without the sleep, plus a header and a checksum
+static const char bench_send_script[] =
+    "rand_seed(5)\n"
+    "hdr = \"\\xAA\\x55\"\n"
+    "n = 0\n"
+    "while n < " G_STRINGIFY(SCRIPT_PACKETS) " {\n"
+    "  payload = rand_bytes(rand_int(20, 1400))\n"
+    "  frame = hdr + payload\n"
+    "  udp.send(frame)\n"
+    "  c = crc16(frame, \"modbus\")\n"
+    "  n = n + 1\n"
+    "}\n";
+
+typedef struct {
+    guint64 packets;
+    gint done;
+} ScriptJob;
+
+static gboolean count_send(void* user, const uint8_t* data, size_t len) {
+    (void)data;
+    (void)len;
+    ((ScriptJob*)user)->packets++;
+    return TRUE;
+}
+
+static void script_state(void* user, ScriptState st, const char* detail) {
+    (void)detail;
+    if (st != SCRIPT_RUNNING) g_atomic_int_set(&((ScriptJob*)user)->done, 1);
+}
+
+static void bench_script(Bench* b) {
+    double best = 0;
+    for (int round = 0; round < (b->quick ? 1 : 3); ++round) {
+        ScriptJob j = { 0, 0 };
+        ScriptHost host = { count_send, NULL, script_state, &j };
+        ScriptVm* vm = script_vm_new(&host);
+        char err[256];
+        ScriptProgram* prog = script_compile(bench_send_script, NULL, NULL, err, sizeof(err));
+        if (!prog) {
+            fprintf(stderr, "  script: %s\n", err);
+            script_vm_free(vm);
+            return;
+        }
+        gint64 t0 = mono_clock_ns();
+        script_vm_start(vm, prog);
+        while (!g_atomic_int_get(&j.done)) g_usleep(200);
+        double per = (double)(mono_clock_ns() - t0) / (double)(j.packets ? j.packets : 1);
+        script_vm_free(vm);
+        if (round == 0 || per < best) best = per;
+    }
+    bench_add(b, "script_send_loop", "ns/pkt", best, FALSE, 15);
+}
+
+// --- highlighting ------------------------------------------------------------------
+
+static const char* const hl_lines[] = {
+    "%define PORT 9000",
+    "// send a burst of sequence-numbered frames",
+    "loop 100 {",
+    "    let n = rand_int(1, 255)",
+    "    udp.send(\"AA 55 01 02 \" + n)",
+    "    printf(\"sent %d crc %04x\\n\", n, crc16(rand_bytes(8)))",
+    "    if (byte_at(n, 0) >= 0x80) { continue }",
+    "    sleep(10)",
+    "}",
+};
+
+static void count_span(void* user, ScriptHlKind kind, int start, int end) {
+    (void)kind; (void)start; (void)end;
+    (*(guint*)user)++;
+}
+
+static void run_highlight(void* arg) {
+    guint spans = 0;
+    script_highlight_scan(arg, count_span, &spans);
+}
+
+static void bench_highlight(Bench* b) {
+    GString* s = g_string_sized_new(HL_SCRIPT_LINES * 40);
+    for (int i = 0; i < HL_SCRIPT_LINES; ++i) {
+        g_string_append(s, hl_lines[i % G_N_ELEMENTS(hl_lines)]);
+        g_string_append_c(s, '\n');
+    }
+    double ns = time_per_call(b, run_highlight, s->str);
+    bench_add(b, "highlight_20k_lines", "ms", ns / 1e6, FALSE, 10);
+    g_string_free(s, TRUE);
+}
+
+// --- event log ---------------------------------------------------------------------
+
+#define LOG_BATCH 512
+
+typedef struct {
+    EvRecord recs[4];
+    GString* line;
+} LogJob;
+
+static void run_log_format(void* arg) {
+    LogJob* j = arg;
+    for (int i = 0; i < LOG_BATCH; ++i) {
+        g_string_truncate(j->line, 0);
+        evlog_format_record(&j->recs[i & 3], j->line);
+    }
+}
+
+static void run_log_emit(void* arg) {
+    (void)arg;
+    UdpPeer peer = { 0x0100007f, 0x2823 };
+    // stays below the per-thread ring size, so nothing is dropped
+    for (int i = 0; i < LOG_BATCH; ++i)
+        EVLOG("[RECV] %zu bytes from %a", (size_t)i, EV_PEER(&peer));
+    evlog_collect();
+}
+
+static void bench_log(Bench* b) {
+    LogJob j;
+    memset(&j, 0, sizeof(j));
+    j.line = g_string_sized_new(256);
+    UdpPeer peer = { 0x0100007f, 0x2823 };
+    const char* fmts[4] = {
+        "[RECV] %zu bytes from %a",
+        "[SEND] %u datagrams, %zu bytes to %a",
+        "[NET] UDP bound at %s:%d",
+        "[SCRIPT] line %d: %s (0x%08x)",
+    };
+    uint64_t args[4][3] = {
+        { 1472, EV_PEER(&peer), 0 },
+        { 64, 65536, EV_PEER(&peer) },
+        { EV_STR("127.0.0.1"), 9000, 0 },
+        { 42, EV_STR("checksum mismatch"), 0xdeadbeef },
+    };
+    unsigned nargs[4] = { 2, 3, 2, 3 };
+    for (int i = 0; i < 4; ++i) {
+        j.recs[i].fmt = fmts[i];
+        j.recs[i].nargs = nargs[i];
+        memcpy(j.recs[i].args, args[i], sizeof(args[i]));
+    }
+    bench_add(b, "evlog_format_record", "ns/op", time_per_call(b, run_log_format, &j) / LOG_BATCH, FALSE, 10);
+    bench_add(b, "evlog_emit_collect", "ns/op", time_per_call(b, run_log_emit, NULL) / LOG_BATCH, FALSE, 15);
+    evlog_clear();
+    g_string_free(j.line, TRUE);
+}
+
+// --- UDP loopback ------------------------------------------------------------------
+
+static UdpIo* bench_udp_open(int local_port, int target_port, gboolean reflect) {
+    NetConfig cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.local_ip = "127.0.0.1";
+    cfg.local_port = local_port;
+    cfg.target_ip = "127.0.0.1";
+    cfg.target_port = target_port;
+    cfg.proto = NET_PROTO_UDP;
+    cfg.reflect = reflect ? 1 : 0;
+    // no packet callback: received data is counted, never copied for display
+    UdpIo* io = udp_io_new(NULL, NULL);
+    if (!udp_io_apply_config(io, &cfg) || !udp_io_open(io)) {
+        fprintf(stderr, "  cannot open UDP 127.0.0.1:%d\n", local_port);
+        udp_io_free(io);
+        return NULL;
+    }
+    return io;
+}
+
+static guint64 rx_packets(UdpIo* io) {
+    NetTotals t;
+    udp_io_counters(io, &t, NULL, 0);
+    return t.rx_packets;
+}
+
+#define UDP_PAYLOAD 64
+#define UDP_CHUNK 1024
+
+static void bench_udp_throughput(Bench* b) {
+    UdpIo* rx = bench_udp_open(b->port, b->port + 1, FALSE);
+    UdpIo* tx = rx ? bench_udp_open(b->port + 1, b->port, FALSE) : NULL;
+    if (!tx) {
+        udp_io_free(rx);
+        return;
+    }
+    static uint8_t payload[UDP_PAYLOAD];
+    const uint8_t* data[UDP_CHUNK];
+    size_t lens[UDP_CHUNK];
+    for (int i = 0; i < UDP_CHUNK; ++i) {
+        data[i] = payload;
+        lens[i] = sizeof(payload);
+    }
+
+    size_t total = b->quick ? 200000 : 2000000;
+    size_t sent = 0;
+    int err = 0;
+    gint64 t0 = mono_clock_ns();
+    while (sent < total) {
+        size_t n = udp_io_send_many(tx, data, lens, MIN((size_t)UDP_CHUNK, total - sent), &err);
+        sent += n;
+        if (n == 0 && err != EAGAIN && err != ENOBUFS && err != EINTR) break;
+    }
+    gint64 t_sent = mono_clock_ns();
+
+    // the receive side is done once its counter stops moving
+    guint64 got = 0;
+    gint64 t_last = t_sent;
+    for (gint64 idle_since = mono_clock_ns(); mono_clock_ns() - idle_since < 200000000; ) {
+        guint64 now_got = rx_packets(rx);
+        if (now_got != got) {
+            got = now_got;
+            t_last = idle_since = mono_clock_ns();
+            if (got >= sent) break;
+        }
+        g_usleep(1000);
+    }
+    evlog_collect();
+
+    bench_add(b, "udp_loopback_tx_pps", "pps", (double)sent * 1e9 / (double)MAX(t_sent - t0, 1), TRUE, 25);
+    bench_add(b, "udp_loopback_rx_pps", "pps", (double)got * 1e9 / (double)MAX(t_last - t0, 1), TRUE, 25);
+    bench_add(b, "udp_loopback_delivered", "%", sent ? 100.0 * (double)got / (double)sent : 0, TRUE, 25);
+    udp_io_free(tx);
+    udp_io_free(rx);
+}
+
+static void bench_udp_latency(Bench* b) {
+    UdpIo* refl = bench_udp_open(b->port + 2, b->port + 3, TRUE);
+    UdpIo* io = refl ? bench_udp_open(b->port + 3, b->port + 2, FALSE) : NULL;
+    if (!io) {
+        udp_io_free(refl);
+        return;
+    }
+    RttProbe* probe = rtt_probe_new();
+    udp_io_set_probe(io, probe);
+    ProbeConfig cfg = { 20000, b->quick ? 5000 : 50000, UDP_PAYLOAD };
+    int err = 0;
+    rtt_probe_run(probe, io, &cfg, NULL, &err);
+    ProbeStats st;
+    rtt_probe_stats(probe, &st);
+    evlog_collect();
+    if (err) {
+        fprintf(stderr, "  probe send failed: %s\n", g_strerror(err));
+    } else if (st.received) {
+        bench_add(b, "udp_rtt_p50", "us", (double)st.p50_ns / 1000.0, FALSE, 50);
+        bench_add(b, "udp_rtt_p99", "us", (double)st.p99_ns / 1000.0, FALSE, 50);
+        bench_add(b, "udp_rtt_replied", "%", 100.0 * (double)st.received / (double)MAX(st.sent, 1), TRUE, 25);
+    }
+    udp_io_set_probe(io, NULL);
+    udp_io_free(io);
+    udp_io_free(refl);
+    rtt_probe_free(probe);
+}
+
+// --- baseline ----------------------------------------------------------------------
+
+// pull "name"/"value" pairs out of a file written by bench_write (one result per line)
+static gboolean baseline_load(Bench* b, const char* path) {
+    char* text = NULL;
+    GError* err = NULL;
+    if (!g_file_get_contents(path, &text, NULL, &err)) {
+        fprintf(stderr, "baseline: %s\n", err->message);
+        g_clear_error(&err);
+        return FALSE;
+    }
+    for (char* line = text; line && *line; ) {
+        char* next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+        const char* name = strstr(line, "\"name\": \"");
+        const char* value = strstr(line, "\"value\": ");
+        if (name && value) {
+            name += strlen("\"name\": \"");
+            const char* q = strchr(name, '"');
+            for (int i = 0; q && i < b->nres; ++i) {
+                if (strlen(b->res[i].name) == (size_t)(q - name) && strncmp(b->res[i].name, name, (size_t)(q - name)) == 0)
+                    b->res[i].baseline = g_ascii_strtod(value + strlen("\"value\": "), NULL);
+            }
+        }
+        line = next;
+    }
+    g_free(text);
+    return TRUE;
+}
+
+// signed change in percent, positive = better
+static double change_pct(const BenchResult* r) {
+    if (isnan(r->baseline) || r->baseline == 0) return 0;
+    double d = (r->value - r->baseline) / r->baseline * 100.0;
+    return r->higher_better ? d : -d;
+}
+
+static gboolean regressed(const BenchResult* r) {
+    return !isnan(r->baseline) && change_pct(r) < -r->tolerance;
+}
+
+static int report(const Bench* b) {
+    int bad = 0;
+    fprintf(stderr, "\n%-28s %12s %12s %9s\n", "benchmark", "value", "baseline", "change");
+    for (int i = 0; i < b->nres; ++i) {
+        const BenchResult* r = &b->res[i];
+        if (isnan(r->baseline)) {
+            fprintf(stderr, "%-28s %12.2f %12s %9s\n", r->name, r->value, "-", "new");
+            continue;
+        }
+        gboolean reg = regressed(r);
+        if (reg) bad++;
+        fprintf(stderr, "%-28s %12.2f %12.2f %+8.1f%%%s\n", r->name, r->value, r->baseline, change_pct(r),
+                reg ? "  REGRESSION" : "");
+    }
+    if (bad) fprintf(stderr, "%d regression(s) beyond tolerance\n", bad);
+    return bad;
+}
+
+static void bench_write(const Bench* b, FILE* f) {
+    fprintf(f, "{\n  \"version\": 1,\n  \"quick\": %s,\n  \"results\": [\n", b->quick ? "true" : "false");
+    for (int i = 0; i < b->nres; ++i) {
+        const BenchResult* r = &b->res[i];
+        fprintf(f, "    {\"name\": \"%s\", \"unit\": \"%s\", \"value\": %.3f, \"better\": \"%s\", \"tolerance_pct\": %.0f",
+                r->name, r->unit, r->value, r->higher_better ? "higher" : "lower", r->tolerance);
+        if (!isnan(r->baseline))
+            fprintf(f, ", \"baseline\": %.3f, \"change_pct\": %.1f, \"regressed\": %s",
+                    r->baseline, change_pct(r), regressed(r) ? "true" : "false");
+        fprintf(f, "}%s\n", i + 1 < b->nres ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+int main(int argc, char** argv) {
+    Bench b;
+    memset(&b, 0, sizeof(b));
+    b.port = 47100;
+    char* out = NULL;
+    char* baseline = NULL;
+    gboolean strict = FALSE;
+
+    GOptionEntry entries[] = {
+        { "out", 'o', 0, G_OPTION_ARG_FILENAME, &out, "Write the JSON results here (default stdout)", "FILE" },
+        { "baseline", 'b', 0, G_OPTION_ARG_FILENAME, &baseline, "Compare against an earlier --out file", "FILE" },
+        { "strict", 0, 0, G_OPTION_ARG_NONE, &strict, "Exit with status 1 when anything regressed", NULL },
+        { "quick", 0, 0, G_OPTION_ARG_NONE, &b.quick, "Shorter runs (noisier numbers)", NULL },
+        { "filter", 'f', 0, G_OPTION_ARG_STRING, &b.filter, "Only run groups containing this (hex, rng, crc, script, highlight, log, udp)", "TEXT" },
+        { "port", 0, 0, G_OPTION_ARG_INT, &b.port, "First of four loopback UDP ports to use", "PORT" },
+        { NULL }
+    };
+    GOptionContext* octx = g_option_context_new("- netassist micro/macro benchmarks");
+    g_option_context_add_main_entries(octx, entries, NULL);
+    GError* err = NULL;
+    gboolean parsed = g_option_context_parse(octx, &argc, &argv, &err);
+    g_option_context_free(octx);
+    if (!parsed) {
+        fprintf(stderr, "%s\n", err->message);
+        g_clear_error(&err);
+        return 2;
+    }
+    b.round_ns = b.quick ? 10000000 : 60000000;
+
+    if (bench_wanted(&b, "hex")) bench_hex(&b);
+    if (bench_wanted(&b, "rng")) bench_rng(&b);
+    if (bench_wanted(&b, "crc")) bench_crc(&b);
+    if (bench_wanted(&b, "script")) bench_script(&b);
+    if (bench_wanted(&b, "highlight")) bench_highlight(&b);
+    if (bench_wanted(&b, "log")) bench_log(&b);
+    if (bench_wanted(&b, "udp")) {
+        bench_udp_throughput(&b);
+        bench_udp_latency(&b);
+    }
+    evlog_clear();
+
+    int bad = 0;
+    if (baseline && baseline_load(&b, baseline)) bad = report(&b);
+
+    int status = 0;
+    FILE* f = out ? fopen(out, "w") : stdout;
+    if (!f) {
+        fprintf(stderr, "%s: %s\n", out, g_strerror(errno));
+        status = 1;
+    } else {
+        bench_write(&b, f);
+        if (f != stdout) fclose(f);
+    }
+    if (strict && bad) status = 1;
+
+    g_free(out);
+    g_free(baseline);
+    g_free(b.filter);
+    return status;
+}
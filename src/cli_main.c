@@ -0,0 +1,6 @@
+#include "headless.h"
+
+// GTK-free build of the headless runner (make cli)
+int main(int argc, char** argv) {
+    return headless_main(argc, argv);
+}
@@ -0,0 +1,198 @@
+#include "crc.h"
+#include <string.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CRC_X86 1
+#endif
+
+typedef struct {
+    const char* name;
+    uint32_t poly;          // reflected variants: bit-reversed polynomial
+    uint32_t init;
+    uint32_t xorout;
+    gboolean reflected;
+} CrcParams;
+
+static const CrcParams k_params[CRC_KIND_COUNT] = {
+    [CRC16_CCITT]  = { "ccitt",  0x1021,     0xFFFF,     0,          FALSE },
+    [CRC16_MODBUS] = { "modbus", 0xA001,     0xFFFF,     0,          TRUE },
+    [CRC16_IBM]    = { "ibm",    0xA001,     0,          0,          TRUE },
+    [CRC32_IEEE]   = { "crc32",  0xEDB88320, 0xFFFFFFFF, 0xFFFFFFFF, TRUE },
+    [CRC32_C]      = { "crc32c", 0x82F63B78, 0xFFFFFFFF, 0xFFFFFFFF, TRUE },
+};
+
+// slicing-by-8: t[k][b] is the register after byte b followed by k zero bytes
+static uint32_t k_refl[CRC_KIND_COUNT][8][256];     // reflected variants
+static uint16_t k_msb[8][256];                      // CRC16_CCITT (MSB first)
+
+#if defined(CRC_X86)
+static gboolean have_pclmul;
+static gboolean have_sse42;
+#endif
+
+static void crc_init(void) {
+    static gsize ready = 0;
+    if (!g_once_init_enter(&ready)) return;
+    for (int kind = 0; kind < CRC_KIND_COUNT; ++kind) {
+        if (!k_params[kind].reflected) continue;
+        uint32_t (*t)[256] = k_refl[kind];
+        for (uint32_t b = 0; b < 256; ++b) {
+            uint32_t c = b;
+            for (int i = 0; i < 8; ++i) c = (c & 1) ? (c >> 1) ^ k_params[kind].poly : c >> 1;
+            t[0][b] = c;
+        }
+        for (int k = 1; k < 8; ++k) {
+            for (int b = 0; b < 256; ++b) t[k][b] = (t[k - 1][b] >> 8) ^ t[0][t[k - 1][b] & 0xff];
+        }
+    }
+    for (uint32_t b = 0; b < 256; ++b) {
+        uint16_t c = (uint16_t)(b << 8);
+        for (int i = 0; i < 8; ++i) c = (c & 0x8000) ? (uint16_t)((c << 1) ^ k_params[CRC16_CCITT].poly) : (uint16_t)(c << 1);
+        k_msb[0][b] = c;
+    }
+    for (int k = 1; k < 8; ++k) {
+        for (int b = 0; b < 256; ++b) k_msb[k][b] = (uint16_t)((k_msb[k - 1][b] << 8) ^ k_msb[0][k_msb[k - 1][b] >> 8]);
+    }
+#if defined(CRC_X86)
+    __builtin_cpu_init();
+    have_pclmul = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+    have_sse42 = __builtin_cpu_supports("sse4.2");
+#endif
+    g_once_init_leave(&ready, 1);
+}
+
+gboolean crc_kind_from_name(const char* name, size_t len, CrcKind* out) {
+    for (int kind = 0; kind < CRC_KIND_COUNT; ++kind) {
+        if (strlen(k_params[kind].name) == len && memcmp(k_params[kind].name, name, len) == 0) {
+            *out = (CrcKind)kind;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static inline uint32_t load_le32(const uint8_t* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// reflected register of up to 32 bits, kept in the low bits
+static uint32_t crc_refl_sliced(uint32_t (*t)[256], uint32_t crc, const uint8_t* p, size_t n) {
+    for (; n >= 8; n -= 8, p += 8) {
+        uint32_t lo = crc ^ load_le32(p);
+        uint32_t hi = load_le32(p + 4);
+        crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+    }
+    for (; n > 0; --n, ++p) crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xff];
+    return crc;
+}
+
+// 16-bit MSB-first register: only the first two bytes of a step meet it
+static uint16_t crc_msb16_sliced(uint16_t crc, const uint8_t* p, size_t n) {
+    for (; n >= 8; n -= 8, p += 8) {
+        crc = k_msb[7][p[0] ^ (crc >> 8)] ^ k_msb[6][p[1] ^ (crc & 0xff)] ^ k_msb[5][p[2]] ^ k_msb[4][p[3]] ^
+              k_msb[3][p[4]] ^ k_msb[2][p[5]] ^ k_msb[1][p[6]] ^ k_msb[0][p[7]];
+    }
+    for (; n > 0; --n, ++p) crc = (uint16_t)((crc << 8) ^ k_msb[0][(crc >> 8) ^ *p]);
+    return crc;
+}
+
+#if defined(CRC_X86)
+
+// CRC-32 over n bytes (n >= 64, multiple of 16) by carry-less multiplication:
+// fold four 128-bit lanes across the buffer, fold those into one, then
+// Barrett-reduce to 32 bits. crc is the raw (pre-inverted) register.
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_pclmul(uint32_t crc, const uint8_t* p, size_t n) {
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+    const __m128i k5 = _mm_set_epi64x(0, 0x0163cd6124);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+    const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+    __m128i x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(const void*)p), _mm_cvtsi32_si128((int)crc));
+    __m128i x2 = _mm_loadu_si128((const __m128i*)(const void*)(p + 16));
+    __m128i x3 = _mm_loadu_si128((const __m128i*)(const void*)(p + 32));
+    __m128i x4 = _mm_loadu_si128((const __m128i*)(const void*)(p + 48));
+    p += 64;
+    n -= 64;
+    for (; n >= 64; n -= 64, p += 64) {
+        __m128i y1 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+        __m128i y2 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+        __m128i y3 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+        __m128i y4 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+        x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, k1k2, 0x11), y1);
+        x2 = _mm_xor_si128(_mm_clmulepi64_si128(x2, k1k2, 0x11), y2);
+        x3 = _mm_xor_si128(_mm_clmulepi64_si128(x3, k1k2, 0x11), y3);
+        x4 = _mm_xor_si128(_mm_clmulepi64_si128(x4, k1k2, 0x11), y4);
+        x1 = _mm_xor_si128(x1, _mm_loadu_si128((const __m128i*)(const void*)p));
+        x2 = _mm_xor_si128(x2, _mm_loadu_si128((const __m128i*)(const void*)(p + 16)));
+        x3 = _mm_xor_si128(x3, _mm_loadu_si128((const __m128i*)(const void*)(p + 32)));
+        x4 = _mm_xor_si128(x4, _mm_loadu_si128((const __m128i*)(const void*)(p + 48)));
+    }
+
+    // four lanes into one, then the remaining 16-byte blocks
+    __m128i next[3] = { x2, x3, x4 };
+    for (int i = 0; i < 3; ++i) {
+        __m128i lo = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), lo), next[i]);
+    }
+    for (; n >= 16; n -= 16, p += 16) {
+        __m128i lo = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), lo),
+                           _mm_loadu_si128((const __m128i*)(const void*)p));
+    }
+
+    // 128 -> 64 bits
+    __m128i t = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), t);
+    t = _mm_srli_si128(x1, 4);
+    x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k5, 0x00), t);
+
+    // Barrett reduction to 32 bits
+    t = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), poly, 0x10);
+    t = _mm_clmulepi64_si128(_mm_and_si128(t, mask32), poly, 0x00);
+    x1 = _mm_xor_si128(x1, t);
+    return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t* p, size_t n) {
+#if defined(__x86_64__)
+    uint64_t c = crc;
+    for (; n >= 8; n -= 8, p += 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = _mm_crc32_u64(c, v);
+    }
+    crc = (uint32_t)c;
+#endif
+    for (; n >= 4; n -= 4, p += 4) {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        crc = _mm_crc32_u32(crc, v);
+    }
+    for (; n > 0; --n, ++p) crc = _mm_crc32_u8(crc, *p);
+    return crc;
+}
+
+#endif
+
+uint32_t crc_compute(CrcKind kind, const uint8_t* data, size_t len) {
+    if ((unsigned)kind >= CRC_KIND_COUNT) return 0;
+    crc_init();
+    const CrcParams* cp = &k_params[kind];
+    if (!cp->reflected) return crc_msb16_sliced((uint16_t)cp->init, data, len) ^ cp->xorout;
+
+    uint32_t crc = cp->init;
+#if defined(CRC_X86)
+    if (kind == CRC32_C && have_sse42) return crc32c_sse42(crc, data, len) ^ cp->xorout;
+    if (kind == CRC32_IEEE && have_pclmul && len >= 64) {
+        size_t bulk = len & ~(size_t)15;
+        crc = crc32_pclmul(crc, data, bulk);
+        data += bulk;
+        len -= bulk;
+    }
+#endif
+    return crc_refl_sliced(k_refl[kind], crc, data, len) ^ cp->xorout;
+}
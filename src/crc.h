@@ -0,0 +1,33 @@
+#pragma once
+#include <glib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Frame checksums for the script builtins. Every variant runs from
+// slicing-by-8 tables (eight bytes per step); on x86 CPUs that have them,
+// CRC-32 folds 64 bytes at a time with PCLMULQDQ and CRC-32C uses the SSE4.2
+// crc32 instruction. The instruction set is picked at run time, so one
+// binary serves every machine. Any thread.
+
+typedef enum {
+    CRC16_CCITT = 0,    // CRC-16/CCITT-FALSE: poly 0x1021, init 0xFFFF
+    CRC16_MODBUS,       // CRC-16/MODBUS: poly 0x8005 reflected, init 0xFFFF
+    CRC16_IBM,          // CRC-16/ARC ("IBM"): poly 0x8005 reflected, init 0
+    CRC32_IEEE,         // CRC-32 (Ethernet, zip, png)
+    CRC32_C,            // CRC-32C (Castagnoli; iSCSI, SCTP)
+    CRC_KIND_COUNT
+} CrcKind;
+
+// "ccitt", "modbus", "ibm", "crc32" or "crc32c" (name[0..len)); FALSE if unknown
+gboolean crc_kind_from_name(const char* name, size_t len, CrcKind* out);
+
+// checksum of data[0..len) with the variant's standard init and final xor
+uint32_t crc_compute(CrcKind kind, const uint8_t* data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
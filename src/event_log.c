@@ -0,0 +1,363 @@
+#include "event_log.h"
+#include <stdio.h>
+#include <string.h>
+
+// frame interval used to batch collection (matches the packet ring)
+#define EVLOG_FRAME_US 16667
+
+// single-producer/single-consumer ring, one per producing thread
+typedef struct {
+    EvRecord* slots;
+    guint mask;
+
+    gint tail;                  // producer: published write index
+    gint dropped;               // producer: events lost because the ring was full
+    char pad0[64];
+
+    gint head;                  // collector: read index
+    guint dropped_seen;
+    gint orphaned;              // producing thread has exited
+} EvRing;
+
+typedef struct {
+    GSource base;
+    gint64 last_dispatch;
+} EvSource;
+
+static struct {
+    GMutex lock;                // guards rings (registration vs. collection)
+    GPtrArray* rings;
+    gint consumer_waiting;
+    GMainContext* ctx;
+    GSource* src;
+
+    evlog_notify_fn notify;
+    void* user;
+
+    // main-loop only
+    EvRecord* hist;             // EVLOG_HISTORY slots, circular
+    guint hist_len;
+    guint64 first_seq;          // sequence number of the oldest event
+} ev;
+
+static void ring_thread_exit(gpointer data) {
+    EvRing* r = (EvRing*)data;
+    g_atomic_int_set(&r->orphaned, 1);
+}
+
+static GPrivate ring_key = G_PRIVATE_INIT(ring_thread_exit);
+
+// free strings owned by an event (%S arguments)
+static void rec_release(EvRecord* r) {
+    guint ai = 0;
+    for (const char* p = r->fmt; p && *p && ai < r->nargs; ++p) {
+        if (*p != '%') continue;
+        ++p;
+        if (*p == '%') continue;
+        while (*p && strchr("-+ #0123456789.hlLqjzt", *p)) ++p;
+        if (!*p) break;
+        if (*p == 'S') g_free((gpointer)(uintptr_t)r->args[ai]);
+        ++ai;
+    }
+}
+
+static EvRing* ring_for_thread(void) {
+    EvRing* r = g_private_get(&ring_key);
+    if (r) return r;
+    r = g_new0(EvRing, 1);
+    r->slots = g_new(EvRecord, EVLOG_RING_SLOTS);
+    r->mask = EVLOG_RING_SLOTS - 1;
+    g_mutex_lock(&ev.lock);
+    if (!ev.rings) ev.rings = g_ptr_array_new();
+    g_ptr_array_add(ev.rings, r);
+    g_mutex_unlock(&ev.lock);
+    g_private_set(&ring_key, r);
+    return r;
+}
+
+void evlog_emit(const char* fmt, unsigned nargs, const uint64_t* args) {
+    if (!fmt) return;
+    EvRing* r = ring_for_thread();
+    if (nargs > EVLOG_MAX_ARGS) nargs = EVLOG_MAX_ARGS;
+
+    guint tail = (guint)r->tail;
+    if (tail - (guint)g_atomic_int_get(&r->head) > r->mask) {
+        EvRecord lost = { 0, fmt, nargs, 0, { 0 } };
+        if (nargs) memcpy(lost.args, args, nargs * sizeof(uint64_t));
+        rec_release(&lost);
+        g_atomic_int_inc(&r->dropped);
+        return;
+    }
+    EvRecord* rec = &r->slots[tail & r->mask];
+    rec->ts_us = g_get_real_time();
+    rec->fmt = fmt;
+    rec->nargs = nargs;
+    if (nargs) memcpy(rec->args, args, nargs * sizeof(uint64_t));
+    g_atomic_int_set(&r->tail, (gint)(tail + 1));
+
+    if (g_atomic_int_get(&ev.consumer_waiting) &&
+        g_atomic_int_compare_and_exchange(&ev.consumer_waiting, 1, 0) && ev.ctx) {
+        g_main_context_wakeup(ev.ctx);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// history (main loop)
+// ---------------------------------------------------------------------------
+
+// append one event; returns TRUE if the oldest event was evicted to make room
+static gboolean hist_push(const EvRecord* rec) {
+    gboolean evicted = FALSE;
+    if (!ev.hist) ev.hist = g_new(EvRecord, EVLOG_HISTORY);
+    if (ev.hist_len == EVLOG_HISTORY) {
+        rec_release(&ev.hist[ev.first_seq % EVLOG_HISTORY]);
+        ev.first_seq++;
+        ev.hist_len--;
+        evicted = TRUE;
+    }
+    ev.hist[(ev.first_seq + ev.hist_len) % EVLOG_HISTORY] = *rec;
+    ev.hist_len++;
+    return evicted;
+}
+
+static gboolean rings_have_work(void) {
+    gboolean work = FALSE;
+    g_mutex_lock(&ev.lock);
+    for (guint i = 0; ev.rings && i < ev.rings->len && !work; ++i) {
+        EvRing* r = g_ptr_array_index(ev.rings, i);
+        work = g_atomic_int_get(&r->tail) != r->head ||
+               (guint)g_atomic_int_get(&r->dropped) != r->dropped_seen ||
+               g_atomic_int_get(&r->orphaned);
+    }
+    g_mutex_unlock(&ev.lock);
+    return work;
+}
+
+void evlog_collect(void) {
+    guint before = ev.hist_len;
+    guint evicted = 0;
+    guint dropped = 0;
+
+    g_mutex_lock(&ev.lock);
+    for (guint i = 0; ev.rings && i < ev.rings->len; ) {
+        EvRing* r = g_ptr_array_index(ev.rings, i);
+        gboolean orphaned = g_atomic_int_get(&r->orphaned);
+        guint tail = (guint)g_atomic_int_get(&r->tail);
+        guint head = (guint)r->head;
+        for (; head != tail; ++head) evicted += hist_push(&r->slots[head & r->mask]);
+        g_atomic_int_set(&r->head, (gint)head);
+
+        guint d = (guint)g_atomic_int_get(&r->dropped);
+        dropped += d - r->dropped_seen;
+        r->dropped_seen = d;
+
+        if (orphaned) {
+            g_ptr_array_remove_index_fast(ev.rings, i);
+            g_free(r->slots);
+            g_free(r);
+            continue;
+        }
+        ++i;
+    }
+    g_mutex_unlock(&ev.lock);
+
+    if (dropped) {
+        EvRecord note = { g_get_real_time(), "[LOG] %u events dropped (log ring full)", 1, 0, { dropped } };
+        evicted += hist_push(&note);
+    }
+    // evictions beyond what the view had were events added in this same pass
+    guint removed = MIN(evicted, before);
+    guint added = ev.hist_len - (before - removed);
+    if ((removed || added) && ev.notify) ev.notify(ev.user, removed, added);
+}
+
+static gboolean ev_source_prepare(GSource* source, gint* timeout) {
+    EvSource* s = (EvSource*)source;
+    *timeout = -1;
+    if (!rings_have_work()) {
+        // ask producers to wake us, then re-check to close the race
+        g_atomic_int_set(&ev.consumer_waiting, 1);
+        if (!rings_have_work()) return FALSE;
+        g_atomic_int_set(&ev.consumer_waiting, 0);
+    }
+    gint64 due = s->last_dispatch + EVLOG_FRAME_US;
+    gint64 now = g_source_get_time(source);
+    if (now >= due) return TRUE;
+    *timeout = (gint)((due - now + 999) / 1000);
+    return FALSE;
+}
+
+static gboolean ev_source_check(GSource* source) {
+    EvSource* s = (EvSource*)source;
+    return g_source_get_time(source) >= s->last_dispatch + EVLOG_FRAME_US && rings_have_work();
+}
+
+static gboolean ev_source_dispatch(GSource* source, GSourceFunc callback, gpointer user_data) {
+    (void)callback;
+    (void)user_data;
+    ((EvSource*)source)->last_dispatch = g_source_get_time(source);
+    evlog_collect();
+    return G_SOURCE_CONTINUE;
+}
+
+static GSourceFuncs ev_source_funcs = {
+    ev_source_prepare,
+    ev_source_check,
+    ev_source_dispatch,
+    NULL, NULL, NULL
+};
+
+void evlog_attach(evlog_notify_fn fn, void* user) {
+    ev.notify = fn;
+    ev.user = user;
+    if (ev.src) return;
+    ev.ctx = g_main_context_default();
+    ev.src = g_source_new(&ev_source_funcs, sizeof(EvSource));
+    g_source_set_name(ev.src, "event-log");
+    g_source_attach(ev.src, NULL);
+}
+
+void evlog_detach(void) {
+    if (ev.src) {
+        g_source_destroy(ev.src);
+        g_source_unref(ev.src);
+        ev.src = NULL;
+    }
+    ev.notify = NULL;
+    ev.user = NULL;
+}
+
+guint evlog_count(void) {
+    return ev.hist_len;
+}
+
+guint64 evlog_first_seq(void) {
+    return ev.first_seq;
+}
+
+void evlog_clear(void) {
+    guint n = ev.hist_len;
+    for (guint i = 0; i < n; ++i) rec_release(&ev.hist[(ev.first_seq + i) % EVLOG_HISTORY]);
+    ev.first_seq += n;
+    ev.hist_len = 0;
+    if (n && ev.notify) ev.notify(ev.user, n, 0);
+}
+
+// ---------------------------------------------------------------------------
+// formatting
+// ---------------------------------------------------------------------------
+
+static void append_peer(GString* out, uint64_t packed) {
+    uint32_t addr = (uint32_t)(packed >> 16);
+    uint16_t port = (uint16_t)packed;
+    uint8_t a[4], p[2];
+    memcpy(a, &addr, 4);        // network byte order in memory
+    memcpy(p, &port, 2);
+    g_string_append_printf(out, "%u.%u.%u.%u:%u", a[0], a[1], a[2], a[3], (unsigned)((p[0] << 8) | p[1]));
+}
+
+void evlog_format_record(const EvRecord* rec, GString* out) {
+    guint ai = 0;
+    const char* p = rec->fmt;
+    while (*p) {
+        const char* pct = strchr(p, '%');
+        if (!pct) {
+            g_string_append(out, p);
+            break;
+        }
+        g_string_append_len(out, p, pct - p);
+        p = pct + 1;
+        if (*p == '%') {
+            g_string_append_c(out, '%');
+            ++p;
+            continue;
+        }
+
+        // rebuild the spec with a 64-bit length modifier
+        char spec[24];
+        size_t sl = 0;
+        spec[sl++] = '%';
+        while (*p && strchr("-+ #0123456789.", *p) && sl < 12) spec[sl++] = *p++;
+        while (*p && strchr("hlLqjzt", *p)) ++p;
+        char conv = *p;
+        if (!conv) break;
+        ++p;
+
+        uint64_t v = ai < rec->nargs ? rec->args[ai] : 0;
+        if (ai++ >= rec->nargs) {
+            g_string_append(out, "<?>");
+            continue;
+        }
+        switch (conv) {
+        case 'd': case 'i':
+            memcpy(spec + sl, "lld", 4);
+            g_string_append_printf(out, spec, (long long)v);
+            break;
+        case 'u': case 'x': case 'X': case 'o':
+            spec[sl++] = 'l';
+            spec[sl++] = 'l';
+            spec[sl++] = conv;
+            spec[sl] = '\0';
+            g_string_append_printf(out, spec, (unsigned long long)v);
+            break;
+        case 'c':
+            g_string_append_c(out, (char)v);
+            break;
+        case 's': case 'S': {
+            const char* s = (const char*)(uintptr_t)v;
+            memcpy(spec + sl, "s", 2);
+            g_string_append_printf(out, spec, s ? s : "(null)");
+            break;
+        }
+        case 'a':
+            append_peer(out, v);
+            break;
+        default:
+            g_string_append_c(out, '%');
+            g_string_append_c(out, conv);
+            break;
+        }
+    }
+}
+
+static void format_line(const EvRecord* rec, GString* out) {
+    GDateTime* dt = g_date_time_new_from_unix_local(rec->ts_us / G_USEC_PER_SEC);
+    char* hms = dt ? g_date_time_format(dt, "%H:%M:%S") : NULL;
+    g_string_append_printf(out, "%s.%03u  ", hms ? hms : "--:--:--",
+                           (unsigned)(rec->ts_us % G_USEC_PER_SEC / 1000));
+    g_free(hms);
+    if (dt) g_date_time_unref(dt);
+    evlog_format_record(rec, out);
+}
+
+gboolean evlog_format(guint64 seq, GString* out) {
+    if (seq < ev.first_seq || seq - ev.first_seq >= ev.hist_len) return FALSE;
+    format_line(&ev.hist[seq % EVLOG_HISTORY], out);
+    return TRUE;
+}
+
+const char* evlog_event_id(guint64 seq) {
+    if (seq < ev.first_seq || seq - ev.first_seq >= ev.hist_len) return NULL;
+    return ev.hist[seq % EVLOG_HISTORY].fmt;
+}
+
+gboolean evlog_export(const char* path, GError** error) {
+    FILE* f = path ? fopen(path, "wb") : NULL;
+    if (!f) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_FAILED, "cannot open %s for writing", path ? path : "(null)");
+        return FALSE;
+    }
+    setvbuf(f, NULL, _IOFBF, 1 << 20);
+    GString* line = g_string_sized_new(256);
+    gboolean ok = TRUE;
+    for (guint i = 0; i < ev.hist_len && ok; ++i) {
+        g_string_truncate(line, 0);
+        format_line(&ev.hist[(ev.first_seq + i) % EVLOG_HISTORY], line);
+        g_string_append_c(line, '\n');
+        ok = fwrite(line->str, 1, line->len, f) == line->len;
+    }
+    g_string_free(line, TRUE);
+    if (fclose(f) != 0) ok = FALSE;
+    if (!ok) g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_IO, "write to %s failed", path);
+    return ok;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <glib.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Binary event log. Producers record a static format string (which doubles as
+// the event id) plus up to EVLOG_MAX_ARGS raw 64-bit arguments into a ring
+// owned by the calling thread: no formatting, no locks, no allocation. The main
+// loop collects the rings at most once per frame into a bounded history, and
+// text is only produced when a row is shown or the log is exported.
+//
+// Format conversions (flags/width/precision are honoured, length modifiers are
+// accepted and ignored since every argument is 64-bit):
+//   %d %i %u %x %X %o %c  integers
+//   %s                    string that outlives the process (literal / static)
+//   %S                    string owned by the event (pass EV_DUP(s) or EV_DUPN(s, n))
+//   %a                    IPv4 peer packed with EV_PEER(&peer)
+
+#define EVLOG_MAX_ARGS   6
+#define EVLOG_RING_SLOTS 1024           // per producing thread
+#define EVLOG_HISTORY    (1u << 17)     // events kept for the view and export
+
+typedef struct {
+    gint64 ts_us;
+    const char* fmt;
+    uint32_t nargs;
+    uint32_t pad;
+    uint64_t args[EVLOG_MAX_ARGS];
+} EvRecord;
+
+#define EV_STR(s)  ((uint64_t)(uintptr_t)(s))
+#define EV_DUP(s)  ((uint64_t)(uintptr_t)g_strdup(s))
+#define EV_DUPN(s, n) ((uint64_t)(uintptr_t)g_strndup((s), (n)))
+#define EV_PEER(p) (((uint64_t)(p)->addr << 16) | (uint64_t)(p)->port)
+
+// any thread
+void evlog_emit(const char* fmt, unsigned nargs, const uint64_t* args);
+
+#define EVLOG(fmt, ...) do { \
+        const uint64_t ev_args_[] = { 0, ##__VA_ARGS__ }; \
+        _Static_assert(sizeof(ev_args_) / sizeof(ev_args_[0]) - 1 <= EVLOG_MAX_ARGS, \
+                       "too many EVLOG arguments"); \
+        evlog_emit((fmt), (unsigned)G_N_ELEMENTS(ev_args_) - 1, ev_args_ + 1); \
+    } while (0)
+
+// one already-formatted line (cold paths, e.g. script output)
+#define evlog_text(line) EVLOG("%S", EV_DUP(line))
+
+// --- main loop side -------------------------------------------------------
+
+// history changed: removed events dropped off the front, added appended
+typedef void (*evlog_notify_fn)(void* user, guint removed, guint added);
+
+// start collecting on the default main context; fn may be NULL
+void evlog_attach(evlog_notify_fn fn, void* user);
+void evlog_detach(void);
+
+// collect pending events now (also done automatically once attached)
+void evlog_collect(void);
+
+// history access; sequence numbers are stable while positions shift
+guint evlog_count(void);
+guint64 evlog_first_seq(void);
+gboolean evlog_format(guint64 seq, GString* out);
+// the event's format string, usable for filtering by prefix; NULL if gone
+const char* evlog_event_id(guint64 seq);
+
+void evlog_clear(void);
+gboolean evlog_export(const char* path, GError** error);
+
+// render one record (without timestamp) into out
+void evlog_format_record(const EvRecord* rec, GString* out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,355 @@
+#include "headless.h"
+#include "app_controller.h"
+#include "event_log.h"
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <glib-unix.h>
+#include <signal.h>
+#endif
+
+#define HL_EXIT_OK     0
+#define HL_EXIT_FAILED 1
+#define HL_EXIT_USAGE  2
+
+// script/replay completion and the duration are checked this often
+#define HL_TICK_MS 100
+
+typedef struct {
+    // command line
+    gboolean headless;          // accepted so the GTK binary can pass argv through
+    char* local;
+    char* target;
+    gboolean tcp;
+    gboolean server;
+    gint clients;
+    char* framing;
+    gint shards;
+    gint rx_batch;
+    gboolean reflect;
+    char* script;
+    char* replay;
+    gdouble speed;
+    char* capture;
+    char* metrics;
+    gint probe_rate;
+    gint probe_count;
+    gint probe_size;
+    gdouble duration;
+    gint interval;
+    gboolean verbose;
+    gboolean quiet;
+
+    AppController* ctrl;
+    const BackendAPI* api;
+    void* user;
+    GMainLoop* loop;
+    int status;
+
+    gboolean script_running;
+    gboolean replay_running;
+    gboolean probe_running;
+
+    gint64 start_us;
+    guint samples;
+    GString* line;
+} Headless;
+
+// "ip:port", or just "port" on 127.0.0.1
+static gboolean parse_endpoint(const char* s, char** ip, int* port) {
+    const char* colon = strrchr(s, ':');
+    const char* p = colon ? colon + 1 : s;
+    char* end = NULL;
+    long v = strtol(p, &end, 10);
+    if (!*p || *end || v < 0 || v > 65535) return FALSE;
+    *ip = colon ? g_strndup(s, (gsize)(colon - s)) : g_strdup("127.0.0.1");
+    *port = (int)v;
+    return TRUE;
+}
+
+static gboolean parse_framing(const char* s, NetFraming* out) {
+    if (!s || strcmp(s, "none") == 0) *out = NET_FRAME_NONE;
+    else if (strcmp(s, "len32") == 0) *out = NET_FRAME_LEN32;
+    else if (strcmp(s, "delim") == 0) *out = NET_FRAME_DELIM;
+    else return FALSE;
+    return TRUE;
+}
+
+// --- controller -> "UI" callbacks --------------------------------------------
+
+static void hl_log_append(void* ui_user, const char* line) {
+    (void)ui_user;
+    printf("%s\n", line);
+}
+
+static void hl_script_state(void* ui_user, ScriptState st, const char* detail) {
+    Headless* h = (Headless*)ui_user;
+    if (st == SCRIPT_ERROR) {
+        fprintf(stderr, "script error: %s\n", detail ? detail : "");
+        h->status = HL_EXIT_FAILED;
+    }
+    if (st == SCRIPT_STOPPED || st == SCRIPT_ERROR) h->script_running = FALSE;
+}
+
+// traffic floods: one event per datagram or wake-up, and the drop notes they cause
+static gboolean is_traffic_event(const char* id) {
+    return g_str_has_prefix(id, "[RECV]") || g_str_has_prefix(id, "[SEND]") || g_str_has_prefix(id, "[LOG]");
+}
+
+// event log -> stderr; traffic lines only with --verbose
+static void hl_events(void* user, guint removed, guint added) {
+    (void)removed;
+    Headless* h = (Headless*)user;
+    if (h->quiet || added == 0) return;
+    guint64 end = evlog_first_seq() + evlog_count();
+    for (guint64 seq = end - MIN(added, evlog_count()); seq < end; ++seq) {
+        const char* id = evlog_event_id(seq);
+        if (!h->verbose && id && is_traffic_event(id)) continue;
+        g_string_truncate(h->line, 0);
+        evlog_format(seq, h->line);
+        fprintf(stderr, "%s\n", h->line->str);
+    }
+}
+
+// --- stats ---------------------------------------------------------------------
+
+// drops and errors only when there are any, so clean runs stay one short line
+static void print_faults(const NetTotals* t) {
+    guint64 dropped = t->rx_dropped + t->tx_dropped;
+    guint64 errors = t->rx_errors + t->tx_errors;
+    if (dropped) printf("  dropped %" G_GUINT64_FORMAT, dropped);
+    if (t->rx_truncated) printf("  truncated %" G_GUINT64_FORMAT, (guint64)t->rx_truncated);
+    if (errors) printf("  errors %" G_GUINT64_FORMAT, errors);
+}
+
+static void print_rtt(const ProbeStats* r) {
+    printf("  rtt us p50 %.1f p99 %.1f p99.9 %.1f max %.1f (%" G_GUINT64_FORMAT "/%" G_GUINT64_FORMAT ")",
+           r->p50_ns / 1e3, r->p99_ns / 1e3, r->p999_ns / 1e3, r->max_ns / 1e3,
+           (guint64)r->received, (guint64)r->sent);
+}
+
+// controller metrics callback, once per second
+static void hl_metrics(void* ui_user, const NetSample* s) {
+    Headless* h = (Headless*)ui_user;
+    h->samples++;
+    if (h->interval <= 0 || h->samples % (guint)h->interval != 0) return;
+    printf("%8.2fs  rx %10.0f pps %9.2f Mbit/s  tx %10.0f pps %9.2f Mbit/s",
+           (double)(g_get_monotonic_time() - h->start_us) / G_USEC_PER_SEC,
+           s->rx_pps, s->rx_bps / 1e6, s->tx_pps, s->tx_bps / 1e6);
+    if (h->tcp) printf("  conns %u", s->conns);
+    print_faults(&s->total);
+    if (s->rtt.running) print_rtt(&s->rtt);
+    printf("\n");
+    fflush(stdout);
+}
+
+static void print_totals(Headless* h) {
+    NetTotals t;
+    app_controller_totals(h->ctrl, &t);
+    double secs = (double)(g_get_monotonic_time() - h->start_us) / G_USEC_PER_SEC;
+    if (secs <= 0) secs = 1e-6;
+    printf("total %.2fs  rx %" G_GUINT64_FORMAT " pkts %" G_GUINT64_FORMAT " bytes (%.0f pps)"
+           "  tx %" G_GUINT64_FORMAT " pkts %" G_GUINT64_FORMAT " bytes (%.0f pps)",
+           secs, (guint64)t.rx_packets, (guint64)t.rx_bytes, (double)t.rx_packets / secs,
+           (guint64)t.tx_packets, (guint64)t.tx_bytes, (double)t.tx_packets / secs);
+    print_faults(&t);
+    printf("\n");
+
+    ProbeStats r;
+    app_controller_probe_stats(h->ctrl, &r);
+    if (r.sent) {
+        printf("rtt %" G_GUINT64_FORMAT "/%" G_GUINT64_FORMAT " replies (%.2f%% lost)",
+               (guint64)r.received, (guint64)r.sent, 100.0 * (double)(r.sent - MIN(r.received, r.sent)) / (double)r.sent);
+        if (r.received) {
+            printf("  us min %.1f mean %.1f p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f",
+                   r.min_ns / 1e3, r.mean_ns / 1e3, r.p50_ns / 1e3, r.p90_ns / 1e3, r.p99_ns / 1e3,
+                   r.p999_ns / 1e3, r.max_ns / 1e3);
+        }
+        printf("\n");
+    }
+    fflush(stdout);
+}
+
+// --- main loop -----------------------------------------------------------------
+
+static gboolean hl_tick(gpointer data) {
+    Headless* h = (Headless*)data;
+    gint64 now = g_get_monotonic_time();
+
+    if (h->replay_running && !app_controller_replaying(h->ctrl)) h->replay_running = FALSE;
+    if (h->probe_running && !app_controller_probing(h->ctrl)) h->probe_running = FALSE;
+
+    // an endless probe (no --probe-count) runs until --duration or SIGINT
+    gboolean has_job = h->script || h->replay || (h->probe_rate > 0 && h->probe_count > 0);
+    gboolean expired = h->duration > 0 && now - h->start_us >= (gint64)(h->duration * G_USEC_PER_SEC);
+    if (expired || (has_job && !h->script_running && !h->replay_running && !h->probe_running)) {
+        g_main_loop_quit(h->loop);
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+#ifndef _WIN32
+static gboolean hl_signal(gpointer data) {
+    Headless* h = (Headless*)data;
+    g_main_loop_quit(h->loop);
+    return G_SOURCE_CONTINUE;
+}
+#endif
+
+static gboolean hl_start(Headless* h, const NetConfig* cfg) {
+    h->api->on_apply_config(h->user, cfg);
+
+    if (h->capture && !h->api->on_capture_start(h->user, h->capture)) return FALSE;
+    if (h->metrics && !h->api->on_metrics_export_start(h->user, h->metrics)) return FALSE;
+
+    if (h->script) {
+        char* text = NULL;
+        GError* err = NULL;
+        if (!g_file_get_contents(h->script, &text, NULL, &err)) {
+            fprintf(stderr, "cannot read script: %s\n", err->message);
+            g_clear_error(&err);
+            return FALSE;
+        }
+        h->script_running = TRUE;
+        // lets %include resolve relative to the script file
+        if (h->api->on_script_load_file) h->api->on_script_load_file(h->user, h->script);
+        h->api->on_script_run(h->user, text);
+        g_free(text);
+        if (h->status != HL_EXIT_OK) return FALSE;
+    }
+
+    if (h->replay) {
+        h->api->on_replay_start(h->user, h->replay, h->speed);
+        h->replay_running = app_controller_replaying(h->ctrl);
+    }
+
+    if (h->probe_rate > 0) {
+        ProbeConfig pc = { (unsigned)h->probe_rate, (unsigned)MAX(h->probe_count, 0), (unsigned)MAX(h->probe_size, 0) };
+        if (!h->api->on_probe_start(h->user, &pc)) return FALSE;
+        h->probe_running = TRUE;
+    }
+    return TRUE;
+}
+
+int headless_main(int argc, char** argv) {
+    Headless h;
+    memset(&h, 0, sizeof(h));
+    h.clients = 1;
+    h.shards = 1;
+    h.speed = 1.0;
+    h.interval = 1;
+
+    GOptionEntry entries[] = {
+        { "headless", 0, 0, G_OPTION_ARG_NONE, &h.headless, "Run without a window (implied for netassist_cli)", NULL },
+        { "local", 'l', 0, G_OPTION_ARG_STRING, &h.local, "Local address (default 127.0.0.1:9000)", "IP:PORT" },
+        { "target", 't', 0, G_OPTION_ARG_STRING, &h.target, "Target address (default 127.0.0.1:9001)", "IP:PORT" },
+        { "tcp", 0, 0, G_OPTION_ARG_NONE, &h.tcp, "Use TCP instead of UDP", NULL },
+        { "server", 0, 0, G_OPTION_ARG_NONE, &h.server, "TCP: listen on the local address", NULL },
+        { "clients", 0, 0, G_OPTION_ARG_INT, &h.clients, "TCP client: connections to open", "N" },
+        { "framing", 0, 0, G_OPTION_ARG_STRING, &h.framing, "TCP message framing: none, len32 or delim", "MODE" },
+        { "shards", 0, 0, G_OPTION_ARG_INT, &h.shards, "UDP receive sockets sharing the local port", "N" },
+        { "rx-batch", 0, 0, G_OPTION_ARG_INT, &h.rx_batch, "Datagrams per receive syscall", "N" },
+        { "reflect", 0, 0, G_OPTION_ARG_NONE, &h.reflect, "UDP: echo every datagram back to its sender", NULL },
+        { "script", 's', 0, G_OPTION_ARG_FILENAME, &h.script, "Run a script, exit when it finishes", "FILE" },
+        { "replay", 'r', 0, G_OPTION_ARG_FILENAME, &h.replay, "Replay a pcap/pcapng file, exit when done", "FILE" },
+        { "speed", 0, 0, G_OPTION_ARG_DOUBLE, &h.speed, "Replay speed (1 = original, 0 = unpaced)", "X" },
+        { "capture", 'w', 0, G_OPTION_ARG_FILENAME, &h.capture, "Write sent/received datagrams to a pcapng file", "FILE" },
+        { "metrics", 'm', 0, G_OPTION_ARG_FILENAME, &h.metrics, "Append per-second counters to a CSV (.csv) or JSON Lines file", "FILE" },
+        { "probe", 'p', 0, G_OPTION_ARG_INT, &h.probe_rate, "Measure RTT: send this many probes/s for the target to echo", "PPS" },
+        { "probe-count", 0, 0, G_OPTION_ARG_INT, &h.probe_count, "Probes to send, then exit (0 = until stopped)", "N" },
+        { "probe-size", 0, 0, G_OPTION_ARG_INT, &h.probe_size, "Probe datagram size in bytes (min 24)", "BYTES" },
+        { "duration", 'd', 0, G_OPTION_ARG_DOUBLE, &h.duration, "Stop after this many seconds", "SEC" },
+        { "interval", 'i', 0, G_OPTION_ARG_INT, &h.interval, "Seconds between stats lines (0 = off)", "SEC" },
+        { "verbose", 'v', 0, G_OPTION_ARG_NONE, &h.verbose, "Also print per-datagram log events", NULL },
+        { "quiet", 'q', 0, G_OPTION_ARG_NONE, &h.quiet, "Do not print the event log", NULL },
+        { NULL }
+    };
+
+    GOptionContext* octx = g_option_context_new("- UDP/TCP test tool without GUI");
+    g_option_context_add_main_entries(octx, entries, NULL);
+    GError* err = NULL;
+    gboolean parsed = g_option_context_parse(octx, &argc, &argv, &err);
+    g_option_context_free(octx);
+
+    NetConfig cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    char* local_ip = NULL;
+    char* target_ip = NULL;
+    if (!parsed) {
+        fprintf(stderr, "%s\n", err->message);
+        g_clear_error(&err);
+        h.status = HL_EXIT_USAGE;
+    } else if (!parse_endpoint(h.local ? h.local : "127.0.0.1:9000", &local_ip, &cfg.local_port) ||
+               !parse_endpoint(h.target ? h.target : "127.0.0.1:9001", &target_ip, &cfg.target_port)) {
+        fprintf(stderr, "addresses must look like IP:PORT\n");
+        h.status = HL_EXIT_USAGE;
+    } else if (!parse_framing(h.framing, &cfg.framing)) {
+        fprintf(stderr, "unknown framing '%s' (none, len32, delim)\n", h.framing);
+        h.status = HL_EXIT_USAGE;
+    }
+
+    if (h.status == HL_EXIT_OK) {
+        setvbuf(stdout, NULL, _IOLBF, 0);
+        cfg.local_ip = local_ip;
+        cfg.target_ip = target_ip;
+        cfg.rx_batch = h.rx_batch;
+        cfg.rx_shards = h.shards;
+        cfg.reflect = h.reflect ? 1 : 0;
+        cfg.proto = h.tcp ? NET_PROTO_TCP : NET_PROTO_UDP;
+        cfg.tcp_server = h.server ? 1 : 0;
+        cfg.tcp_clients = h.clients;
+        cfg.frame_delim = '\n';
+
+        h.line = g_string_sized_new(256);
+        h.loop = g_main_loop_new(NULL, FALSE);
+        evlog_attach(hl_events, &h);
+
+        // no packet callback: received data is counted, never copied for display
+        h.ctrl = app_controller_new();
+        h.api = app_controller_api(h.ctrl);
+        h.user = app_controller_user(h.ctrl);
+        app_controller_bind_ui(h.ctrl, &h, hl_log_append, hl_script_state, NULL, hl_metrics);
+
+        h.start_us = g_get_monotonic_time();
+        if (!hl_start(&h, &cfg)) {
+            if (h.status == HL_EXIT_OK) h.status = HL_EXIT_FAILED;
+        } else {
+            g_timeout_add(HL_TICK_MS, hl_tick, &h);
+#ifndef _WIN32
+            g_unix_signal_add(SIGINT, hl_signal, &h);
+            g_unix_signal_add(SIGTERM, hl_signal, &h);
+#endif
+            g_main_loop_run(h.loop);
+        }
+
+        if (h.script_running) h.api->on_script_stop(h.user);
+        h.api->on_replay_stop(h.user);
+        h.api->on_probe_stop(h.user);
+        if (h.capture) h.api->on_capture_stop(h.user);
+        print_totals(&h);
+        h.api->on_metrics_export_stop(h.user);
+        h.api->on_close(h.user);
+
+        // deliver queued script output and shutdown events before tearing down
+        while (g_main_context_iteration(NULL, FALSE)) {}
+        evlog_collect();
+        evlog_detach();
+        app_controller_free(h.ctrl);
+        g_main_loop_unref(h.loop);
+        g_string_free(h.line, TRUE);
+    }
+
+    g_free(local_ip);
+    g_free(target_ip);
+    g_free(h.local);
+    g_free(h.target);
+    g_free(h.framing);
+    g_free(h.script);
+    g_free(h.replay);
+    g_free(h.capture);
+    g_free(h.metrics);
+    return h.status;
+}
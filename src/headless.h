@@ -0,0 +1,18 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Command-line runner without any GTK: drives AppController on a plain
+// GMainLoop, prints throughput once per interval to stdout and the event log
+// to stderr. Used by `netassist_gtk4 --headless ...` and by the GTK-free
+// netassist_cli binary (make cli).
+//
+// Runs until --duration expires, the script or replay finishes, or SIGINT.
+// Returns the process exit status (0 ok, 1 runtime failure, 2 bad arguments).
+int headless_main(int argc, char** argv);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,326 @@
+#include "hexfmt.h"
+#include "event_log.h"
+#include <string.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HEXFMT_SSE2 1
+#endif
+#if defined(HEXFMT_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HEXFMT_SSSE3 1      // spaced decode, used when the CPU has SSSE3
+#endif
+
+// "xx" for every byte value, indexed by 2 * byte
+static const char pair_lower[] =
+    "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+    "202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
+    "404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f"
+    "606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f"
+    "808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f"
+    "a0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+    "c0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+    "e0e1e2e3e4e5e6e7e8e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+static const char pair_upper[] =
+    "000102030405060708090A0B0C0D0E0F101112131415161718191A1B1C1D1E1F"
+    "202122232425262728292A2B2C2D2E2F303132333435363738393A3B3C3D3E3F"
+    "404142434445464748494A4B4C4D4E4F505152535455565758595A5B5C5D5E5F"
+    "606162636465666768696A6B6C6D6E6F707172737475767778797A7B7C7D7E7F"
+    "808182838485868788898A8B8C8D8E8F909192939495969798999A9B9C9D9E9F"
+    "A0A1A2A3A4A5A6A7A8A9AAABACADAEAFB0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+    "C0C1C2C3C4C5C6C7C8C9CACBCCCDCECFD0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+    "E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEFF0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
+// digit value, HEX_SPACE for whitespace, HEX_BAD for anything else
+#define HEX_SPACE 0x40
+#define HEX_BAD   0x80
+static const uint8_t hex_val[256] = {
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x40, 0x40, 0x80, 0x80, 0x40, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x40, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+};
+
+#ifdef HEXFMT_SSE2
+// 16 bytes -> 32 hex digits in byte order
+static inline void hex16_sse2(char* out, const uint8_t* in, gboolean upper) {
+    const __m128i lo_mask = _mm_set1_epi8(0x0f);
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i alpha = _mm_set1_epi8(upper ? 'A' - '0' - 10 : 'a' - '0' - 10);
+
+    __m128i v = _mm_loadu_si128((const __m128i*)in);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), lo_mask);
+    __m128i lo = _mm_and_si128(v, lo_mask);
+    __m128i a = _mm_unpacklo_epi8(hi, lo);
+    __m128i b = _mm_unpackhi_epi8(hi, lo);
+    a = _mm_add_epi8(_mm_add_epi8(a, zero), _mm_and_si128(_mm_cmpgt_epi8(a, nine), alpha));
+    b = _mm_add_epi8(_mm_add_epi8(b, zero), _mm_and_si128(_mm_cmpgt_epi8(b, nine), alpha));
+    _mm_storeu_si128((__m128i*)out, a);
+    _mm_storeu_si128((__m128i*)(out + 16), b);
+}
+
+// printable bytes kept, everything else '.'
+static inline void ascii16_sse2(char* out, const uint8_t* in) {
+    __m128i v = _mm_loadu_si128((const __m128i*)in);
+    // shift 32..126 onto -128..-34 so one signed compare covers the range
+    __m128i s = _mm_add_epi8(v, _mm_set1_epi8((char)(0x80 - 32)));
+    __m128i printable = _mm_cmplt_epi8(s, _mm_set1_epi8(-33));
+    __m128i r = _mm_or_si128(_mm_and_si128(printable, v), _mm_andnot_si128(printable, _mm_set1_epi8('.')));
+    _mm_storeu_si128((__m128i*)out, r);
+}
+
+// 16 chars -> digit values (garbage elsewhere) and the mask of digit lanes
+static inline __m128i unhex_classify(__m128i c, int* digits) {
+    __m128i d = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+    __m128i l = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    __m128i is_d = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+    __m128i is_l = _mm_cmpeq_epi8(_mm_min_epu8(l, _mm_set1_epi8(5)), l);
+    *digits = _mm_movemask_epi8(_mm_or_si128(is_d, is_l));
+    return _mm_or_si128(_mm_and_si128(is_d, d), _mm_and_si128(is_l, _mm_add_epi8(l, _mm_set1_epi8(10))));
+}
+
+// 16 digit values -> 8 bytes
+static inline void unhex_pack(uint8_t* out, __m128i v) {
+    // each 16-bit lane holds (high nibble, low nibble) in memory order
+    __m128i b = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(v, 4), _mm_set1_epi16(0x00f0)), _mm_srli_epi16(v, 8));
+    _mm_storel_epi64((__m128i*)out, _mm_packus_epi16(b, b));
+}
+
+// 16 hex digits -> 8 bytes; FALSE (nothing written) if any char is not a digit
+static inline gboolean unhex16_sse2(uint8_t* out, const char* in) {
+    int digits;
+    __m128i v = unhex_classify(_mm_loadu_si128((const __m128i*)in), &digits);
+    if (digits != 0xffff) return FALSE;
+    unhex_pack(out, v);
+    return TRUE;
+}
+#endif
+
+#ifdef HEXFMT_SSSE3
+static gboolean have_ssse3;
+// row m: eight 0x80, the lanes set in the 8-lane mask m in order (0x80
+// padded), eight 0x80. Loaded at row + 8 it is the pshufb control that moves
+// those lanes to the front; loaded further left it puts them further right.
+static uint8_t compact_lut[256][24];
+static uint8_t compact_len[256];
+// 0x80 x16, 0..15, 0x80 x16: loaded at 16 - k it shifts lanes up by k,
+// at 32 - k it brings lanes 16 - k.. down to 0
+static const uint8_t shift_lut[48] = {
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+};
+
+static void unhex_init(void) {
+    static gsize ready = 0;
+    if (!g_once_init_enter(&ready)) return;
+    memset(compact_lut, 0x80, sizeof(compact_lut));
+    for (int m = 0; m < 256; ++m) {
+        int k = 0;
+        for (int j = 0; j < 8; ++j) {
+            if (m & (1 << j)) compact_lut[m][8 + k++] = (uint8_t)j;
+        }
+        compact_len[m] = (uint8_t)k;
+    }
+    __builtin_cpu_init();
+    have_ssse3 = __builtin_cpu_supports("ssse3");
+    g_once_init_leave(&ready, 1);
+}
+
+#define LOADU(p) _mm_loadu_si128((const __m128i*)(const void*)(p))
+
+// Digits separated by whitespace ("de ad be ef"), 16 chars per step: the
+// digit lanes of each block are compacted with pshufb and appended to a
+// register of pending digits; every 16 of them become 8 bytes. Stops at a
+// block holding anything but digits and whitespace, or when out has no room
+// for 8 more bytes; returns the input offset where the scalar loop picks up
+// (digits consumed in whole pairs).
+__attribute__((target("ssse3")))
+static size_t unhex_spaced_ssse3(uint8_t* out, size_t cap, size_t* n, const char* text, size_t len) {
+    __m128i acc = _mm_setzero_si128();     // k pending digit values, zero above
+    size_t k = 0, i = 0, w = *n;
+    for (; i + 16 <= len && w + 8 <= cap; i += 16) {
+        __m128i c = LOADU(text + i);
+        int digits;
+        __m128i v = unhex_classify(c, &digits);
+        if (digits == 0xffff && k == 0) {
+            unhex_pack(out + w, v);
+            w += 8;
+            continue;
+        }
+        __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(c, _mm_set1_epi8('\t'))),
+                                  _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(c, _mm_set1_epi8('\r'))));
+        if ((digits | _mm_movemask_epi8(ws)) != 0xffff) break;
+
+        // the block's digits, contiguous from lane 0: the low half's as they
+        // are, the high half's (lanes 8..15) right after them
+        int lo = digits & 0xff, hi = digits >> 8;
+        size_t nlo = compact_len[lo];
+        size_t p = nlo + compact_len[hi];
+        __m128i ctrl = _mm_min_epu8(LOADU(compact_lut[lo] + 8),
+                                    _mm_add_epi8(LOADU(compact_lut[hi] + 8 - nlo), _mm_set1_epi8(8)));
+        __m128i packed = _mm_shuffle_epi8(v, ctrl);
+
+        acc = _mm_or_si128(acc, _mm_shuffle_epi8(packed, LOADU(shift_lut + 16 - k)));
+        if (k + p >= 16) {
+            unhex_pack(out + w, acc);
+            w += 8;
+            acc = _mm_shuffle_epi8(packed, LOADU(shift_lut + 32 - k));
+            k = k + p - 16;
+        } else {
+            k += p;
+        }
+    }
+    // the digits still pending are parsed again by the scalar loop
+    while (k > 0) {
+        if (hex_val[(uint8_t)text[--i]] != HEX_SPACE) --k;
+    }
+    *n = w;
+    return i;
+}
+#undef LOADU
+#endif
+
+size_t hex_encode(char* out, const uint8_t* data, size_t len, gboolean upper) {
+    if (!out || !data) return 0;
+    size_t i = 0;
+#ifdef HEXFMT_SSE2
+    for (; i + 16 <= len; i += 16) hex16_sse2(out + i * 2, data + i, upper);
+#endif
+    const char* pair = upper ? pair_upper : pair_lower;
+    for (; i < len; ++i) memcpy(out + i * 2, pair + data[i] * 2, 2);
+    return len * 2;
+}
+
+size_t hexdump_row(char* out, const uint8_t* data, size_t n, size_t offset) {
+    if (n > HEXDUMP_ROW_BYTES) n = HEXDUMP_ROW_BYTES;
+
+    uint32_t off = (uint32_t)offset;
+    memcpy(out + 0, pair_lower + ((off >> 24) & 0xff) * 2, 2);
+    memcpy(out + 2, pair_lower + ((off >> 16) & 0xff) * 2, 2);
+    memcpy(out + 4, pair_lower + ((off >> 8) & 0xff) * 2, 2);
+    memcpy(out + 6, pair_lower + (off & 0xff) * 2, 2);
+    memset(out + 8, ' ', HEXDUMP_ROW_CHARS - 8);
+
+    // hex columns start at 10, three chars per byte, one extra gap after byte 7
+    char* hx = out + 10;
+    char* asc = out + 10 + 49 + 3;
+#ifdef HEXFMT_SSE2
+    if (n == HEXDUMP_ROW_BYTES) {
+        char digits[32];
+        hex16_sse2(digits, data, FALSE);
+        for (size_t j = 0; j < 8; ++j) memcpy(hx + j * 3, digits + j * 2, 2);
+        for (size_t j = 8; j < 16; ++j) memcpy(hx + j * 3 + 1, digits + j * 2, 2);
+        ascii16_sse2(asc, data);
+    } else
+#endif
+    {
+        for (size_t j = 0; j < n; ++j) {
+            memcpy(hx + j * 3 + (j >= 8), pair_lower + data[j] * 2, 2);
+            uint8_t c = data[j];
+            asc[j] = (c >= 32 && c <= 126) ? (char)c : '.';
+        }
+    }
+    out[10 + 49] = ' ';
+    out[10 + 49 + 1] = '|';
+    out[HEXDUMP_ROW_CHARS - 2] = '|';
+    out[HEXDUMP_ROW_CHARS - 1] = '\n';
+    return HEXDUMP_ROW_CHARS;
+}
+
+size_t hexdump_format(char* out, size_t cap, const uint8_t* data, size_t len) {
+    if (!out || cap == 0) return 0;
+    size_t w = 0;
+    for (size_t i = 0; data && i < len && w + HEXDUMP_ROW_CHARS < cap; i += HEXDUMP_ROW_BYTES) {
+        size_t n = len - i < HEXDUMP_ROW_BYTES ? len - i : HEXDUMP_ROW_BYTES;
+        w += hexdump_row(out + w, data + i, n, i);
+    }
+    out[w] = '\0';
+    return w;
+}
+
+void hexdump_append(GString* s, const uint8_t* data, size_t len) {
+    if (!s || !data || len == 0) return;
+    gsize old = s->len;
+    size_t need = HEXDUMP_SIZE(len);
+    g_string_set_size(s, old + need - 1);
+    size_t w = hexdump_format(s->str + old, need, data, len);
+    g_string_truncate(s, old + w);
+}
+
+HexDecodeStatus hex_decode(uint8_t* out, size_t cap, const char* text, size_t len,
+                           size_t* out_len, size_t* err_off) {
+    size_t n = 0, i = 0, hi_at = 0;
+    int hi = -1;
+    HexDecodeStatus st = HEX_DECODE_OK;
+#ifdef HEXFMT_SSSE3
+    unhex_init();
+    if (have_ssse3) i = unhex_spaced_ssse3(out, cap, &n, text, len);
+#endif
+    while (st == HEX_DECODE_OK && i < len) {
+#ifdef HEXFMT_SSE2
+        // dense runs (no whitespace) go 16 digits at a time
+        if (hi < 0 && i + 16 <= len && n + 8 <= cap && unhex16_sse2(out + n, text + i)) {
+            i += 16;
+            n += 8;
+            continue;
+        }
+#endif
+        size_t end = len - i > 16 ? i + 16 : len;
+        for (; i < end; ++i) {
+            uint8_t v = hex_val[(uint8_t)text[i]];
+            if (v == HEX_SPACE) continue;
+            if (v == HEX_BAD) {
+                st = HEX_DECODE_BAD_CHAR;
+                break;
+            }
+            if (hi >= 0 && n >= cap) {
+                st = HEX_DECODE_OVERFLOW;
+                break;
+            }
+            if (hi < 0) {
+                hi = v;
+                hi_at = i;
+            } else {
+                out[n++] = (uint8_t)((hi << 4) | v);
+                hi = -1;
+            }
+        }
+    }
+    if (st == HEX_DECODE_OK && hi >= 0) {
+        st = HEX_DECODE_UNPAIRED;
+        i = hi_at;
+    }
+    if (out_len) *out_len = n;
+    if (st != HEX_DECODE_OK && err_off) *err_off = i;
+    return st;
+}
+
+void hex_decode_log(HexDecodeStatus st, const char* text, size_t err_off, size_t cap) {
+    switch (st) {
+    case HEX_DECODE_OK:
+        break;
+    case HEX_DECODE_OVERFLOW:
+        EVLOG("[SEND] hex payload exceeds %zu bytes (at offset %zu)", cap, err_off);
+        break;
+    case HEX_DECODE_UNPAIRED:
+        EVLOG("[SEND] hex parse failed: unpaired digit at offset %zu", err_off);
+        break;
+    case HEX_DECODE_BAD_CHAR:
+        EVLOG("[SEND] hex parse failed: invalid character 0x%02x at offset %zu",
+              (unsigned char)text[err_off], err_off);
+        break;
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <glib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Hex formatting and parsing shared by the packet view, the send path and
+// script output. Everything works from lookup tables (SSE2 for 16 bytes or
+// digits at a time when available; whitespace-separated digits are compacted
+// with SSSE3 when the CPU has it) straight into caller memory.
+//
+// Row layout (HEXDUMP_ROW_CHARS including '\n'):
+// "00000010  de ad be ef 00 01 02 03  04 05 06 07 08 09 0a 0b  | ................ |"
+
+#define HEXDUMP_ROW_BYTES 16
+#define HEXDUMP_ROW_CHARS 81
+// buffer size for a dump of len bytes, including the terminating NUL
+#define HEXDUMP_SIZE(len) ((((len) + HEXDUMP_ROW_BYTES - 1) / HEXDUMP_ROW_BYTES) * HEXDUMP_ROW_CHARS + 1)
+
+// write 2*len hex digits (no separator, no NUL); returns chars written
+size_t hex_encode(char* out, const uint8_t* data, size_t len, gboolean upper);
+
+// write one row for n (<= 16) bytes at offset; returns HEXDUMP_ROW_CHARS
+size_t hexdump_row(char* out, const uint8_t* data, size_t n, size_t offset);
+
+// dump data as rows into out (cap bytes, NUL terminated). Only whole rows are
+// written; returns chars written excluding the NUL.
+size_t hexdump_format(char* out, size_t cap, const uint8_t* data, size_t len);
+
+// append the full dump of data to s
+void hexdump_append(GString* s, const uint8_t* data, size_t len);
+
+typedef enum {
+    HEX_DECODE_OK = 0,
+    HEX_DECODE_BAD_CHAR,    // not a hex digit or whitespace
+    HEX_DECODE_UNPAIRED,    // odd number of digits
+    HEX_DECODE_OVERFLOW,    // more than cap bytes
+} HexDecodeStatus;
+
+// decode hex digits (whitespace between digits is ignored) into out, at most
+// cap bytes; no allocation. On failure *err_off is the offset of the first bad
+// character, of an unpaired trailing digit, or of the digit that would exceed
+// cap, and *out_len holds the bytes decoded before it.
+HexDecodeStatus hex_decode(uint8_t* out, size_t cap, const char* text, size_t len,
+                           size_t* out_len, size_t* err_off);
+
+// record why a send-box payload failed to decode, as a [SEND] event; cap is
+// the size limit hex_decode was given
+void hex_decode_log(HexDecodeStatus st, const char* text, size_t err_off, size_t cap);
+
+#ifdef __cplusplus
+}
+#endif
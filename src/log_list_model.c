@@ -0,0 +1,79 @@
+#include "log_list_model.h"
+
+struct _LogRow {
+    GObject parent_instance;
+    guint64 seq;
+};
+
+G_DEFINE_TYPE(LogRow, log_row, G_TYPE_OBJECT)
+
+static void log_row_class_init(LogRowClass* klass) {
+    (void)klass;
+}
+
+static void log_row_init(LogRow* row) {
+    (void)row;
+}
+
+guint64 log_row_seq(LogRow* row) {
+    return row ? row->seq : 0;
+}
+
+struct _LogListModel {
+    GObject parent_instance;
+    guint n_items;          // rows announced to the view so far
+};
+
+static GType log_list_model_get_item_type(GListModel* list) {
+    (void)list;
+    return LOG_TYPE_ROW;
+}
+
+static guint log_list_model_get_n_items(GListModel* list) {
+    return LOG_LIST_MODEL(list)->n_items;
+}
+
+static gpointer log_list_model_get_item(GListModel* list, guint position) {
+    LogListModel* m = LOG_LIST_MODEL(list);
+    if (position >= m->n_items) return NULL;
+    LogRow* row = g_object_new(LOG_TYPE_ROW, NULL);
+    row->seq = evlog_first_seq() + position;
+    return row;
+}
+
+static void log_list_model_iface_init(GListModelInterface* iface) {
+    iface->get_item_type = log_list_model_get_item_type;
+    iface->get_n_items = log_list_model_get_n_items;
+    iface->get_item = log_list_model_get_item;
+}
+
+G_DEFINE_TYPE_WITH_CODE(LogListModel, log_list_model, G_TYPE_OBJECT,
+                        G_IMPLEMENT_INTERFACE(G_TYPE_LIST_MODEL, log_list_model_iface_init))
+
+static void log_list_model_class_init(LogListModelClass* klass) {
+    (void)klass;
+}
+
+static void log_list_model_init(LogListModel* m) {
+    m->n_items = 0;
+}
+
+LogListModel* log_list_model_new(void) {
+    LogListModel* m = g_object_new(LOG_TYPE_LIST_MODEL, NULL);
+    m->n_items = evlog_count();
+    return m;
+}
+
+void log_list_model_apply(LogListModel* m, guint removed, guint added) {
+    if (!m) return;
+    if (removed > m->n_items) removed = m->n_items;
+    if (removed) {
+        m->n_items -= removed;
+        g_list_model_items_changed(G_LIST_MODEL(m), 0, removed, 0);
+    }
+    if (added) {
+        guint old = m->n_items;
+        m->n_items += added;
+        g_list_model_items_changed(G_LIST_MODEL(m), old, 0, added);
+    }
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <gio/gio.h>
+#include "event_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// GListModel over the event log history for GtkListView. Each LogRow only
+// carries the event's sequence number; text is rendered on bind through
+// evlog_format(), so rows that are never shown are never formatted.
+
+#define LOG_TYPE_ROW (log_row_get_type())
+G_DECLARE_FINAL_TYPE(LogRow, log_row, LOG, ROW, GObject)
+
+guint64 log_row_seq(LogRow* row);
+
+#define LOG_TYPE_LIST_MODEL (log_list_model_get_type())
+G_DECLARE_FINAL_TYPE(LogListModel, log_list_model, LOG, LIST_MODEL, GObject)
+
+LogListModel* log_list_model_new(void);
+
+// mirror an evlog_notify_fn change (removed from the front, added at the end)
+void log_list_model_apply(LogListModel* m, guint removed, guint added);
+
+#ifdef __cplusplus
+}
+#endif
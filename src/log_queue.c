@@ -0,0 +1,79 @@
+#include "log_queue.h"
+#include <stdio.h>
+#include <stdarg.h>
+
+struct LogQueue {
+    log_queue_fn fn;
+    void* user;
+
+    GMutex lock;
+    GString* pending;       // '\n'-terminated lines
+    guint nlines;
+    guint suppressed;
+    guint idle_id;          // non-zero while a flush is scheduled
+};
+
+static gboolean flush_idle_cb(gpointer data) {
+    LogQueue* q = (LogQueue*)data;
+
+    g_mutex_lock(&q->lock);
+    GString* batch = q->pending;
+    guint suppressed = q->suppressed;
+    q->pending = g_string_sized_new(batch->allocated_len);
+    q->nlines = 0;
+    q->suppressed = 0;
+    q->idle_id = 0;
+    g_mutex_unlock(&q->lock);
+
+    if (suppressed) g_string_append_printf(batch, "[LOG] %u lines suppressed\n", suppressed);
+    if (batch->len > 0) {
+        g_string_truncate(batch, batch->len - 1);
+        if (q->fn) q->fn(q->user, batch->str);
+    }
+    g_string_free(batch, TRUE);
+    return G_SOURCE_REMOVE;
+}
+
+LogQueue* log_queue_new(log_queue_fn fn, void* user) {
+    LogQueue* q = g_new0(LogQueue, 1);
+    q->fn = fn;
+    q->user = user;
+    q->pending = g_string_sized_new(4096);
+    g_mutex_init(&q->lock);
+    return q;
+}
+
+void log_queue_free(LogQueue* q) {
+    if (!q) return;
+    g_mutex_lock(&q->lock);
+    if (q->idle_id) g_source_remove(q->idle_id);
+    q->idle_id = 0;
+    g_mutex_unlock(&q->lock);
+    g_string_free(q->pending, TRUE);
+    g_mutex_clear(&q->lock);
+    g_free(q);
+}
+
+void log_queue_push(LogQueue* q, const char* line) {
+    if (!q || !line) return;
+    g_mutex_lock(&q->lock);
+    if (q->nlines < LOG_QUEUE_MAX_LINES) {
+        g_string_append(q->pending, line);
+        g_string_append_c(q->pending, '\n');
+        q->nlines++;
+    } else {
+        q->suppressed++;
+    }
+    if (!q->idle_id) q->idle_id = g_idle_add(flush_idle_cb, q);
+    g_mutex_unlock(&q->lock);
+}
+
+void log_queue_pushf(LogQueue* q, const char* fmt, ...) {
+    if (!q) return;
+    char buf[512];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    log_queue_push(q, buf);
+}
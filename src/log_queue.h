@@ -0,0 +1,29 @@
+#pragma once
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Coalesces log lines produced on any thread into one delivery per main-loop
+// iteration. Lines beyond LOG_QUEUE_MAX_LINES in one iteration are collapsed
+// into a single "N lines suppressed" summary so a flood cannot stall the UI.
+
+#define LOG_QUEUE_MAX_LINES 200
+
+// receives one or more '\n'-separated lines (no trailing newline), on the main loop
+typedef void (*log_queue_fn)(void* user, const char* text);
+
+typedef struct LogQueue LogQueue;
+
+LogQueue* log_queue_new(log_queue_fn fn, void* user);
+// must be called on the main loop thread
+void log_queue_free(LogQueue* q);
+
+// thread-safe
+void log_queue_push(LogQueue* q, const char* line);
+void log_queue_pushf(LogQueue* q, const char* fmt, ...) G_GNUC_PRINTF(2, 3);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,6 +1,8 @@
 #include <gtk/gtk.h>
+#include <string.h>
 #include "app_controller.h"
 #include "ui_main.h"
+#include "headless.h"
 
 static void on_activate(GtkApplication* app, gpointer user_data) {
     (void)user_data;
@@ -12,7 +14,8 @@ static void on_activate(GtkApplication* app, gpointer user_data) {
     UIMain* ui = ui_main_new(app, api, app_controller_user(ctrl));
 
     // Bind controller -> UI callbacks
-    app_controller_bind_ui(ctrl, (void*)ui, ui_main_log_append, ui_main_set_script_state, ui_main_packet_append);
+    app_controller_bind_ui(ctrl, (void*)ui, ui_main_log_append, ui_main_set_script_state, ui_main_packet_append,
+                           ui_main_metrics);
 
     // NOTE:
     // -  ctrl/ui ʾûӹ
@@ -21,6 +24,11 @@ static void on_activate(GtkApplication* app, gpointer user_data) {
 }
 
 int main(int argc, char** argv) {
+    // --headless never touches GTK, so it also works without a display
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--headless") == 0) return headless_main(argc, argv);
+    }
+
     GtkApplication* app = gtk_application_new("com.example.netassist", G_APPLICATION_DEFAULT_FLAGS);
     g_signal_connect(app, "activate", G_CALLBACK(on_activate), NULL);
 
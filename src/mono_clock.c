@@ -0,0 +1,26 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L     // clock_gettime()
+#endif
+#include "mono_clock.h"
+#include <time.h>
+
+gint64 mono_clock_ns(void) {
+#ifdef _WIN32
+    return g_get_monotonic_time() * 1000;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (gint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+gboolean mono_clock_wait_until(gint64 target, gint64 spin_ns, const gint* cancel) {
+    while (TRUE) {
+        if (cancel && g_atomic_int_get(cancel)) return FALSE;
+        gint64 left = target - mono_clock_ns();
+        if (left <= 0) return TRUE;
+        if (left > spin_ns) {
+            g_usleep((gulong)(MIN(left - spin_ns / 2, (gint64)100000000) / 1000));
+        }
+    }
+}
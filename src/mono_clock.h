@@ -0,0 +1,20 @@
+#pragma once
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Monotonic nanosecond clock and a cancellable precise wait, shared by the
+// replay pacer, the RTT probe and the bench harness. Any thread.
+
+// CLOCK_MONOTONIC in ns (microsecond resolution on Windows)
+gint64 mono_clock_ns(void);
+
+// sleep until spin_ns before target, then spin for the last stretch; wakes at
+// least every 100 ms to poll *cancel (may be NULL). FALSE when cancelled
+gboolean mono_clock_wait_until(gint64 target, gint64 spin_ns, const gint* cancel);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,174 @@
+#include "net_metrics.h"
+#include "event_log.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+// counter columns, in NetTotals order; the names double as CSV/JSON keys
+static const struct {
+    const char* name;
+    gsize ctr_off;
+    gsize tot_off;
+} net_fields[] = {
+#define NET_FIELD(f) { #f, G_STRUCT_OFFSET(NetCounters, f), G_STRUCT_OFFSET(NetTotals, f) }
+    NET_FIELD(rx_packets),
+    NET_FIELD(rx_bytes),
+    NET_FIELD(rx_truncated),
+    NET_FIELD(rx_dropped),
+    NET_FIELD(rx_errors),
+    NET_FIELD(tx_packets),
+    NET_FIELD(tx_bytes),
+    NET_FIELD(tx_dropped),
+    NET_FIELD(tx_errors),
+#undef NET_FIELD
+};
+
+#define TOTAL_AT(t, i) (*(uint64_t*)((char*)(t) + net_fields[i].tot_off))
+
+// RTT probe columns, after the counters; latencies in microseconds
+static const char* const rtt_fields[] = {
+    "rtt_sent", "rtt_received", "rtt_p50_us", "rtt_p99_us", "rtt_p999_us", "rtt_max_us"
+};
+
+static void export_rtt(GString* row, const ProbeStats* r, gboolean csv) {
+    guint64 counts[] = { r->sent, r->received };
+    double us[] = { r->p50_ns / 1e3, r->p99_ns / 1e3, r->p999_ns / 1e3, r->max_ns / 1e3 };
+    for (guint i = 0; i < G_N_ELEMENTS(rtt_fields); ++i) {
+        if (csv) g_string_append_c(row, ',');
+        else g_string_append_printf(row, ",\"%s\":", rtt_fields[i]);
+        if (i < 2) g_string_append_printf(row, "%" G_GUINT64_FORMAT, counts[i]);
+        else g_string_append_printf(row, "%.1f", us[i - 2]);
+    }
+}
+
+void net_counters_reset(NetCounters* c) {
+    if (c) memset(c, 0, sizeof(*c));
+}
+
+void net_counters_read(const NetCounters* c, NetTotals* acc) {
+    if (!c || !acc) return;
+    for (guint i = 0; i < G_N_ELEMENTS(net_fields); ++i) {
+        gsize* p = (gsize*)((char*)c + net_fields[i].ctr_off);
+        TOTAL_AT(acc, i) += (uint64_t)(gsize)g_atomic_pointer_get(p);
+    }
+}
+
+struct NetMeter {
+    NetTotals prev;
+    gint64 prev_us;             // monotonic time of the previous sample
+    gint64 start_us;
+
+    FILE* out;
+    char* path;
+    gboolean csv;
+};
+
+NetMeter* net_meter_new(void) {
+    NetMeter* m = g_new0(NetMeter, 1);
+    m->start_us = m->prev_us = g_get_monotonic_time();
+    return m;
+}
+
+void net_meter_free(NetMeter* m) {
+    if (!m) return;
+    net_meter_export_stop(m);
+    g_free(m);
+}
+
+static double rate(uint64_t now, uint64_t prev, double dt) {
+    return now >= prev ? (double)(now - prev) / dt : (double)now / dt;
+}
+
+static void export_close(NetMeter* m) {
+    if (m->out) fclose(m->out);
+    m->out = NULL;
+    g_free(m->path);
+    m->path = NULL;
+}
+
+static void export_row(NetMeter* m, const NetSample* s) {
+    GDateTime* dt = g_date_time_new_from_unix_utc(s->wall_us / G_USEC_PER_SEC);
+    char* when = dt ? g_date_time_format(dt, "%Y-%m-%dT%H:%M:%S") : NULL;
+    if (dt) g_date_time_unref(dt);
+    unsigned ms = (unsigned)(s->wall_us % G_USEC_PER_SEC / 1000);
+
+    GString* row = g_string_sized_new(512);
+    if (m->csv) {
+        g_string_append_printf(row, "%s.%03uZ,%.3f,%.0f,%.0f,%.0f,%.0f,%u", when ? when : "", ms,
+                               s->elapsed_s, s->rx_pps, s->rx_bps, s->tx_pps, s->tx_bps, s->conns);
+        for (guint i = 0; i < G_N_ELEMENTS(net_fields); ++i)
+            g_string_append_printf(row, ",%" G_GUINT64_FORMAT, (guint64)TOTAL_AT(&s->total, i));
+        export_rtt(row, &s->rtt, TRUE);
+        g_string_append_c(row, '\n');
+    } else {
+        g_string_append_printf(row, "{\"time\":\"%s.%03uZ\",\"elapsed_s\":%.3f,\"rx_pps\":%.0f,\"rx_bps\":%.0f,"
+                               "\"tx_pps\":%.0f,\"tx_bps\":%.0f,\"conns\":%u", when ? when : "", ms,
+                               s->elapsed_s, s->rx_pps, s->rx_bps, s->tx_pps, s->tx_bps, s->conns);
+        for (guint i = 0; i < G_N_ELEMENTS(net_fields); ++i)
+            g_string_append_printf(row, ",\"%s\":%" G_GUINT64_FORMAT, net_fields[i].name,
+                                   (guint64)TOTAL_AT(&s->total, i));
+        export_rtt(row, &s->rtt, FALSE);
+        g_string_append(row, "}\n");
+    }
+    g_free(when);
+
+    // flushed per row so a crashed or killed soak run still leaves every sample on disk
+    gboolean ok = fwrite(row->str, 1, row->len, m->out) == row->len && fflush(m->out) == 0;
+    g_string_free(row, TRUE);
+    if (!ok) {
+        EVLOG("[METRICS] write to %S failed: errno=%d; export stopped", EV_DUP(m->path), errno);
+        export_close(m);
+    }
+}
+
+void net_meter_sample(NetMeter* m, const NetTotals* now, unsigned conns, const ProbeStats* rtt, NetSample* out) {
+    gint64 t = g_get_monotonic_time();
+    double dt = (double)(t - m->prev_us) / G_USEC_PER_SEC;
+    if (dt <= 0) dt = 1e-6;
+
+    memset(out, 0, sizeof(*out));
+    out->wall_us = g_get_real_time();
+    out->elapsed_s = (double)(t - m->start_us) / G_USEC_PER_SEC;
+    out->total = *now;
+    out->conns = conns;
+    if (rtt) out->rtt = *rtt;
+    out->rx_pps = rate(now->rx_packets, m->prev.rx_packets, dt);
+    out->rx_bps = rate(now->rx_bytes, m->prev.rx_bytes, dt) * 8;
+    out->tx_pps = rate(now->tx_packets, m->prev.tx_packets, dt);
+    out->tx_bps = rate(now->tx_bytes, m->prev.tx_bytes, dt) * 8;
+
+    m->prev = *now;
+    m->prev_us = t;
+    if (m->out) export_row(m, out);
+}
+
+gboolean net_meter_export_start(NetMeter* m, const char* path, GError** error) {
+    if (!m || !path) return FALSE;
+    net_meter_export_stop(m);
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        int e = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(e), "cannot create %s: %s", path, g_strerror(e));
+        return FALSE;
+    }
+    m->out = f;
+    m->path = g_strdup(path);
+    m->csv = g_str_has_suffix(path, ".csv") || g_str_has_suffix(path, ".CSV");
+    if (m->csv) {
+        fputs("time,elapsed_s,rx_pps,rx_bps,tx_pps,tx_bps,conns", f);
+        for (guint i = 0; i < G_N_ELEMENTS(net_fields); ++i) fprintf(f, ",%s", net_fields[i].name);
+        for (guint i = 0; i < G_N_ELEMENTS(rtt_fields); ++i) fprintf(f, ",%s", rtt_fields[i]);
+        fputc('\n', f);
+    }
+    return TRUE;
+}
+
+gboolean net_meter_export_stop(NetMeter* m) {
+    if (!m || !m->out) return FALSE;
+    export_close(m);
+    return TRUE;
+}
+
+gboolean net_meter_exporting(NetMeter* m) {
+    return m && m->out;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "backend_api.h"
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Lock-free traffic counters. Hot paths add to them with one atomic add per
+// batch (never per byte); readers fold any number of them into a NetTotals
+// snapshot without stopping the writers. Fields are pointer-sized, so on
+// 32-bit builds byte counters wrap after 4 GiB.
+typedef struct {
+    gsize rx_packets;
+    gsize rx_bytes;
+    gsize rx_truncated;
+    gsize rx_dropped;
+    gsize rx_errors;
+    gsize tx_packets;
+    gsize tx_bytes;
+    gsize tx_dropped;
+    gsize tx_errors;
+} NetCounters;
+
+#define NET_COUNT(ctr, field, n) ((void)g_atomic_pointer_add(&(ctr)->field, (gsize)(n)))
+
+// only while no writer is running
+void net_counters_reset(NetCounters* c);
+// add c's current values to acc (any thread)
+void net_counters_read(const NetCounters* c, NetTotals* acc);
+
+// Per-second sampler: turns successive totals into rates and optionally
+// appends every sample to a CSV (".csv") or JSON Lines file.
+typedef struct NetMeter NetMeter;
+
+NetMeter* net_meter_new(void);
+void net_meter_free(NetMeter* m);
+
+// rates since the previous call; counters that went backwards (transport
+// reopened) count from zero. rtt (optional) is copied into the sample.
+// Appends to the export file when one is open.
+void net_meter_sample(NetMeter* m, const NetTotals* now, unsigned conns, const ProbeStats* rtt, NetSample* out);
+
+gboolean net_meter_export_start(NetMeter* m, const char* path, GError** error);
+// returns FALSE when no export was running
+gboolean net_meter_export_stop(NetMeter* m);
+gboolean net_meter_exporting(NetMeter* m);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,408 @@
+#include "pcap_replay.h"
+#include "mono_clock.h"
+#include <string.h>
+#include <errno.h>
+
+#define PCAP_MAGIC_US      0xa1b2c3d4u
+#define PCAP_MAGIC_NS      0xa1b23c4du
+#define PCAPNG_SHB_TYPE    0x0A0D0D0Au
+#define PCAPNG_BOM         0x1A2B3C4Du
+
+#define LINKTYPE_NULL      0
+#define LINKTYPE_ETHERNET  1
+#define LINKTYPE_RAW_BSD   12
+#define LINKTYPE_RAW_OBSD  14
+#define LINKTYPE_RAW       101
+#define LINKTYPE_LOOP      108
+#define LINKTYPE_LINUX_SLL 113
+#define LINKTYPE_IPV4      228
+#define LINKTYPE_IPV6      229
+#define LINKTYPE_LINUX_SLL2 276
+
+// sleep instead of spinning when the next slot is further away than this
+#define REPLAY_SPIN_NS     2000000
+#define REPLAY_LATE_NS     1000000
+
+typedef struct {
+    gint64 ts_ns;
+    const uint8_t* data;    // UDP payload inside the mapping
+    uint32_t len;
+} ReplayPkt;
+
+struct PcapReplay {
+    GMappedFile* map;
+    ReplayPkt* pkts;
+    guint count;
+    guint alloc;
+    guint skipped;
+    guint truncated;
+    gint64 span_ns;
+};
+
+// pcapng interface description: what a packet's link type and clock are
+typedef struct {
+    uint32_t linktype;
+    uint8_t tsresol;
+    gint64 tsoffset_s;
+} PcapngIf;
+
+static inline uint16_t rd16(const uint8_t* p, gboolean swap) {
+    uint16_t v;
+    memcpy(&v, p, 2);
+    return swap ? GUINT16_SWAP_LE_BE(v) : v;
+}
+
+static inline uint32_t rd32(const uint8_t* p, gboolean swap) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return swap ? GUINT32_SWAP_LE_BE(v) : v;
+}
+
+static inline uint64_t rd64(const uint8_t* p, gboolean swap) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return swap ? GUINT64_SWAP_LE_BE(v) : v;
+}
+
+static inline uint16_t be16(const uint8_t* p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+// UDP payload of an IPv4/IPv6 packet; fragments and other protocols are rejected
+static gboolean ip_udp_payload(const uint8_t* p, size_t n, const uint8_t** out, uint32_t* out_len,
+                               gboolean* truncated) {
+    const uint8_t* l4;
+    size_t avail;
+    if (n < 1) return FALSE;
+    if ((p[0] >> 4) == 4) {
+        size_t ihl = (size_t)(p[0] & 0x0f) * 4;
+        if (ihl < 20 || n < ihl || p[9] != 17) return FALSE;
+        if (be16(p + 6) & 0x3fff) return FALSE;     // MF set or non-zero offset
+        l4 = p + ihl;
+        avail = n - ihl;
+    } else if ((p[0] >> 4) == 6) {
+        if (n < 40) return FALSE;
+        uint8_t nh = p[6];
+        size_t off = 40;
+        // hop-by-hop, routing and destination options may precede UDP
+        for (int k = 0; k < 8 && (nh == 0 || nh == 43 || nh == 60); ++k) {
+            if (n < off + 2) return FALSE;
+            nh = p[off];
+            off += ((size_t)p[off + 1] + 1) * 8;
+        }
+        if (nh != 17 || off > n) return FALSE;
+        l4 = p + off;
+        avail = n - off;
+    } else {
+        return FALSE;
+    }
+
+    if (avail < 8) return FALSE;
+    uint16_t ulen = be16(l4 + 4);
+    if (ulen < 8) return FALSE;
+    size_t plen = ulen - 8u;
+    if (plen > avail - 8) {
+        plen = avail - 8;
+        *truncated = TRUE;
+    }
+    *out = l4 + 8;
+    *out_len = (uint32_t)plen;
+    return TRUE;
+}
+
+static gboolean link_udp_payload(uint32_t linktype, const uint8_t* p, size_t n, const uint8_t** out,
+                                 uint32_t* out_len, gboolean* truncated) {
+    size_t off;
+    switch (linktype) {
+    case LINKTYPE_ETHERNET: {
+        if (n < 14) return FALSE;
+        uint16_t et = be16(p + 12);
+        off = 14;
+        for (int k = 0; k < 2 && (et == 0x8100 || et == 0x88a8); ++k) {
+            if (n < off + 4) return FALSE;
+            et = be16(p + off + 2);
+            off += 4;
+        }
+        if (et != 0x0800 && et != 0x86dd) return FALSE;
+        break;
+    }
+    case LINKTYPE_NULL:
+    case LINKTYPE_LOOP:
+        off = 4;                // address family; the IP version nibble is checked below
+        break;
+    case LINKTYPE_RAW_BSD:
+    case LINKTYPE_RAW_OBSD:
+    case LINKTYPE_RAW:
+    case LINKTYPE_IPV4:
+    case LINKTYPE_IPV6:
+        off = 0;
+        break;
+    case LINKTYPE_LINUX_SLL:
+        off = 16;
+        break;
+    case LINKTYPE_LINUX_SLL2:
+        off = 20;
+        break;
+    default:
+        return FALSE;
+    }
+    if (n < off) return FALSE;
+    return ip_udp_payload(p + off, n - off, out, out_len, truncated);
+}
+
+static void index_packet(PcapReplay* r, uint32_t linktype, const uint8_t* data, size_t caplen,
+                         gint64 ts_ns) {
+    const uint8_t* payload;
+    uint32_t len;
+    gboolean truncated = FALSE;
+    if (!link_udp_payload(linktype, data, caplen, &payload, &len, &truncated)) {
+        r->skipped++;
+        return;
+    }
+    if (truncated) r->truncated++;
+    if (r->count == r->alloc) {
+        r->alloc = r->alloc ? r->alloc * 2 : 1024;
+        r->pkts = g_renew(ReplayPkt, r->pkts, r->alloc);
+    }
+    ReplayPkt* p = &r->pkts[r->count++];
+    p->ts_ns = ts_ns;
+    p->data = payload;
+    p->len = len;
+}
+
+static void index_pcap(PcapReplay* r, const uint8_t* d, size_t n) {
+    uint32_t magic = rd32(d, FALSE);
+    gboolean swap = magic == GUINT32_SWAP_LE_BE(PCAP_MAGIC_US) || magic == GUINT32_SWAP_LE_BE(PCAP_MAGIC_NS);
+    gboolean nsec = magic == PCAP_MAGIC_NS || magic == GUINT32_SWAP_LE_BE(PCAP_MAGIC_NS);
+    // the upper bits of the link type field carry FCS information
+    uint32_t linktype = rd32(d + 20, swap) & 0x03ffffff;
+
+    size_t off = 24;
+    while (off + 16 <= n) {
+        gint64 sec = rd32(d + off, swap);
+        gint64 frac = rd32(d + off + 4, swap);
+        uint32_t incl = rd32(d + off + 8, swap);
+        off += 16;
+        if (incl > n - off) break;      // cut-off last record
+        index_packet(r, linktype, d + off, incl, sec * 1000000000 + (nsec ? frac : frac * 1000));
+        off += incl;
+    }
+}
+
+// if_tsresol: 10^-k seconds, or 2^-k when the top bit is set
+static gint64 pcapng_ts_ns(const PcapngIf* ifc, guint64 t) {
+    static const gint64 pow10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000,
+                                    100000000, 1000000000 };
+    gint64 ns;
+    int k = ifc->tsresol & 0x7f;
+    if (ifc->tsresol & 0x80) {
+        if (k >= 63) return 0;
+        guint64 frac = t & ((G_GUINT64_CONSTANT(1) << k) - 1);
+        ns = (gint64)(t >> k) * 1000000000 + (gint64)((double)frac * 1e9 / (double)(G_GUINT64_CONSTANT(1) << k));
+    } else if (k <= 9) {
+        ns = (gint64)t * pow10[9 - k];
+    } else if (k <= 18) {
+        ns = (gint64)(t / (guint64)pow10[k - 9]);
+    } else {
+        return 0;
+    }
+    return ns + ifc->tsoffset_s * 1000000000;
+}
+
+static void index_pcapng(PcapReplay* r, const uint8_t* d, size_t n) {
+    PcapngIf* ifs = NULL;
+    guint nifs = 0;
+    gboolean swap = FALSE;
+    gint64 last_ts = 0;
+
+    size_t off = 0;
+    while (off + 12 <= n) {
+        uint32_t type = rd32(d + off, swap);
+        if (type == PCAPNG_SHB_TYPE) {
+            // each section declares its own byte order; interfaces restart at 0
+            uint32_t bom = rd32(d + off + 8, FALSE);
+            if (bom == PCAPNG_BOM) swap = FALSE;
+            else if (bom == GUINT32_SWAP_LE_BE(PCAPNG_BOM)) swap = TRUE;
+            else break;
+            nifs = 0;
+        }
+        uint32_t len = rd32(d + off + 4, swap);
+        if (len < 12 || (len & 3) || len > n - off) break;
+        const uint8_t* body = d + off + 8;
+        size_t blen = len - 12;
+
+        if (type == 1 && blen >= 8) {
+            // Interface Description Block
+            ifs = g_renew(PcapngIf, ifs, nifs + 1);
+            PcapngIf* ifc = &ifs[nifs++];
+            ifc->linktype = rd16(body, swap);
+            ifc->tsresol = 6;
+            ifc->tsoffset_s = 0;
+            size_t o = 8;
+            while (o + 4 <= blen) {
+                uint16_t code = rd16(body + o, swap);
+                uint16_t olen = rd16(body + o + 2, swap);
+                if (code == 0 || o + 4 + olen > blen) break;
+                if (code == 9 && olen >= 1) ifc->tsresol = body[o + 4];
+                if (code == 14 && olen == 8) ifc->tsoffset_s = (gint64)rd64(body + o + 4, swap);
+                o += 4 + ((olen + 3u) & ~3u);
+            }
+        } else if (type == 6 && blen >= 20) {
+            // Enhanced Packet Block
+            uint32_t ifid = rd32(body, swap);
+            guint64 ts = ((guint64)rd32(body + 4, swap) << 32) | rd32(body + 8, swap);
+            uint32_t caplen = rd32(body + 12, swap);
+            if (ifid < nifs && caplen <= blen - 20) {
+                last_ts = pcapng_ts_ns(&ifs[ifid], ts);
+                index_packet(r, ifs[ifid].linktype, body + 20, caplen, last_ts);
+            } else {
+                r->skipped++;
+            }
+        } else if (type == 3 && blen >= 4 && nifs > 0) {
+            // Simple Packet Block: interface 0, no timestamp
+            uint32_t orig = rd32(body, swap);
+            index_packet(r, ifs[0].linktype, body + 4, MIN((size_t)orig, blen - 4), last_ts);
+        } else if (type == 2 && blen >= 20) {
+            // obsolete Packet Block
+            uint32_t ifid = rd16(body, swap);
+            guint64 ts = ((guint64)rd32(body + 4, swap) << 32) | rd32(body + 8, swap);
+            uint32_t caplen = rd32(body + 12, swap);
+            if (ifid < nifs && caplen <= blen - 20) {
+                last_ts = pcapng_ts_ns(&ifs[ifid], ts);
+                index_packet(r, ifs[ifid].linktype, body + 20, caplen, last_ts);
+            } else {
+                r->skipped++;
+            }
+        }
+        off += len;
+    }
+    g_free(ifs);
+}
+
+PcapReplay* pcap_replay_open(const char* path, GError** error) {
+    GMappedFile* map = g_mapped_file_new(path, FALSE, error);
+    if (!map) return NULL;
+
+    const uint8_t* d = (const uint8_t*)g_mapped_file_get_contents(map);
+    size_t n = g_mapped_file_get_length(map);
+    uint32_t magic = n >= 4 ? rd32(d, FALSE) : 0;
+
+    PcapReplay* r = g_new0(PcapReplay, 1);
+    r->map = map;
+    if (n >= 24 && (magic == PCAP_MAGIC_US || magic == PCAP_MAGIC_NS ||
+                    magic == GUINT32_SWAP_LE_BE(PCAP_MAGIC_US) || magic == GUINT32_SWAP_LE_BE(PCAP_MAGIC_NS))) {
+        index_pcap(r, d, n);
+    } else if (n >= 28 && magic == PCAPNG_SHB_TYPE) {
+        index_pcapng(r, d, n);
+    } else {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "%s is not a pcap or pcapng file", path);
+        pcap_replay_free(r);
+        return NULL;
+    }
+
+    if (r->count > 0) {
+        gint64 lo = r->pkts[0].ts_ns, hi = lo;
+        for (guint i = 1; i < r->count; ++i) {
+            lo = MIN(lo, r->pkts[i].ts_ns);
+            hi = MAX(hi, r->pkts[i].ts_ns);
+        }
+        r->span_ns = hi - lo;
+    }
+    return r;
+}
+
+void pcap_replay_free(PcapReplay* r) {
+    if (!r) return;
+    g_free(r->pkts);
+    if (r->map) g_mapped_file_unref(r->map);
+    g_free(r);
+}
+
+guint pcap_replay_count(const PcapReplay* r) {
+    return r ? r->count : 0;
+}
+
+guint pcap_replay_skipped(const PcapReplay* r) {
+    return r ? r->skipped : 0;
+}
+
+guint pcap_replay_truncated(const PcapReplay* r) {
+    return r ? r->truncated : 0;
+}
+
+gint64 pcap_replay_span_ns(const PcapReplay* r) {
+    return r ? r->span_ns : 0;
+}
+
+gboolean pcap_replay_run(PcapReplay* r, UdpIo* io, double speed, const gint* cancel,
+                         PcapReplayReport* report) {
+    PcapReplayReport tmp;
+    if (!report) report = &tmp;
+    memset(report, 0, sizeof(*report));
+    if (!r || !io) return FALSE;
+    if (r->count == 0) return TRUE;
+
+    gboolean paced = speed > 0;
+    gint64 t0 = r->pkts[0].ts_ns;
+    const uint8_t* ptrs[PCAP_REPLAY_BATCH];
+    size_t lens[PCAP_REPLAY_BATCH];
+    double err_sum = 0;
+
+    // scheduled offset of packet i from the start; out-of-order stamps go out at once
+#define DUE(i) (r->pkts[i].ts_ns > t0 ? (gint64)((double)(r->pkts[i].ts_ns - t0) / speed) : 0)
+
+    gint64 start = mono_clock_ns();
+    guint i = 0;
+    while (i < r->count) {
+        if (cancel && g_atomic_int_get(cancel)) {
+            report->cancelled = TRUE;
+            break;
+        }
+        if (paced && !mono_clock_wait_until(start + DUE(i) - PCAP_REPLAY_SLACK_NS, REPLAY_SPIN_NS, cancel)) {
+            report->cancelled = TRUE;
+            break;
+        }
+
+        // everything due within the slack goes out in one sendmmsg()
+        gint64 now = mono_clock_ns();
+        guint n = 0;
+        while (i + n < r->count && n < PCAP_REPLAY_BATCH) {
+            if (paced && n > 0 && start + DUE(i + n) > now + PCAP_REPLAY_SLACK_NS) break;
+            ptrs[n] = r->pkts[i + n].data;
+            lens[n] = r->pkts[i + n].len;
+            n++;
+        }
+
+        int err = 0;
+        size_t sent = udp_io_send_many(io, ptrs, lens, n, &err);
+        for (size_t k = 0; k < sent; ++k) {
+            report->bytes += lens[k];
+            if (!paced) continue;
+            gint64 e = now - (start + DUE(i + k));
+            if (e > REPLAY_LATE_NS) report->late++;
+            if (e < 0) e = -e;
+            err_sum += (double)e;
+            report->err_max_ns = MAX(report->err_max_ns, e);
+        }
+        report->packets += sent;
+        i += (guint)sent;
+        if (sent < n) {
+            report->send_errno = err ? err : EIO;
+            break;
+        }
+    }
+#undef DUE
+
+    report->elapsed_ns = mono_clock_ns() - start;
+    if (report->elapsed_ns > 0) {
+        report->achieved_pps = (guint64)((double)report->packets * 1e9 / (double)report->elapsed_ns);
+    }
+    if (paced) {
+        report->requested_ns = (gint64)((double)r->span_ns / speed);
+        if (report->requested_ns > 0) {
+            report->requested_pps = (guint64)((double)r->count * 1e9 / (double)report->requested_ns);
+        }
+        if (report->packets > 0) report->err_mean_ns = (gint64)(err_sum / (double)report->packets);
+    }
+    return report->send_errno == 0 && !report->cancelled;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "udp_io.h"
+#include <glib.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Replay of a recorded pcap or pcapng file to the configured UDP target.
+// The file is memory-mapped and indexed once; only the UDP payload of each
+// IPv4/IPv6 datagram is kept (as a pointer into the mapping) and sent from
+// there without copying. Other packets (TCP, ARP, fragments) are skipped.
+//
+// Link types: Ethernet (incl. VLAN tags), raw IP, Linux SLL/SLL2, BSD loopback.
+
+#define PCAP_REPLAY_BATCH    64         // datagrams per send call
+#define PCAP_REPLAY_SLACK_NS 20000      // packets due this soon join the current batch
+
+typedef struct PcapReplay PcapReplay;
+
+typedef struct {
+    guint64 packets;        // datagrams sent
+    guint64 bytes;          // payload bytes sent
+    gint64 elapsed_ns;
+    gint64 requested_ns;    // file span scaled by speed; 0 when unpaced
+    guint64 achieved_pps;
+    guint64 requested_pps;  // 0 when unpaced
+    gint64 err_mean_ns;     // mean |send time - scheduled time|; 0 when unpaced
+    gint64 err_max_ns;
+    guint64 late;           // packets sent more than 1 ms after their slot
+    int send_errno;         // non-zero when a send failed and replay stopped
+    gboolean cancelled;
+} PcapReplayReport;
+
+PcapReplay* pcap_replay_open(const char* path, GError** error);
+void pcap_replay_free(PcapReplay* r);
+
+// datagrams found / packets in the file that were not UDP over IP
+guint pcap_replay_count(const PcapReplay* r);
+guint pcap_replay_skipped(const PcapReplay* r);
+// payloads cut short by the capture snaplen (sent as captured)
+guint pcap_replay_truncated(const PcapReplay* r);
+// time between first and last datagram in the file
+gint64 pcap_replay_span_ns(const PcapReplay* r);
+
+// Send every datagram to io's target, blocking the calling thread.
+// speed: 1.0 = original timing, 2.0 = twice as fast, <= 0 = as fast as possible.
+// cancel (optional) is polled between batches.
+gboolean pcap_replay_run(PcapReplay* r, UdpIo* io, double speed, const gint* cancel,
+                         PcapReplayReport* report);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,348 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L     // clock_gettime()
+#endif
+#include "pcapng_writer.h"
+#include "event_log.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#define PCAPNG_SHB_TYPE     0x0A0D0D0Au
+#define PCAPNG_IDB_TYPE     0x00000001u
+#define PCAPNG_EPB_TYPE     0x00000006u
+#define PCAPNG_BOM          0x1A2B3C4Du
+#define PCAPNG_LINKTYPE_IPV4 228
+
+#define OPT_ENDOFOPT    0
+#define OPT_SHB_USERAPPL 4
+#define OPT_IF_TSRESOL  9
+#define OPT_EPB_FLAGS   2
+
+#define IPV4_UDP_HDR    28
+#define IPV4_MAX_PAYLOAD (65535 - IPV4_UDP_HDR)
+
+// EPB: 28 byte header, padded packet, epb_flags option, end of options, trailing length
+#define PAD4(n) (((n) + 3u) & ~3u)
+#define EPB_SIZE(caplen) (28u + PAD4(caplen) + 8u + 4u + 4u)
+
+typedef struct {
+    size_t len;
+    uint8_t data[];
+} PcapngChunk;
+
+struct PcapngWriter {
+    GMutex lock;
+    GCond cond;             // writer thread: chunk queued or stop requested
+    gint active;            // producers check this without the lock first
+
+    PcapngChunk* cur;       // chunk producers are filling
+    GQueue full;            // waiting for the writer thread
+    GQueue spare;
+    guint nchunks;
+    gboolean stopping;
+
+    FILE* fp;
+    GThread* thread;
+
+    guint64 packets;
+    guint64 bytes;
+    guint64 dropped;
+    gboolean failed;
+};
+
+gint64 pcapng_now_ns(void) {
+#ifdef _WIN32
+    return g_get_real_time() * 1000;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (gint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static inline uint8_t* put16(uint8_t* p, uint16_t v) { memcpy(p, &v, 2); return p + 2; }
+static inline uint8_t* put32(uint8_t* p, uint32_t v) { memcpy(p, &v, 4); return p + 4; }
+
+// IPv4 header checksum over the 20 header bytes
+static uint16_t ip_checksum(const uint8_t* h) {
+    uint32_t sum = 0;
+    for (int i = 0; i < 20; i += 2) sum += (uint32_t)(h[i] << 8 | h[i + 1]);
+    while (sum >> 16) sum = (sum & 0xffff) + (sum >> 16);
+    return (uint16_t)~sum;
+}
+
+// one Enhanced Packet Block carrying IPv4 + UDP + payload; returns bytes written
+static size_t epb_encode(uint8_t* out, PcapngDir dir, gint64 ts_ns, const UdpPeer* local,
+                         const PcapngPkt* pkt) {
+    uint32_t len = MIN(pkt->len, (uint32_t)IPV4_MAX_PAYLOAD);
+    uint32_t caplen = IPV4_UDP_HDR + len;
+    uint32_t total = EPB_SIZE(caplen);
+    const UdpPeer* src = dir == PCAPNG_IN ? &pkt->peer : local;
+    const UdpPeer* dst = dir == PCAPNG_IN ? local : &pkt->peer;
+
+    uint8_t* p = out;
+    p = put32(p, PCAPNG_EPB_TYPE);
+    p = put32(p, total);
+    p = put32(p, 0);                                // interface id
+    p = put32(p, (uint32_t)((guint64)ts_ns >> 32));
+    p = put32(p, (uint32_t)ts_ns);
+    p = put32(p, caplen);
+    p = put32(p, caplen);
+
+    // addresses and ports are already in network byte order
+    uint8_t* ip = p;
+    ip[0] = 0x45;
+    ip[1] = 0;
+    ip[2] = (uint8_t)(caplen >> 8);
+    ip[3] = (uint8_t)caplen;
+    ip[4] = ip[5] = 0;                              // id
+    ip[6] = 0x40;                                   // don't fragment
+    ip[7] = 0;
+    ip[8] = 64;                                     // ttl
+    ip[9] = 17;                                     // UDP
+    ip[10] = ip[11] = 0;
+    memcpy(ip + 12, &src->addr, 4);
+    memcpy(ip + 16, &dst->addr, 4);
+    uint16_t csum = ip_checksum(ip);
+    ip[10] = (uint8_t)(csum >> 8);
+    ip[11] = (uint8_t)csum;
+
+    uint8_t* udp = ip + 20;
+    memcpy(udp, &src->port, 2);
+    memcpy(udp + 2, &dst->port, 2);
+    udp[4] = (uint8_t)((8 + len) >> 8);
+    udp[5] = (uint8_t)(8 + len);
+    udp[6] = udp[7] = 0;                            // no checksum (allowed for IPv4)
+    memcpy(udp + 8, pkt->data, len);
+
+    p += caplen;
+    memset(p, 0, PAD4(caplen) - caplen);
+    p += PAD4(caplen) - caplen;
+
+    p = put16(p, OPT_EPB_FLAGS);
+    p = put16(p, 4);
+    p = put32(p, (uint32_t)dir);
+    p = put32(p, OPT_ENDOFOPT);
+    p = put32(p, total);
+    return (size_t)(p - out);
+}
+
+// Section Header Block + one Interface Description Block
+static size_t header_encode(uint8_t* out) {
+    static const char appl[] = "netassist";
+    uint32_t appl_len = sizeof(appl) - 1;
+    uint32_t shb_len = 24 + 4 + PAD4(appl_len) + 4 + 4;
+    uint32_t idb_len = 16 + 4 + 4 + 4 + 4;
+
+    uint8_t* p = out;
+    p = put32(p, PCAPNG_SHB_TYPE);
+    p = put32(p, shb_len);
+    p = put32(p, PCAPNG_BOM);
+    p = put16(p, 1);
+    p = put16(p, 0);
+    p = put32(p, 0xffffffffu);                      // section length unknown (-1)
+    p = put32(p, 0xffffffffu);
+    p = put16(p, OPT_SHB_USERAPPL);
+    p = put16(p, (uint16_t)appl_len);
+    memset(p, 0, PAD4(appl_len));
+    memcpy(p, appl, appl_len);
+    p += PAD4(appl_len);
+    p = put32(p, OPT_ENDOFOPT);
+    p = put32(p, shb_len);
+
+    p = put32(p, PCAPNG_IDB_TYPE);
+    p = put32(p, idb_len);
+    p = put16(p, PCAPNG_LINKTYPE_IPV4);
+    p = put16(p, 0);
+    p = put32(p, 65535);                            // snaplen
+    p = put16(p, OPT_IF_TSRESOL);
+    p = put16(p, 1);
+    p = put32(p, 9);                                // 10^-9 s, padding bytes are zero
+    p = put32(p, OPT_ENDOFOPT);
+    p = put32(p, idb_len);
+    return (size_t)(p - out);
+}
+
+PcapngWriter* pcapng_writer_new(void) {
+    PcapngWriter* w = g_new0(PcapngWriter, 1);
+    g_mutex_init(&w->lock);
+    g_cond_init(&w->cond);
+    g_queue_init(&w->full);
+    g_queue_init(&w->spare);
+    return w;
+}
+
+void pcapng_writer_free(PcapngWriter* w) {
+    if (!w) return;
+    pcapng_writer_stop(w);
+    PcapngChunk* c;
+    while ((c = g_queue_pop_head(&w->spare))) g_free(c);
+    g_free(w->cur);
+    g_cond_clear(&w->cond);
+    g_mutex_clear(&w->lock);
+    g_free(w);
+}
+
+// lock held; NULL when every chunk is already queued for the writer
+static PcapngChunk* chunk_take(PcapngWriter* w) {
+    PcapngChunk* c = g_queue_pop_head(&w->spare);
+    if (!c && w->nchunks < PCAPNG_MAX_CHUNKS) {
+        c = g_malloc(sizeof(PcapngChunk) + PCAPNG_CHUNK);
+        w->nchunks++;
+    }
+    if (c) c->len = 0;
+    return c;
+}
+
+// lock held
+static void chunk_queue_cur(PcapngWriter* w) {
+    if (!w->cur) return;
+    if (w->cur->len == 0) return;
+    g_queue_push_tail(&w->full, w->cur);
+    w->cur = NULL;
+    g_cond_signal(&w->cond);
+}
+
+static gpointer writer_thread(gpointer data) {
+    PcapngWriter* w = (PcapngWriter*)data;
+    g_mutex_lock(&w->lock);
+    while (TRUE) {
+        if (g_queue_is_empty(&w->full)) {
+            if (w->stopping) break;
+            gint64 deadline = g_get_monotonic_time() + PCAPNG_FLUSH_MS * G_TIME_SPAN_MILLISECOND;
+            // quiet traffic still reaches the disk within one flush interval
+            if (!g_cond_wait_until(&w->cond, &w->lock, deadline)) chunk_queue_cur(w);
+            continue;
+        }
+
+        PcapngChunk* c = g_queue_pop_head(&w->full);
+        g_mutex_unlock(&w->lock);
+
+        size_t n = w->failed ? c->len : fwrite(c->data, 1, c->len, w->fp);
+        int err = errno;
+
+        g_mutex_lock(&w->lock);
+        if (n != c->len && !w->failed) {
+            w->failed = TRUE;
+            g_atomic_int_set(&w->active, FALSE);
+            EVLOG("[CAP] write failed: errno=%d, capture stopped", err);
+        } else if (!w->failed) {
+            w->bytes += n;
+        }
+        g_queue_push_tail(&w->spare, c);
+    }
+    g_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+gboolean pcapng_writer_start(PcapngWriter* w, const char* path, GError** error) {
+    g_return_val_if_fail(w && path, FALSE);
+    g_mutex_lock(&w->lock);
+    gboolean running = w->thread != NULL;
+    g_mutex_unlock(&w->lock);
+    if (running) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_EXIST, "capture already running");
+        return FALSE;
+    }
+
+    FILE* fp = fopen(path, "wb");
+    if (!fp) {
+        int err = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(err),
+                    "cannot create %s: %s", path, g_strerror(err));
+        return FALSE;
+    }
+    // chunks are already large; stdio buffering would only add a copy
+    setvbuf(fp, NULL, _IONBF, 0);
+
+    uint8_t hdr[128];
+    size_t hlen = header_encode(hdr);
+    if (fwrite(hdr, 1, hlen, fp) != hlen) {
+        int err = errno;
+        fclose(fp);
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(err),
+                    "cannot write %s: %s", path, g_strerror(err));
+        return FALSE;
+    }
+
+    g_mutex_lock(&w->lock);
+    w->fp = fp;
+    w->stopping = FALSE;
+    w->packets = 0;
+    w->bytes = hlen;
+    w->dropped = 0;
+    w->failed = FALSE;
+    w->thread = g_thread_new("pcapng-writer", writer_thread, w);
+    g_atomic_int_set(&w->active, TRUE);
+    g_mutex_unlock(&w->lock);
+    return TRUE;
+}
+
+gboolean pcapng_writer_stop(PcapngWriter* w) {
+    if (!w) return FALSE;
+    g_mutex_lock(&w->lock);
+    GThread* th = w->thread;
+    w->thread = NULL;
+    g_atomic_int_set(&w->active, FALSE);
+    if (th) {
+        chunk_queue_cur(w);
+        w->stopping = TRUE;
+        g_cond_signal(&w->cond);
+    }
+    g_mutex_unlock(&w->lock);
+    if (!th) return FALSE;
+
+    g_thread_join(th);
+    if (w->fp) {
+        if (fclose(w->fp) != 0 && !w->failed) {
+            w->failed = TRUE;
+            EVLOG("[CAP] close failed: errno=%d", errno);
+        }
+        w->fp = NULL;
+    }
+    return TRUE;
+}
+
+gboolean pcapng_writer_active(PcapngWriter* w) {
+    return w && g_atomic_int_get(&w->active);
+}
+
+void pcapng_writer_add(PcapngWriter* w, PcapngDir dir, gint64 ts_ns, const UdpPeer* local,
+                       const PcapngPkt* pkts, size_t n) {
+    if (!w || n == 0 || !g_atomic_int_get(&w->active)) return;
+    static const UdpPeer any = { 0, 0 };
+    if (!local) local = &any;
+
+    g_mutex_lock(&w->lock);
+    if (!w->active) {
+        g_mutex_unlock(&w->lock);
+        return;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        size_t need = EPB_SIZE(IPV4_UDP_HDR + MIN(pkts[i].len, (uint32_t)IPV4_MAX_PAYLOAD));
+        if (!w->cur || w->cur->len + need > PCAPNG_CHUNK) {
+            chunk_queue_cur(w);
+            if (!w->cur) w->cur = chunk_take(w);
+            if (!w->cur) {
+                // the disk is behind: never stall the caller
+                w->dropped += n - i;
+                break;
+            }
+        }
+        w->cur->len += epb_encode(w->cur->data + w->cur->len, dir, ts_ns, local, &pkts[i]);
+        w->packets++;
+    }
+    g_mutex_unlock(&w->lock);
+}
+
+void pcapng_writer_stats(PcapngWriter* w, PcapngStats* out) {
+    memset(out, 0, sizeof(*out));
+    if (!w) return;
+    g_mutex_lock(&w->lock);
+    out->packets = w->packets;
+    out->bytes = w->bytes;
+    out->dropped = w->dropped;
+    out->failed = w->failed;
+    g_mutex_unlock(&w->lock);
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "backend_api.h"
+#include <glib.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Streaming pcapng capture. Producers (receive thread, senders) encode each
+// datagram as an Enhanced Packet Block straight into a large in-memory chunk
+// under a short per-batch lock; full chunks are handed to a writer thread that
+// owns the file. Producers never wait for the disk: when every chunk is queued
+// the batch is dropped and counted instead.
+//
+// Packets are written with a synthesized IPv4/UDP header (LINKTYPE_IPV4) so
+// Wireshark decodes ports and addresses, nanosecond timestamps and the
+// inbound/outbound direction flag.
+
+#define PCAPNG_CHUNK      (4u << 20)    // bytes per buffer handed to the writer
+#define PCAPNG_MAX_CHUNKS 32            // buffered data before producers drop
+#define PCAPNG_FLUSH_MS   250           // partial chunks are written after this idle time
+
+typedef enum {
+    PCAPNG_IN  = 1,
+    PCAPNG_OUT = 2
+} PcapngDir;
+
+typedef struct {
+    const uint8_t* data;
+    uint32_t len;
+    UdpPeer peer;           // remote end of the datagram
+} PcapngPkt;
+
+typedef struct PcapngWriter PcapngWriter;
+
+// realtime clock in nanoseconds since the epoch
+gint64 pcapng_now_ns(void);
+
+// the writer object may outlive many captures; producers can hold it freely
+PcapngWriter* pcapng_writer_new(void);
+void pcapng_writer_free(PcapngWriter* w);
+
+// create path, write the section/interface headers and start the writer thread
+gboolean pcapng_writer_start(PcapngWriter* w, const char* path, GError** error);
+// flush everything queued, stop the thread and close the file;
+// returns FALSE when no capture was running
+gboolean pcapng_writer_stop(PcapngWriter* w);
+gboolean pcapng_writer_active(PcapngWriter* w);
+
+// any thread; one lock per call. local is this socket's bound address.
+void pcapng_writer_add(PcapngWriter* w, PcapngDir dir, gint64 ts_ns, const UdpPeer* local,
+                       const PcapngPkt* pkts, size_t n);
+
+// counters for the current/last capture
+typedef struct {
+    guint64 packets;
+    guint64 bytes;          // file bytes written
+    guint64 dropped;        // packets not captured because the writer fell behind
+    gboolean failed;        // a write error stopped the capture
+} PcapngStats;
+
+void pcapng_writer_stats(PcapngWriter* w, PcapngStats* out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,84 @@
+#include "pkt_list_model.h"
+
+struct _PktRow {
+    GObject parent_instance;
+    guint index;
+};
+
+G_DEFINE_TYPE(PktRow, pkt_row, G_TYPE_OBJECT)
+
+static void pkt_row_class_init(PktRowClass* klass) {
+    (void)klass;
+}
+
+static void pkt_row_init(PktRow* row) {
+    (void)row;
+}
+
+guint pkt_row_index(PktRow* row) {
+    return row ? row->index : 0;
+}
+
+struct _PktListModel {
+    GObject parent_instance;
+    PktStore* store;
+    guint n_items;          // rows announced to the view so far
+};
+
+static GType pkt_list_model_get_item_type(GListModel* list) {
+    (void)list;
+    return PKT_TYPE_ROW;
+}
+
+static guint pkt_list_model_get_n_items(GListModel* list) {
+    return PKT_LIST_MODEL(list)->n_items;
+}
+
+static gpointer pkt_list_model_get_item(GListModel* list, guint position) {
+    PktListModel* m = PKT_LIST_MODEL(list);
+    if (position >= m->n_items) return NULL;
+    PktRow* row = g_object_new(PKT_TYPE_ROW, NULL);
+    row->index = position;
+    return row;
+}
+
+static void pkt_list_model_iface_init(GListModelInterface* iface) {
+    iface->get_item_type = pkt_list_model_get_item_type;
+    iface->get_n_items = pkt_list_model_get_n_items;
+    iface->get_item = pkt_list_model_get_item;
+}
+
+G_DEFINE_TYPE_WITH_CODE(PktListModel, pkt_list_model, G_TYPE_OBJECT,
+                        G_IMPLEMENT_INTERFACE(G_TYPE_LIST_MODEL, pkt_list_model_iface_init))
+
+static void pkt_list_model_class_init(PktListModelClass* klass) {
+    (void)klass;
+}
+
+static void pkt_list_model_init(PktListModel* m) {
+    m->store = NULL;
+    m->n_items = 0;
+}
+
+PktListModel* pkt_list_model_new(PktStore* store) {
+    PktListModel* m = g_object_new(PKT_TYPE_LIST_MODEL, NULL);
+    m->store = store;
+    return m;
+}
+
+guint pkt_list_model_sync(PktListModel* m) {
+    if (!m) return 0;
+    guint n = pkt_store_count(m->store);
+    if (n <= m->n_items) return 0;
+    guint old = m->n_items;
+    m->n_items = n;
+    g_list_model_items_changed(G_LIST_MODEL(m), old, 0, n - old);
+    return n - old;
+}
+
+void pkt_list_model_reset(PktListModel* m) {
+    if (!m) return;
+    guint old = m->n_items;
+    m->n_items = pkt_store_count(m->store);
+    if (old || m->n_items) g_list_model_items_changed(G_LIST_MODEL(m), 0, old, m->n_items);
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <gio/gio.h>
+#include "pkt_store.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// GListModel view over a PktStore for GtkListView. Items are lightweight
+// PktRow objects carrying only the record index; they are created on demand
+// for the rows the view asks for, so the model costs nothing per packet.
+
+#define PKT_TYPE_ROW (pkt_row_get_type())
+G_DECLARE_FINAL_TYPE(PktRow, pkt_row, PKT, ROW, GObject)
+
+guint pkt_row_index(PktRow* row);
+
+#define PKT_TYPE_LIST_MODEL (pkt_list_model_get_type())
+G_DECLARE_FINAL_TYPE(PktListModel, pkt_list_model, PKT, LIST_MODEL, GObject)
+
+// store is borrowed and must outlive the model
+PktListModel* pkt_list_model_new(PktStore* store);
+
+// expose records appended to the store since the last sync (one items-changed)
+// returns the number of new rows
+guint pkt_list_model_sync(PktListModel* m);
+
+// call after pkt_store_clear()
+void pkt_list_model_reset(PktListModel* m);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,164 @@
+#include "pkt_ring.h"
+#include <string.h>
+
+// frame interval used to batch UI updates
+#define PKT_RING_FRAME_US 16667
+
+struct PktRing {
+    PktDesc* slots;
+    guint mask;
+
+    // producer-owned cache line
+    gint tail;                  // published write index
+    guint tail_local;           // reserved but not yet published
+    guint head_cache;           // last head seen by the producer
+    gint overflows;
+    char pad0[64];
+
+    // consumer-owned cache line
+    gint head;                  // read index
+    guint tail_cache;           // last tail seen by the consumer
+    gint consumer_waiting;      // set by the GSource before it sleeps
+    char pad1[64];
+
+    GMainContext* ctx;          // woken when the first packet lands in an idle ring
+};
+
+PktRing* pkt_ring_new(guint capacity) {
+    guint cap = 16;
+    while (cap < capacity) cap <<= 1;
+    PktRing* r = g_new0(PktRing, 1);
+    r->slots = g_new(PktDesc, cap);
+    r->mask = cap - 1;
+    return r;
+}
+
+void pkt_ring_free(PktRing* r) {
+    if (!r) return;
+    g_free(r->slots);
+    g_free(r);
+}
+
+PktDesc* pkt_ring_reserve(PktRing* r) {
+    guint tail = r->tail_local;
+    if (tail - r->head_cache > r->mask) {
+        r->head_cache = (guint)g_atomic_int_get(&r->head);
+        if (tail - r->head_cache > r->mask) {
+            g_atomic_int_inc(&r->overflows);
+            return NULL;
+        }
+    }
+    r->tail_local = tail + 1;
+    return &r->slots[tail & r->mask];
+}
+
+void pkt_ring_publish(PktRing* r) {
+    if ((guint)r->tail == r->tail_local) return;
+    g_atomic_int_set(&r->tail, (gint)r->tail_local);
+    if (g_atomic_int_get(&r->consumer_waiting) &&
+        g_atomic_int_compare_and_exchange(&r->consumer_waiting, 1, 0) && r->ctx) {
+        g_main_context_wakeup(r->ctx);
+    }
+}
+
+const PktDesc* pkt_ring_peek(PktRing* r) {
+    guint head = (guint)r->head;
+    if (head == r->tail_cache) {
+        r->tail_cache = (guint)g_atomic_int_get(&r->tail);
+        if (head == r->tail_cache) return NULL;
+    }
+    return &r->slots[head & r->mask];
+}
+
+void pkt_ring_release(PktRing* r) {
+    g_atomic_int_set(&r->head, (gint)((guint)r->head + 1));
+}
+
+guint pkt_ring_overflows(PktRing* r) {
+    return r ? (guint)g_atomic_int_get(&r->overflows) : 0;
+}
+
+// ---------------------------------------------------------------------------
+// GSource: drains the ring at most once per frame
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    GSource base;
+    PktRing* ring;
+    guint max_per_frame;
+    pkt_ring_drain_fn drain;
+    pkt_ring_overflow_fn overflow;
+    void* user;
+    gint64 last_dispatch;
+    guint overflows_seen;
+} PktRingSource;
+
+static gboolean ring_has_work(PktRingSource* s) {
+    return pkt_ring_peek(s->ring) != NULL || pkt_ring_overflows(s->ring) != s->overflows_seen;
+}
+
+static gboolean ring_source_prepare(GSource* source, gint* timeout) {
+    PktRingSource* s = (PktRingSource*)source;
+    *timeout = -1;
+    if (!ring_has_work(s)) {
+        // ask the producer to wake us, then re-check to close the race
+        g_atomic_int_set(&s->ring->consumer_waiting, 1);
+        if (!ring_has_work(s)) return FALSE;
+        g_atomic_int_set(&s->ring->consumer_waiting, 0);
+    }
+    gint64 due = s->last_dispatch + PKT_RING_FRAME_US;
+    gint64 now = g_source_get_time(source);
+    if (now >= due) return TRUE;
+    *timeout = (gint)((due - now + 999) / 1000);
+    return FALSE;
+}
+
+static gboolean ring_source_check(GSource* source) {
+    PktRingSource* s = (PktRingSource*)source;
+    return ring_has_work(s) && g_source_get_time(source) >= s->last_dispatch + PKT_RING_FRAME_US;
+}
+
+static gboolean ring_source_dispatch(GSource* source, GSourceFunc callback, gpointer user_data) {
+    (void)callback;
+    (void)user_data;
+    PktRingSource* s = (PktRingSource*)source;
+    s->last_dispatch = g_source_get_time(source);
+
+    guint n = 0;
+    const PktDesc* pkt;
+    while (n < s->max_per_frame && (pkt = pkt_ring_peek(s->ring)) != NULL) {
+        if (s->drain) s->drain(s->user, pkt);
+        pkt_ring_release(s->ring);
+        ++n;
+    }
+
+    guint ov = pkt_ring_overflows(s->ring);
+    if (ov != s->overflows_seen) {
+        guint dropped = ov - s->overflows_seen;
+        s->overflows_seen = ov;
+        if (s->overflow) s->overflow(s->user, dropped);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static GSourceFuncs ring_source_funcs = {
+    ring_source_prepare,
+    ring_source_check,
+    ring_source_dispatch,
+    NULL, NULL, NULL
+};
+
+GSource* pkt_ring_source_new(PktRing* r, guint max_per_frame,
+                             pkt_ring_drain_fn drain, pkt_ring_overflow_fn overflow, void* user) {
+    GSource* source = g_source_new(&ring_source_funcs, sizeof(PktRingSource));
+    PktRingSource* s = (PktRingSource*)source;
+    s->ring = r;
+    s->max_per_frame = max_per_frame ? max_per_frame : G_MAXUINT;
+    s->drain = drain;
+    s->overflow = overflow;
+    s->user = user;
+    s->overflows_seen = pkt_ring_overflows(r);
+    g_source_set_name(source, "pkt-ring");
+    r->ctx = g_main_context_default();
+    return source;
+}
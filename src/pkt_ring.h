@@ -0,0 +1,53 @@
+#pragma once
+#include <glib.h>
+#include <stdint.h>
+#include "udp_io.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bounded lock-free single-producer/single-consumer ring of received
+// datagrams. The receive thread fills slots without ever blocking (a full
+// ring drops and counts), the main loop drains it once per frame through
+// one GSource.
+
+#define PKT_RING_SLOT 2048
+
+typedef struct {
+    gint64 ts_us;           // g_get_real_time() at receive
+    UdpPeer from;
+    uint32_t len;           // bytes stored in data (<= PKT_RING_SLOT)
+    uint32_t truncated;     // datagram was larger than the receive buffer
+    uint8_t data[PKT_RING_SLOT];
+} PktDesc;
+
+typedef struct PktRing PktRing;
+
+// capacity is rounded up to a power of two
+PktRing* pkt_ring_new(guint capacity);
+void pkt_ring_free(PktRing* r);
+
+// producer side (receive thread): reserve a slot, fill it, then publish
+// everything reserved so far in one go. reserve returns NULL when full.
+PktDesc* pkt_ring_reserve(PktRing* r);
+void pkt_ring_publish(PktRing* r);
+
+// consumer side (main loop)
+const PktDesc* pkt_ring_peek(PktRing* r);
+void pkt_ring_release(PktRing* r);
+
+// datagrams dropped because the ring was full (any thread; wraps at 2^32)
+guint pkt_ring_overflows(PktRing* r);
+
+// main-loop side: called for each packet, at most max_per_frame per frame
+typedef void (*pkt_ring_drain_fn)(void* user, const PktDesc* pkt);
+// called once per frame when new overflows were counted since the last frame
+typedef void (*pkt_ring_overflow_fn)(void* user, guint dropped_since_last);
+
+GSource* pkt_ring_source_new(PktRing* r, guint max_per_frame,
+                             pkt_ring_drain_fn drain, pkt_ring_overflow_fn overflow, void* user);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,99 @@
+#include "pkt_store.h"
+#include <string.h>
+
+struct PktStore {
+    PktRecord** pages;
+    guint npages;
+    guint count;
+
+    uint8_t** chunks;
+    guint nchunks;
+    guint32 chunk_used;     // bytes used in the last chunk
+    guint64 bytes;
+
+    guint64 dropped;
+};
+
+PktStore* pkt_store_new(void) {
+    return g_new0(PktStore, 1);
+}
+
+void pkt_store_free(PktStore* s) {
+    if (!s) return;
+    pkt_store_clear(s);
+    g_free(s);
+}
+
+static uint8_t* arena_alloc(PktStore* s, size_t len, guint32* chunk, guint32* off) {
+    if (s->nchunks == 0 || s->chunk_used + len > PKT_STORE_CHUNK) {
+        if ((guint64)(s->nchunks + 1) * PKT_STORE_CHUNK > PKT_STORE_MAX_BYTES) return NULL;
+        s->chunks = g_renew(uint8_t*, s->chunks, s->nchunks + 1);
+        s->chunks[s->nchunks++] = g_malloc(PKT_STORE_CHUNK);
+        s->chunk_used = 0;
+    }
+    *chunk = s->nchunks - 1;
+    *off = s->chunk_used;
+    s->chunk_used += (guint32)len;
+    s->bytes += len;
+    return s->chunks[*chunk] + *off;
+}
+
+gboolean pkt_store_append(PktStore* s, const uint8_t* data, size_t len,
+                          const UdpPeer* from, gint64 ts_us) {
+    if (!s || !data) return FALSE;
+    if (len > G_MAXUINT16) len = G_MAXUINT16;
+    if (s->count >= PKT_STORE_MAX_RECORDS) {
+        s->dropped++;
+        return FALSE;
+    }
+
+    guint32 chunk = 0, off = 0;
+    uint8_t* dst = arena_alloc(s, len, &chunk, &off);
+    if (!dst) {
+        s->dropped++;
+        return FALSE;
+    }
+    memcpy(dst, data, len);
+
+    guint page = s->count / PKT_STORE_PAGE;
+    if (page == s->npages) {
+        s->pages = g_renew(PktRecord*, s->pages, s->npages + 1);
+        s->pages[s->npages++] = g_new(PktRecord, PKT_STORE_PAGE);
+    }
+    PktRecord* r = &s->pages[page][s->count % PKT_STORE_PAGE];
+    r->ts_us = ts_us;
+    r->addr = from ? from->addr : 0;
+    r->port = from ? from->port : 0;
+    r->len = (uint16_t)len;
+    r->chunk = chunk;
+    r->off = off;
+    s->count++;
+    return TRUE;
+}
+
+guint pkt_store_count(const PktStore* s) {
+    return s ? s->count : 0;
+}
+
+const PktRecord* pkt_store_get(const PktStore* s, guint idx) {
+    if (!s || idx >= s->count) return NULL;
+    return &s->pages[idx / PKT_STORE_PAGE][idx % PKT_STORE_PAGE];
+}
+
+const uint8_t* pkt_store_data(const PktStore* s, const PktRecord* rec) {
+    if (!s || !rec || rec->chunk >= s->nchunks) return NULL;
+    return s->chunks[rec->chunk] + rec->off;
+}
+
+guint64 pkt_store_dropped(const PktStore* s) {
+    return s ? s->dropped : 0;
+}
+
+void pkt_store_clear(PktStore* s) {
+    if (!s) return;
+    for (guint i = 0; i < s->npages; ++i) g_free(s->pages[i]);
+    for (guint i = 0; i < s->nchunks; ++i) g_free(s->chunks[i]);
+    g_free(s->pages);
+    g_free(s->chunks);
+    memset(s, 0, sizeof(*s));
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <glib.h>
+#include <stdint.h>
+#include "backend_api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Append-only store of captured datagrams for the packet view. Each packet
+// costs one 24-byte record plus its payload in a chunked byte arena; nothing
+// is formatted until a row is actually shown. Records live in fixed pages so
+// growth never moves existing data. Main-loop only.
+
+#define PKT_STORE_PAGE        65536u            // records per page
+#define PKT_STORE_CHUNK       (4u << 20)        // arena chunk size
+#define PKT_STORE_MAX_RECORDS (16u << 20)
+#define PKT_STORE_MAX_BYTES   ((guint64)1 << 30)
+
+typedef struct {
+    gint64   ts_us;         // wall clock at receive
+    uint32_t addr;          // peer, network byte order
+    uint16_t port;
+    uint16_t len;           // payload bytes (datagrams are <= 64K)
+    uint32_t chunk;         // arena chunk holding the payload
+    uint32_t off;           // offset inside that chunk
+} PktRecord;
+
+typedef struct PktStore PktStore;
+
+PktStore* pkt_store_new(void);
+void pkt_store_free(PktStore* s);
+
+// copies the payload; returns FALSE (and counts a drop) once a cap is reached
+gboolean pkt_store_append(PktStore* s, const uint8_t* data, size_t len,
+                          const UdpPeer* from, gint64 ts_us);
+
+guint pkt_store_count(const PktStore* s);
+const PktRecord* pkt_store_get(const PktStore* s, guint idx);
+const uint8_t* pkt_store_data(const PktStore* s, const PktRecord* rec);
+
+// packets refused because the store was full, since the last clear
+guint64 pkt_store_dropped(const PktStore* s);
+
+void pkt_store_clear(PktStore* s);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,158 @@
+#include "rng.h"
+#include <glib.h>
+#include <string.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define RNG_AVX2 1      // compiled for AVX2 whatever the build targets, used when the CPU has it
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RNG_SSE2 1
+#endif
+
+#define RNG_BLOCK (8 * RNG_LANES)   // bytes per step of all lanes
+
+static uint64_t splitmix64(uint64_t* x) {
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+void rng_seed(Rng* r, uint64_t seed) {
+    uint64_t x = seed;
+    for (int k = 0; k < 4; ++k) r->s[k] = splitmix64(&x);
+    for (int i = 0; i < RNG_LANES; ++i) {
+        for (int k = 0; k < 4; ++k) r->lane[k][i] = splitmix64(&x);
+    }
+}
+
+uint64_t rng_below(Rng* r, uint64_t bound) {
+    if (bound == 0) return rng_next(r);
+    // reject the low values that would make the modulo uneven
+    uint64_t floor = (0 - bound) % bound;
+    uint64_t x;
+    do x = rng_next(r); while (x < floor);
+    return x % bound;
+}
+
+// one xoshiro256++ step of every lane per RNG_BLOCK bytes; block i holds
+// the 64-bit outputs of lanes 0..RNG_LANES-1 in order, little-endian
+typedef void (*RngFillFn)(Rng* r, uint8_t* dst, size_t nblocks);
+
+#if defined(RNG_AVX2)
+
+__attribute__((target("avx2")))
+static inline __m256i rotl256(__m256i x, int k) {
+    return _mm256_or_si256(_mm256_slli_epi64(x, k), _mm256_srli_epi64(x, 64 - k));
+}
+
+__attribute__((target("avx2")))
+static void fill_blocks_avx2(Rng* r, uint8_t* dst, size_t nblocks) {
+    __m256i s0 = _mm256_loadu_si256((const __m256i*)(const void*)r->lane[0]);
+    __m256i s1 = _mm256_loadu_si256((const __m256i*)(const void*)r->lane[1]);
+    __m256i s2 = _mm256_loadu_si256((const __m256i*)(const void*)r->lane[2]);
+    __m256i s3 = _mm256_loadu_si256((const __m256i*)(const void*)r->lane[3]);
+    for (size_t b = 0; b < nblocks; ++b) {
+        __m256i out = _mm256_add_epi64(rotl256(_mm256_add_epi64(s0, s3), 23), s0);
+        _mm256_storeu_si256((__m256i*)(void*)(dst + b * RNG_BLOCK), out);
+        __m256i t = _mm256_slli_epi64(s1, 17);
+        s2 = _mm256_xor_si256(s2, s0);
+        s3 = _mm256_xor_si256(s3, s1);
+        s1 = _mm256_xor_si256(s1, s2);
+        s0 = _mm256_xor_si256(s0, s3);
+        s2 = _mm256_xor_si256(s2, t);
+        s3 = rotl256(s3, 45);
+    }
+    _mm256_storeu_si256((__m256i*)(void*)r->lane[0], s0);
+    _mm256_storeu_si256((__m256i*)(void*)r->lane[1], s1);
+    _mm256_storeu_si256((__m256i*)(void*)r->lane[2], s2);
+    _mm256_storeu_si256((__m256i*)(void*)r->lane[3], s3);
+}
+
+#endif
+
+#if defined(RNG_SSE2)
+
+static inline __m128i rotl128(__m128i x, int k) {
+    return _mm_or_si128(_mm_slli_epi64(x, k), _mm_srli_epi64(x, 64 - k));
+}
+
+// lanes 0-1 and 2-3 in two registers each
+static void fill_blocks_base(Rng* r, uint8_t* dst, size_t nblocks) {
+    __m128i s[4][2];
+    for (int k = 0; k < 4; ++k) {
+        s[k][0] = _mm_loadu_si128((const __m128i*)(const void*)&r->lane[k][0]);
+        s[k][1] = _mm_loadu_si128((const __m128i*)(const void*)&r->lane[k][2]);
+    }
+    for (size_t b = 0; b < nblocks; ++b) {
+        for (int h = 0; h < 2; ++h) {
+            __m128i out = _mm_add_epi64(rotl128(_mm_add_epi64(s[0][h], s[3][h]), 23), s[0][h]);
+            _mm_storeu_si128((__m128i*)(void*)(dst + b * RNG_BLOCK + h * 16), out);
+            __m128i t = _mm_slli_epi64(s[1][h], 17);
+            s[2][h] = _mm_xor_si128(s[2][h], s[0][h]);
+            s[3][h] = _mm_xor_si128(s[3][h], s[1][h]);
+            s[1][h] = _mm_xor_si128(s[1][h], s[2][h]);
+            s[0][h] = _mm_xor_si128(s[0][h], s[3][h]);
+            s[2][h] = _mm_xor_si128(s[2][h], t);
+            s[3][h] = rotl128(s[3][h], 45);
+        }
+    }
+    for (int k = 0; k < 4; ++k) {
+        _mm_storeu_si128((__m128i*)(void*)&r->lane[k][0], s[k][0]);
+        _mm_storeu_si128((__m128i*)(void*)&r->lane[k][2], s[k][1]);
+    }
+}
+
+#else
+
+static void fill_blocks_base(Rng* r, uint8_t* dst, size_t nblocks) {
+    for (size_t b = 0; b < nblocks; ++b) {
+        for (int i = 0; i < RNG_LANES; ++i) {
+            uint64_t s0 = r->lane[0][i], s1 = r->lane[1][i], s2 = r->lane[2][i], s3 = r->lane[3][i];
+            uint64_t out = rng_rotl(s0 + s3, 23) + s0;
+            uint8_t* p = dst + b * RNG_BLOCK + (size_t)i * 8;
+            for (int j = 0; j < 8; ++j) p[j] = (uint8_t)(out >> (8 * j));
+            uint64_t t = s1 << 17;
+            s2 ^= s0;
+            s3 ^= s1;
+            s1 ^= s2;
+            s0 ^= s3;
+            s2 ^= t;
+            r->lane[0][i] = s0;
+            r->lane[1][i] = s1;
+            r->lane[2][i] = s2;
+            r->lane[3][i] = rng_rotl(s3, 45);
+        }
+    }
+}
+
+#endif
+
+// the widest variant this CPU runs; all of them give the same bytes
+static RngFillFn fill_pick(void) {
+    static gsize ready = 0;
+    static RngFillFn fn;
+    if (g_once_init_enter(&ready)) {
+        fn = fill_blocks_base;
+#if defined(RNG_AVX2)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) fn = fill_blocks_avx2;
+#endif
+        g_once_init_leave(&ready, 1);
+    }
+    return fn;
+}
+
+void rng_fill(Rng* r, uint8_t* dst, size_t n) {
+    RngFillFn fill_blocks = fill_pick();
+    size_t full = n / RNG_BLOCK;
+    fill_blocks(r, dst, full);
+    size_t rest = n % RNG_BLOCK;
+    if (rest) {
+        // the unused tail of the last block is dropped, on every path alike
+        uint8_t tail[RNG_BLOCK];
+        fill_blocks(r, tail, 1);
+        memcpy(dst + full * RNG_BLOCK, tail, rest);
+    }
+}
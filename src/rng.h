@@ -0,0 +1,51 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Seedable xoshiro256++ generator for the script's random builtins.
+// rng_next() serves single draws; rng_fill() runs RNG_LANES independent
+// streams side by side so bulk payloads vectorize (AVX2 when the CPU has it,
+// picked at run time; SSE2 otherwise on x86, plain C elsewhere). Every path
+// gives the same bytes for the same seed, so a seeded load test replays exactly.
+// Not for cryptographic use.
+
+#define RNG_LANES 4
+
+typedef struct {
+    uint64_t s[4];                  // rng_next
+    uint64_t lane[4][RNG_LANES];    // rng_fill; lane[k][i] is word k of stream i
+} Rng;
+
+// all state derives from seed via splitmix64; any value is fine, 0 included
+void rng_seed(Rng* r, uint64_t seed);
+
+static inline uint64_t rng_rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t rng_next(Rng* r) {
+    uint64_t* s = r->s;
+    uint64_t out = rng_rotl(s[0] + s[3], 23) + s[0];
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rng_rotl(s[3], 45);
+    return out;
+}
+
+// uniform in [0, bound); bound 0 means the full 64-bit range
+uint64_t rng_below(Rng* r, uint64_t bound);
+
+// n random bytes from the lane streams
+void rng_fill(Rng* r, uint8_t* dst, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,277 @@
+#include "rtt_probe.h"
+#include "pcapng_writer.h"
+#include "event_log.h"
+#include "mono_clock.h"
+#include <string.h>
+#include <errno.h>
+
+static const uint8_t probe_magic[4] = { 'N', 'A', 'P', 'R' };
+
+// largest IPv4 UDP payload
+#define PROBE_MAX_SIZE 65507
+// probes in flight that can still be matched; older replies count as stale
+#define PROBE_SLOTS 65536
+// how long a finished run waits for its last replies
+#define PROBE_DRAIN_NS 1000000000
+// sleep instead of spinning when the next probe is further away than this
+#define PROBE_SPIN_NS 200000
+
+// HDR-style histogram: values below 2*HIST_SUB ns are exact, above that every
+// power of two is split into HIST_SUB buckets (relative error < 1/HIST_SUB)
+#define HIST_SUB_BITS 7
+#define HIST_SUB (1u << HIST_SUB_BITS)
+#define HIST_MAX_SHIFT 33u
+#define HIST_BUCKETS (HIST_SUB * (HIST_MAX_SHIFT + 2))
+
+#define SLOT_SENT    1u
+#define SLOT_REPLIED 2u
+
+typedef struct {
+    guint64 seq;
+    gint64 user_ns;         // CLOCK_REALTIME just before the send
+    RttStamp tx;
+    guint state;
+} ProbeSlot;
+
+struct RttProbe {
+    gint active;            // read by the receive threads without the lock
+
+    GMutex lock;            // everything below
+    guint32 run;
+    gboolean keys_valid;    // kernel tx stamp keys still line up with sequence numbers
+    ProbeSlot* slots;
+    ProbeStats st;          // counters; percentiles are filled in by rtt_probe_stats
+    gint64 sum_ns;
+    guint64 samples;
+    guint64 hist[HIST_BUCKETS];
+};
+
+static inline void wr32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24); p[1] = (uint8_t)(v >> 16); p[2] = (uint8_t)(v >> 8); p[3] = (uint8_t)v;
+}
+
+static inline void wr64(uint8_t* p, uint64_t v) {
+    wr32(p, (uint32_t)(v >> 32));
+    wr32(p + 4, (uint32_t)v);
+}
+
+static inline uint32_t rd32(const uint8_t* p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static inline uint64_t rd64(const uint8_t* p) {
+    return (uint64_t)rd32(p) << 32 | rd32(p + 4);
+}
+
+// --- histogram -------------------------------------------------------------------
+
+static guint hist_index(gint64 v) {
+    guint64 u = v > 0 ? (guint64)v : 0;
+    if (u < 2 * HIST_SUB) return (guint)u;
+    guint shift = 1;
+    while ((u >> shift) >= 2 * HIST_SUB) shift++;
+    if (shift > HIST_MAX_SHIFT) return HIST_BUCKETS - 1;
+    return HIST_SUB * shift + (guint)(u >> shift);
+}
+
+// largest value that lands in bucket i
+static gint64 hist_value(guint i) {
+    if (i < 2 * HIST_SUB) return (gint64)i;
+    guint shift = i / HIST_SUB - 1;
+    guint64 top = i - HIST_SUB * shift;
+    return (gint64)(((top + 1) << shift) - 1);
+}
+
+static gint64 hist_percentile(const RttProbe* p, double q) {
+    if (p->samples == 0) return 0;
+    // smallest value with at least q of the samples at or below it
+    double exact = q * (double)p->samples;
+    guint64 want = (guint64)exact;
+    if ((double)want < exact || want == 0) want++;
+    guint64 seen = 0;
+    for (guint i = 0; i < HIST_BUCKETS; ++i) {
+        seen += p->hist[i];
+        if (seen >= want) return MIN(hist_value(i), p->st.max_ns);
+    }
+    return p->st.max_ns;
+}
+
+static void hist_add(RttProbe* p, gint64 rtt) {
+    if (rtt < 0) rtt = 0;
+    p->hist[hist_index(rtt)]++;
+    if (p->samples == 0 || rtt < p->st.min_ns) p->st.min_ns = rtt;
+    if (rtt > p->st.max_ns) p->st.max_ns = rtt;
+    p->sum_ns += rtt;
+    p->samples++;
+}
+
+// --- probe -----------------------------------------------------------------------
+
+RttProbe* rtt_probe_new(void) {
+    RttProbe* p = g_new0(RttProbe, 1);
+    g_mutex_init(&p->lock);
+    // start from the clock so a restarted tool ignores echoes of its previous life
+    p->run = (guint32)g_get_real_time();
+    return p;
+}
+
+void rtt_probe_free(RttProbe* p) {
+    if (!p) return;
+    g_free(p->slots);
+    g_mutex_clear(&p->lock);
+    g_free(p);
+}
+
+gboolean rtt_probe_active(RttProbe* p) {
+    return p && g_atomic_int_get(&p->active);
+}
+
+gboolean rtt_probe_is_reply(const uint8_t* data, size_t len) {
+    return len >= RTT_PROBE_HDR && memcmp(data, probe_magic, sizeof(probe_magic)) == 0;
+}
+
+void rtt_probe_on_reply(RttProbe* p, const uint8_t* data, size_t len, const RttStamp* rx, int64_t user_ns) {
+    if (!p || !rtt_probe_is_reply(data, len)) return;
+    guint32 run = rd32(data + 4);
+    guint64 seq = rd64(data + 8);
+
+    g_mutex_lock(&p->lock);
+    ProbeSlot* s = p->slots ? &p->slots[seq % PROBE_SLOTS] : NULL;
+    if (run != p->run || !s || !(s->state & SLOT_SENT) || s->seq != seq) {
+        p->st.stale++;
+    } else if (s->state & SLOT_REPLIED) {
+        p->st.duplicates++;
+    } else {
+        s->state |= SLOT_REPLIED;
+        p->st.received++;
+        // best clock pair available on both ends; the receive side falls
+        // back to the kernel software stamp even when the send side cannot
+        ProbeTsSource src;
+        gint64 rtt;
+        if (s->tx.hw_ns && rx && rx->hw_ns) {
+            src = PROBE_TS_HARDWARE;
+            rtt = rx->hw_ns - s->tx.hw_ns;
+        } else if (s->tx.sw_ns && rx && rx->sw_ns) {
+            src = PROBE_TS_SOFTWARE;
+            rtt = rx->sw_ns - s->tx.sw_ns;
+        } else {
+            src = PROBE_TS_USER;
+            rtt = (rx && rx->sw_ns ? rx->sw_ns : user_ns) - s->user_ns;
+        }
+        p->st.by_source[src]++;
+        hist_add(p, rtt);
+    }
+    g_mutex_unlock(&p->lock);
+}
+
+void rtt_probe_on_tx_stamp(RttProbe* p, uint32_t key, const RttStamp* tx) {
+    if (!p || !tx) return;
+    g_mutex_lock(&p->lock);
+    // keys count probes from 0 per run, modulo 2^32
+    ProbeSlot* s = p->slots && p->keys_valid ? &p->slots[key % PROBE_SLOTS] : NULL;
+    if (s && (s->state & SLOT_SENT) && (guint32)s->seq == key) {
+        if (tx->sw_ns) s->tx.sw_ns = tx->sw_ns;
+        if (tx->hw_ns) s->tx.hw_ns = tx->hw_ns;
+    }
+    g_mutex_unlock(&p->lock);
+}
+
+static void run_reset(RttProbe* p) {
+    g_mutex_lock(&p->lock);
+    if (!p->slots) p->slots = g_new(ProbeSlot, PROBE_SLOTS);
+    memset(p->slots, 0, sizeof(ProbeSlot) * PROBE_SLOTS);
+    memset(&p->st, 0, sizeof(p->st));
+    memset(p->hist, 0, sizeof(p->hist));
+    p->sum_ns = 0;
+    p->samples = 0;
+    p->run++;
+    p->keys_valid = TRUE;
+    p->st.running = 1;
+    g_mutex_unlock(&p->lock);
+}
+
+gboolean rtt_probe_run(RttProbe* p, UdpIo* io, const ProbeConfig* cfg, const gint* cancel, int* send_errno) {
+    if (send_errno) *send_errno = 0;
+    if (!p || !io || !cfg) return FALSE;
+    guint rate = cfg->rate ? cfg->rate : 100;
+    size_t size = CLAMP((size_t)cfg->size, (size_t)RTT_PROBE_HDR, (size_t)PROBE_MAX_SIZE);
+
+    run_reset(p);
+    uint8_t* buf = g_malloc0(size);
+    memcpy(buf, probe_magic, sizeof(probe_magic));
+    wr32(buf + 4, p->run);
+
+    // (re)enabling restarts the kernel's tx stamp keys at 0, in step with seq
+    gboolean kernel_ts = udp_io_timestamping(io, TRUE);
+    EVLOG("[PROBE] %u probes/s, %zu bytes each, %s timestamps", rate, size,
+          EV_STR(kernel_ts ? "kernel" : "user-space"));
+    g_atomic_int_set(&p->active, 1);
+
+    gint64 interval = 1000000000 / (gint64)rate;
+    gint64 start = mono_clock_ns();
+    int err = 0;
+    for (guint64 seq = 0; cfg->count == 0 || seq < cfg->count; ++seq) {
+        if (!mono_clock_wait_until(start + (gint64)seq * interval, PROBE_SPIN_NS, cancel)) break;
+        gint64 now = pcapng_now_ns();
+        g_mutex_lock(&p->lock);
+        ProbeSlot* s = &p->slots[seq % PROBE_SLOTS];
+        memset(s, 0, sizeof(*s));
+        s->seq = seq;
+        s->user_ns = now;
+        s->state = SLOT_SENT;
+        p->st.sent++;
+        g_mutex_unlock(&p->lock);
+
+        wr64(buf + 8, seq);
+        wr64(buf + 16, (guint64)now);
+        while ((err = udp_io_send_probe(io, buf, size)) == EAGAIN || err == ENOBUFS || err == EINTR) {
+            // a retried send may or may not have consumed a stamp key
+            g_mutex_lock(&p->lock);
+            p->keys_valid = FALSE;
+            g_mutex_unlock(&p->lock);
+            g_usleep(100);
+        }
+        if (err) {
+            g_mutex_lock(&p->lock);
+            s->state = 0;
+            p->st.sent--;
+            g_mutex_unlock(&p->lock);
+            break;
+        }
+    }
+
+    // give the last probes a chance to come back
+    gint64 deadline = mono_clock_ns() + PROBE_DRAIN_NS;
+    while (!err && mono_clock_ns() < deadline && !(cancel && g_atomic_int_get(cancel))) {
+        g_mutex_lock(&p->lock);
+        gboolean done = p->st.received >= p->st.sent;
+        g_mutex_unlock(&p->lock);
+        if (done) break;
+        g_usleep(10000);
+    }
+
+    g_atomic_int_set(&p->active, 0);
+    udp_io_timestamping(io, FALSE);
+    g_mutex_lock(&p->lock);
+    p->st.running = 0;
+    g_mutex_unlock(&p->lock);
+    g_free(buf);
+    if (send_errno) *send_errno = err;
+    return err == 0;
+}
+
+void rtt_probe_stats(RttProbe* p, ProbeStats* out) {
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    if (!p) return;
+    g_mutex_lock(&p->lock);
+    *out = p->st;
+    if (p->samples) {
+        out->mean_ns = p->sum_ns / (gint64)p->samples;
+        out->p50_ns = hist_percentile(p, 0.50);
+        out->p90_ns = hist_percentile(p, 0.90);
+        out->p99_ns = hist_percentile(p, 0.99);
+        out->p999_ns = hist_percentile(p, 0.999);
+    }
+    g_mutex_unlock(&p->lock);
+}
@@ -0,0 +1,42 @@
+#include "script_highlight.h"
+#include "script_lexer.h"
+
+void script_highlight_scan(const char* text, script_hl_fn fn, void* user) {
+    if (!text || !fn) return;
+    ScriptLexer lx;
+    script_lexer_init(&lx, text, TRUE);
+    for (;;) {
+        ScriptToken t;
+        script_lex_next(&lx, &t);
+        int kind = -1;
+        switch (t.kind) {
+        case SCRIPT_TK_EOF:
+            return;
+        case SCRIPT_TK_IDENT:
+            if (script_lex_is_keyword(t.start, t.len)) kind = SCRIPT_HL_KEYWORD;
+            break;
+        case SCRIPT_TK_INT:
+            kind = SCRIPT_HL_NUMBER;
+            break;
+        case SCRIPT_TK_STR:
+            kind = SCRIPT_HL_STRING;
+            break;
+        case SCRIPT_TK_PUNCT:
+            // separators stay plain
+            if (t.op[0] != ',' && t.op[0] != ';') kind = SCRIPT_HL_OPERATOR;
+            break;
+        case SCRIPT_TK_DIRECTIVE:
+            kind = SCRIPT_HL_DIRECTIVE;
+            break;
+        case SCRIPT_TK_COMMENT:
+            kind = SCRIPT_HL_COMMENT;
+            break;
+        default:
+            break;
+        }
+        if (kind >= 0) {
+            int start = (int)(t.start - text);
+            fn(user, (ScriptHlKind)kind, start, start + t.len);
+        }
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Syntax highlighting for the script DSL without any GTK: finds the spans the
+// editor tags (and the benchmark times) in one pass of the shared lexer
+// (script_lexer.h), so the colours follow exactly what the compiler reads.
+// Spans come out in text order, never overlap and never cross a line break.
+
+typedef enum {
+    SCRIPT_HL_KEYWORD = 0,
+    SCRIPT_HL_STRING,
+    SCRIPT_HL_COMMENT,
+    SCRIPT_HL_NUMBER,
+    SCRIPT_HL_DIRECTIVE,    // %define / %set / %include / #word lines
+    SCRIPT_HL_OPERATOR,
+    SCRIPT_HL_COUNT
+} ScriptHlKind;
+
+// one span [start, end), in bytes from the start of text
+typedef void (*script_hl_fn)(void* user, ScriptHlKind kind, int start, int end);
+
+// scan the NUL-terminated text and report every span
+void script_highlight_scan(const char* text, script_hl_fn fn, void* user);
+
+#ifdef __cplusplus
+}
+#endif
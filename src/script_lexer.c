@@ -0,0 +1,142 @@
+#include "script_lexer.h"
+#include <string.h>
+#include <stdlib.h>
+
+// character classes, one table lookup per byte
+enum {
+    CC_BLANK    = 1 << 0,   // space, tab, CR
+    CC_IDSTART  = 1 << 1,
+    CC_IDCHAR   = 1 << 2,   // letters, digits, '_' and '.'
+    CC_DIGIT    = 1 << 3,
+    CC_PUNCT    = 1 << 4,   // single-char operators and brackets
+};
+
+static uint8_t k_cc[256];
+
+static void cc_init(void) {
+    static gsize ready = 0;
+    if (!g_once_init_enter(&ready)) return;
+    k_cc[' '] = k_cc['\t'] = k_cc['\r'] = CC_BLANK;
+    for (int c = 0; c < 256; ++c) {
+        gboolean alpha = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+        gboolean digit = c >= '0' && c <= '9';
+        if (alpha) k_cc[c] |= CC_IDSTART | CC_IDCHAR;
+        if (digit) k_cc[c] |= CC_DIGIT | CC_IDCHAR;
+    }
+    k_cc['.'] |= CC_IDCHAR;
+    for (const char* p = "(){}+-*/%&|^<>=!,;"; *p; ++p) k_cc[(uint8_t)*p] |= CC_PUNCT;
+    g_once_init_leave(&ready, 1);
+}
+
+#define CC(ch, cls) (k_cc[(uint8_t)(ch)] & (cls))
+
+// the builtin names must match k_builtins in script_vm.c
+static const char* const k_keywords[] = {
+    "loop", "break", "continue", "if", "else", "return", "fn", "let", "var", "while", "for",
+    "sleep", "udp.send", "rand_int", "rand_bytes", "byte_at", "crc16", "printf", "len", "slice", "hex",
+    "rand_seed", "rand_pool", "crc32", "crc32c",
+};
+
+gboolean script_lex_is_keyword(const char* s, int len) {
+    for (size_t i = 0; i < G_N_ELEMENTS(k_keywords); ++i) {
+        if (strncmp(k_keywords[i], s, (size_t)len) == 0 && k_keywords[i][len] == '\0') return TRUE;
+    }
+    return FALSE;
+}
+
+void script_lexer_init(ScriptLexer* lx, const char* text, gboolean comments) {
+    cc_init();
+    memset(lx, 0, sizeof(*lx));
+    lx->p = text ? text : "";
+    lx->line = 1;
+    lx->bol = TRUE;
+    lx->comments = comments;
+}
+
+static const char* to_line_end(const char* p) {
+    while (*p && *p != '\n') ++p;
+    return p;
+}
+
+void script_lex_next(ScriptLexer* lx, ScriptToken* t) {
+    const char* p = lx->p;
+    memset(t, 0, sizeof(*t));
+    for (;;) {
+        while (CC(*p, CC_BLANK)) ++p;
+        if (p[0] == '/' && p[1] == '/') {
+            if (lx->comments) {
+                t->kind = SCRIPT_TK_COMMENT;
+                t->start = p;
+                t->line = lx->line;
+                p = to_line_end(p);
+                goto done;
+            }
+            p = to_line_end(p);
+            continue;
+        }
+        if (*p == '\n' && lx->paren > 0) {
+            ++lx->line;
+            ++p;
+            lx->bol = TRUE;
+            continue;
+        }
+        break;
+    }
+
+    t->start = p;
+    t->line = lx->line;
+    gboolean bol = lx->bol;
+    lx->bol = FALSE;
+
+    if (*p == '\0') {
+        t->kind = SCRIPT_TK_EOF;
+    } else if (*p == '\n') {
+        t->kind = SCRIPT_TK_NEWLINE;
+        ++lx->line;
+        ++p;
+        lx->bol = TRUE;
+    } else if (CC(*p, CC_IDSTART)) {
+        while (CC(*p, CC_IDCHAR)) ++p;
+        t->kind = SCRIPT_TK_IDENT;
+    } else if (CC(*p, CC_DIGIT)) {
+        char* end = NULL;
+        t->ival = (int64_t)strtoll(p, &end, 0);
+        p = end;
+        t->kind = SCRIPT_TK_INT;
+    } else if (*p == '"') {
+        ++p;
+        while (*p && *p != '"' && *p != '\n') {
+            if (*p == '\\' && p[1] && p[1] != '\n') ++p;
+            ++p;
+        }
+        if (*p != '"') {
+            t->kind = SCRIPT_TK_ERROR;
+        } else {
+            ++p;
+            t->kind = SCRIPT_TK_STR;
+        }
+    } else if (bol && lx->paren == 0 && (*p == '%' || *p == '#') && CC(p[1], CC_IDSTART)) {
+        t->kind = SCRIPT_TK_DIRECTIVE;
+        p = to_line_end(p);
+    } else if (CC(*p, CC_PUNCT)) {
+        static const char two[][3] = { "==", "!=", "<=", ">=", "&&", "||", "<<", ">>" };
+        t->kind = SCRIPT_TK_PUNCT;
+        for (size_t i = 0; i < G_N_ELEMENTS(two); ++i) {
+            if (p[0] == two[i][0] && p[1] == two[i][1]) {
+                t->op[0] = p[0];
+                t->op[1] = p[1];
+                p += 2;
+                goto done;
+            }
+        }
+        t->op[0] = *p++;
+        if (t->op[0] == '(') lx->paren++;
+        else if (t->op[0] == ')' && lx->paren > 0) lx->paren--;
+    } else {
+        t->kind = SCRIPT_TK_ERROR;
+        ++p;
+    }
+done:
+    t->len = (int)(p - t->start);
+    lx->p = p;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <glib.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Tokenizer for the script DSL, shared by the compiler (script_vm.c) and the
+// editor highlighting (script_highlight.c) so both read the text the same way.
+// One pass, no allocation: tokens point into the source text.
+
+typedef enum {
+    SCRIPT_TK_EOF = 0,
+    SCRIPT_TK_NEWLINE,
+    SCRIPT_TK_IDENT,        // may contain '.', e.g. udp.send
+    SCRIPT_TK_INT,          // decimal, 0x hex or 0 octal (strtoll base 0)
+    SCRIPT_TK_STR,          // including the quotes; ends at the line end
+    SCRIPT_TK_PUNCT,        // single/double char operator or bracket, see ScriptToken.op
+    SCRIPT_TK_DIRECTIVE,    // %word or #word first on a line, up to the line end
+    SCRIPT_TK_COMMENT,      // "//" to the line end; only with ScriptLexer.comments
+    SCRIPT_TK_ERROR         // unknown character or unterminated string
+} ScriptTokKind;
+
+typedef struct {
+    ScriptTokKind kind;
+    const char* start;
+    int len;
+    int line;               // 1-based
+    const char* file;       // source file; NULL for the top-level text (set by script_pp)
+    int64_t ival;           // SCRIPT_TK_INT
+    char op[3];             // SCRIPT_TK_PUNCT
+} ScriptToken;
+
+typedef struct {
+    const char* p;
+    int line;
+    int paren;              // newlines inside (...) are not statement terminators
+    gboolean bol;           // nothing but blanks since the last line break
+    gboolean comments;      // report comments instead of skipping them
+} ScriptLexer;
+
+void script_lexer_init(ScriptLexer* lx, const char* text, gboolean comments);
+void script_lex_next(ScriptLexer* lx, ScriptToken* t);
+
+// language keywords and builtin function names (highlighted alike)
+gboolean script_lex_is_keyword(const char* s, int len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,369 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L     // struct stat.st_mtim
+#endif
+#include "script_pp.h"
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define PP_MAX_INCLUDE_DEPTH   16
+#define PP_MAX_EXPANSION_DEPTH 32
+#define PP_MAX_TOKENS          (4 * 1024 * 1024)    // after expansion
+
+// ---------------------------------------------------------------------------
+// include cache
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    int refs;               // the cache and every ScriptPp whose tokens point into it
+    char* path;             // canonical; also the ScriptToken.file of its tokens
+    gint64 mtime_ns;
+    gint64 size;
+    char* text;
+    ScriptToken* toks;      // lexed once, without the final EOF
+    int ntoks;
+} IncludeFile;
+
+struct ScriptIncludeCache {
+    GHashTable* files;      // path -> IncludeFile
+};
+
+static void include_unref(gpointer data) {
+    IncludeFile* f = data;
+    if (!f || --f->refs > 0) return;
+    g_free(f->path);
+    g_free(f->text);
+    g_free(f->toks);
+    g_free(f);
+}
+
+ScriptIncludeCache* script_include_cache_new(void) {
+    ScriptIncludeCache* cache = g_new0(ScriptIncludeCache, 1);
+    cache->files = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, include_unref);
+    return cache;
+}
+
+void script_include_cache_free(ScriptIncludeCache* cache) {
+    if (!cache) return;
+    g_hash_table_destroy(cache->files);
+    g_free(cache);
+}
+
+static gint64 stat_mtime_ns(const GStatBuf* st) {
+#if defined(__linux__)
+    return (gint64)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+#else
+    return (gint64)st->st_mtime * 1000000000;
+#endif
+}
+
+static void lex_all(const char* text, const char* file, GArray* out) {
+    ScriptLexer lx;
+    script_lexer_init(&lx, text, FALSE);
+    for (;;) {
+        ScriptToken t;
+        script_lex_next(&lx, &t);
+        if (t.kind == SCRIPT_TK_EOF) break;
+        t.file = file;
+        g_array_append_val(out, t);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// preprocessor
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    ScriptToken* body;
+    int n;
+} Macro;
+
+static void macro_free(gpointer data) {
+    Macro* m = data;
+    g_free(m->body);
+    g_free(m);
+}
+
+struct ScriptPp {
+    GArray* out;                // ScriptToken
+    GHashTable* macros;         // name -> Macro
+    GPtrArray* held;            // IncludeFile the tokens point into
+    GPtrArray* texts;           // %set values the tokens point into
+    ScriptIncludeCache* cache;
+    gboolean own_cache;
+    script_pp_eval_fn eval;
+
+    const Macro* active[PP_MAX_EXPANSION_DEPTH];
+    int nactive;
+    const char* includes[PP_MAX_INCLUDE_DEPTH];
+    int nincludes;
+
+    char* err;
+    size_t err_len;
+    gboolean failed;
+};
+
+static void pp_error(ScriptPp* pp, const ScriptToken* at, const char* fmt, ...) G_GNUC_PRINTF(3, 4);
+static void pp_error(ScriptPp* pp, const ScriptToken* at, const char* fmt, ...) {
+    if (pp->failed) return;
+    pp->failed = TRUE;
+    if (!pp->err || pp->err_len == 0) return;
+    int n = at->file ? snprintf(pp->err, pp->err_len, "%s:%d: ", at->file, at->line)
+                     : snprintf(pp->err, pp->err_len, "line %d: ", at->line);
+    if (n < 0 || (size_t)n >= pp->err_len) return;
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(pp->err + n, pp->err_len - (size_t)n, fmt, ap);
+    va_end(ap);
+}
+
+static Macro* macro_find(ScriptPp* pp, const ScriptToken* t) {
+    if (g_hash_table_size(pp->macros) == 0) return NULL;
+    char buf[64];
+    if (t->len >= (int)sizeof(buf)) {
+        char* key = g_strndup(t->start, (gsize)t->len);
+        Macro* m = g_hash_table_lookup(pp->macros, key);
+        g_free(key);
+        return m;
+    }
+    memcpy(buf, t->start, (size_t)t->len);
+    buf[t->len] = '\0';
+    return g_hash_table_lookup(pp->macros, buf);
+}
+
+static void macro_define(ScriptPp* pp, const ScriptToken* name, const ScriptToken* body, int n) {
+    Macro* m = g_new0(Macro, 1);
+    m->body = n ? g_memdup2(body, sizeof(ScriptToken) * (gsize)n) : NULL;
+    m->n = n;
+    g_hash_table_replace(pp->macros, g_strndup(name->start, (gsize)name->len), m);
+}
+
+// append t to dst, replacing macros; loc is the use site
+static void pp_expand(ScriptPp* pp, const ScriptToken* t, const ScriptToken* loc, GArray* dst) {
+    if (pp->failed) return;
+    const Macro* m = t->kind == SCRIPT_TK_IDENT ? macro_find(pp, t) : NULL;
+    for (int i = 0; m && i < pp->nactive; ++i) {
+        // a macro does not expand inside its own expansion
+        if (pp->active[i] == m) m = NULL;
+    }
+    if (m) {
+        if (pp->nactive >= PP_MAX_EXPANSION_DEPTH) {
+            pp_error(pp, loc, "macros nested too deeply in '%.*s'", t->len, t->start);
+            return;
+        }
+        pp->active[pp->nactive++] = m;
+        for (int i = 0; i < m->n; ++i) pp_expand(pp, &m->body[i], loc, dst);
+        pp->nactive--;
+        return;
+    }
+    if (dst->len >= PP_MAX_TOKENS) {
+        pp_error(pp, loc, "script too large after macro expansion");
+        return;
+    }
+    ScriptToken o = *t;
+    o.line = loc->line;
+    o.file = loc->file;
+    g_array_append_val(dst, o);
+}
+
+static IncludeFile* include_load(ScriptPp* pp, const char* path, const ScriptToken* at) {
+    GStatBuf st;
+    if (g_stat(path, &st) != 0) {
+        pp_error(pp, at, "cannot open include '%s'", path);
+        return NULL;
+    }
+    IncludeFile* f = g_hash_table_lookup(pp->cache->files, path);
+    if (f && f->mtime_ns == stat_mtime_ns(&st) && f->size == (gint64)st.st_size) return f;
+
+    char* text = NULL;
+    GError* err = NULL;
+    if (!g_file_get_contents(path, &text, NULL, &err)) {
+        pp_error(pp, at, "%s", err->message);
+        g_clear_error(&err);
+        return NULL;
+    }
+    f = g_new0(IncludeFile, 1);
+    f->refs = 1;
+    f->path = g_strdup(path);
+    f->mtime_ns = stat_mtime_ns(&st);
+    f->size = (gint64)st.st_size;
+    f->text = text;
+    GArray* toks = g_array_new(FALSE, FALSE, sizeof(ScriptToken));
+    lex_all(f->text, f->path, toks);
+    f->ntoks = (int)toks->len;
+    f->toks = (ScriptToken*)(void*)g_array_free(toks, FALSE);
+    // an older version stays alive while a ScriptPp still points into it
+    g_hash_table_replace(pp->cache->files, f->path, f);
+    return f;
+}
+
+static void pp_tokens(ScriptPp* pp, const ScriptToken* toks, int n, const char* dir);
+
+static void pp_include(ScriptPp* pp, const ScriptToken* at, const ScriptToken* arg, const char* dir) {
+    if (!arg || arg->kind != SCRIPT_TK_STR || arg->len < 2) {
+        pp_error(pp, at, "%%include expects a quoted path");
+        return;
+    }
+    char* name = g_strndup(arg->start + 1, (gsize)arg->len - 2);
+    char* path = g_canonicalize_filename(name, dir);
+    g_free(name);
+    for (int i = 0; i < pp->nincludes; ++i) {
+        if (strcmp(pp->includes[i], path) == 0) {
+            pp_error(pp, at, "'%s' includes itself", path);
+            g_free(path);
+            return;
+        }
+    }
+    if (pp->nincludes >= PP_MAX_INCLUDE_DEPTH) {
+        pp_error(pp, at, "includes nested too deeply");
+        g_free(path);
+        return;
+    }
+    IncludeFile* f = include_load(pp, path, at);
+    g_free(path);
+    if (!f) return;
+    f->refs++;
+    g_ptr_array_add(pp->held, f);
+
+    char* fdir = g_path_get_dirname(f->path);
+    pp->includes[pp->nincludes++] = f->path;
+    pp_tokens(pp, f->toks, f->ntoks, fdir);
+    pp->nincludes--;
+    g_free(fdir);
+    // a last line without '\n' must not run into the next statement;
+    // errors there still point into the included file
+    ScriptToken nl = *at;
+    nl.kind = SCRIPT_TK_NEWLINE;
+    nl.len = 0;
+    nl.file = f->path;
+    nl.line = f->ntoks ? f->toks[f->ntoks - 1].line : 1;
+    if (!pp->failed) g_array_append_val(pp->out, nl);
+}
+
+static void pp_set(ScriptPp* pp, const ScriptToken* at, const ScriptToken* name, const ScriptToken* expr, int n) {
+    if (n == 0 || !pp->eval) {
+        pp_error(pp, at, "%%set expects a value");
+        return;
+    }
+    GArray* tmp = g_array_new(FALSE, FALSE, sizeof(ScriptToken));
+    for (int i = 0; i < n; ++i) pp_expand(pp, &expr[i], &expr[i], tmp);
+    if (!pp->failed && tmp->len == 0) {
+        // the value was all empty macros
+        g_array_free(tmp, TRUE);
+        pp_error(pp, at, "%%set expects a value");
+        return;
+    }
+    char msg[200] = "";
+    char* value = pp->failed ? NULL : pp->eval((const ScriptToken*)(void*)tmp->data, (int)tmp->len, msg, sizeof(msg));
+    g_array_free(tmp, TRUE);
+    if (!value) {
+        pp_error(pp, at, "%%set %.*s: %s", name->len, name->start, msg);
+        return;
+    }
+    g_ptr_array_add(pp->texts, value);
+    GArray* body = g_array_new(FALSE, FALSE, sizeof(ScriptToken));
+    lex_all(value, at->file, body);
+    macro_define(pp, name, (const ScriptToken*)(void*)body->data, (int)body->len);
+    g_array_free(body, TRUE);
+}
+
+static gboolean directive_is(const ScriptToken* t, const char* word) {
+    return t->kind == SCRIPT_TK_IDENT && (int)strlen(word) == t->len && strncmp(t->start, word, (size_t)t->len) == 0;
+}
+
+static void pp_directive(ScriptPp* pp, const ScriptToken* d, const char* dir) {
+    // the directive token spans its whole line; lex what follows the '%'
+    ScriptLexer lx;
+    script_lexer_init(&lx, d->start + 1, FALSE);
+    lx.line = d->line;
+    GArray* args = g_array_new(FALSE, FALSE, sizeof(ScriptToken));
+    ScriptToken word;
+    script_lex_next(&lx, &word);
+    for (;;) {
+        ScriptToken t;
+        script_lex_next(&lx, &t);
+        if (t.kind == SCRIPT_TK_NEWLINE || t.kind == SCRIPT_TK_EOF) break;
+        if (t.kind == SCRIPT_TK_ERROR) {
+            pp_error(pp, d, "unexpected '%.*s' in directive", t.len, t.start);
+            break;
+        }
+        t.file = d->file;
+        g_array_append_val(args, t);
+    }
+    const ScriptToken* a = (const ScriptToken*)(void*)args->data;
+    int n = (int)args->len;
+
+    if (pp->failed) {
+        // reported above
+    } else if (directive_is(&word, "include")) {
+        if (n > 1) pp_error(pp, d, "unexpected '%.*s' after %%include", a[1].len, a[1].start);
+        else pp_include(pp, d, n ? &a[0] : NULL, dir);
+    } else if (directive_is(&word, "define") || directive_is(&word, "set")) {
+        if (n == 0 || a[0].kind != SCRIPT_TK_IDENT) {
+            pp_error(pp, d, "%%%.*s expects a name", word.len, word.start);
+        } else if (directive_is(&word, "define")) {
+            macro_define(pp, &a[0], a + 1, n - 1);
+        } else {
+            pp_set(pp, d, &a[0], a + 1, n - 1);
+        }
+    } else {
+        pp_error(pp, d, "unknown directive '%.*s'", word.len + 1, d->start);
+    }
+    g_array_free(args, TRUE);
+}
+
+static void pp_tokens(ScriptPp* pp, const ScriptToken* toks, int n, const char* dir) {
+    for (int i = 0; i < n && !pp->failed; ++i) {
+        if (toks[i].kind == SCRIPT_TK_DIRECTIVE) pp_directive(pp, &toks[i], dir);
+        else pp_expand(pp, &toks[i], &toks[i], pp->out);
+    }
+}
+
+ScriptPp* script_pp_run(const char* text, const char* base_dir, ScriptIncludeCache* cache,
+                        script_pp_eval_fn eval, char* err, size_t err_len) {
+    if (err && err_len) err[0] = '\0';
+    ScriptPp* pp = g_new0(ScriptPp, 1);
+    pp->out = g_array_new(FALSE, FALSE, sizeof(ScriptToken));
+    pp->macros = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, macro_free);
+    pp->held = g_ptr_array_new_with_free_func(include_unref);
+    pp->texts = g_ptr_array_new_with_free_func(g_free);
+    pp->own_cache = cache == NULL;
+    pp->cache = cache ? cache : script_include_cache_new();
+    pp->eval = eval;
+    pp->err = err;
+    pp->err_len = err_len;
+
+    GArray* main_toks = g_array_new(FALSE, FALSE, sizeof(ScriptToken));
+    lex_all(text ? text : "", NULL, main_toks);
+    pp_tokens(pp, (const ScriptToken*)(void*)main_toks->data, (int)main_toks->len, base_dir);
+
+    ScriptToken eof;
+    memset(&eof, 0, sizeof(eof));
+    eof.kind = SCRIPT_TK_EOF;
+    eof.start = text ? text + strlen(text) : "";
+    eof.line = main_toks->len ? g_array_index(main_toks, ScriptToken, main_toks->len - 1).line : 1;
+    g_array_append_val(pp->out, eof);
+    g_array_free(main_toks, TRUE);
+
+    if (pp->failed) {
+        script_pp_free(pp);
+        return NULL;
+    }
+    return pp;
+}
+
+void script_pp_free(ScriptPp* pp) {
+    if (!pp) return;
+    g_array_free(pp->out, TRUE);
+    g_hash_table_destroy(pp->macros);
+    g_ptr_array_free(pp->held, TRUE);
+    g_ptr_array_free(pp->texts, TRUE);
+    if (pp->own_cache) script_include_cache_free(pp->cache);
+    g_free(pp);
+}
+
+const ScriptToken* script_pp_tokens(const ScriptPp* pp, int* n) {
+    if (n) *n = pp ? (int)pp->out->len : 0;
+    return pp ? (const ScriptToken*)(void*)pp->out->data : NULL;
+}
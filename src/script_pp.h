@@ -0,0 +1,44 @@
+#pragma once
+#include "script_lexer.h"
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Script preprocessor: turns the source text into the token stream the
+// compiler reads. Directives (first on a line, '%' or '#'):
+//   %define NAME tokens...   NAME expands to the tokens (may be empty)
+//   %set NAME expr           expr is evaluated now; NAME expands to the value
+//   %include "path"          tokens of another file; relative paths resolve
+//                            against the including file's directory
+// Expanded tokens carry the location of the use site. Tokens of included
+// files carry the file path in ScriptToken.file (NULL for the top-level text).
+
+// Included files, lexed once and reused while their mtime and size are unchanged.
+// Main-loop only; keep one across compiles to skip re-reading shared headers.
+typedef struct ScriptIncludeCache ScriptIncludeCache;
+
+ScriptIncludeCache* script_include_cache_new(void);
+void script_include_cache_free(ScriptIncludeCache* cache);
+
+// evaluate the constant expression toks[0..n) for %set; returns the value as
+// newly allocated literal source text, or NULL with the reason in err
+typedef char* (*script_pp_eval_fn)(const ScriptToken* toks, int n, char* err, size_t err_len);
+
+typedef struct ScriptPp ScriptPp;
+
+// preprocess text; base_dir resolves %include paths of the top-level text
+// (NULL = current directory), cache may be NULL. On failure returns NULL and
+// writes "line N: reason" (or "path:N: reason") to err.
+ScriptPp* script_pp_run(const char* text, const char* base_dir, ScriptIncludeCache* cache,
+                        script_pp_eval_fn eval, char* err, size_t err_len);
+void script_pp_free(ScriptPp* pp);
+
+// the expanded stream, ending with one SCRIPT_TK_EOF; valid until script_pp_free
+// (tokens point into text, the cache and the ScriptPp)
+const ScriptToken* script_pp_tokens(const ScriptPp* pp, int* n);
+
+#ifdef __cplusplus
+}
+#endif
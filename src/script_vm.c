@@ -0,0 +1,1290 @@
+#include "script_vm.h"
+#include "crc.h"
+#include "hexfmt.h"
+#include "rng.h"
+#include "script_pp.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <stdarg.h>
+
+// ---------------------------------------------------------------------------
+// values
+// ---------------------------------------------------------------------------
+
+// Byte values are slices (p, len) over refcounted blocks, so slicing and
+// passing values around never copies. Blocks the VM allocates come from a
+// per-VM free list by size class: once a loop has warmed up it recycles the
+// same blocks and makes no heap allocations. Compile-time constants use plain
+// heap blocks (pool NULL).
+
+#define BUF_MIN_SHIFT 6         // smallest class: 64 bytes
+#define BUF_CLASSES   11        // up to 64 KiB; larger blocks bypass the pool
+#define BUF_KEEP      32        // free blocks kept per class
+
+typedef struct ScriptBufPool ScriptBufPool;
+
+typedef struct ScriptBuf {
+    int refs;
+    int cls;                    // size class, -1 = not recycled
+    ScriptBufPool* pool;
+    struct ScriptBuf* next;     // free list link
+    size_t cap;
+    uint8_t data[];
+} ScriptBuf;
+
+struct ScriptBufPool {
+    ScriptBuf* free[BUF_CLASSES];
+    int nfree[BUF_CLASSES];
+};
+
+enum { VAL_INT = 0, VAL_BYTES };
+
+typedef struct {
+    int type;
+    int64_t i;                  // VAL_INT
+    ScriptBuf* buf;             // VAL_BYTES: block holding the slice
+    const uint8_t* p;
+    size_t len;
+} ScriptValue;
+
+// block with room for at least len bytes
+static ScriptBuf* buf_new(ScriptBufPool* pool, size_t len) {
+    int cls = 0;
+    while (cls < BUF_CLASSES && ((size_t)1 << (BUF_MIN_SHIFT + cls)) < len) ++cls;
+    if (!pool || cls == BUF_CLASSES) cls = -1;
+    if (cls >= 0 && pool->free[cls]) {
+        ScriptBuf* b = pool->free[cls];
+        pool->free[cls] = b->next;
+        pool->nfree[cls]--;
+        b->refs = 1;
+        return b;
+    }
+    size_t cap = cls >= 0 ? (size_t)1 << (BUF_MIN_SHIFT + cls) : len;
+    ScriptBuf* b = (ScriptBuf*)g_malloc(sizeof(ScriptBuf) + cap);
+    b->refs = 1;
+    b->cls = cls;
+    b->pool = pool;
+    b->next = NULL;
+    b->cap = cap;
+    return b;
+}
+
+static void buf_unref(ScriptBuf* b) {
+    if (!b || --b->refs > 0) return;
+    ScriptBufPool* pool = b->pool;
+    if (b->cls >= 0 && pool->nfree[b->cls] < BUF_KEEP) {
+        b->next = pool->free[b->cls];
+        pool->free[b->cls] = b;
+        pool->nfree[b->cls]++;
+        return;
+    }
+    g_free(b);
+}
+
+static void buf_pool_drain(ScriptBufPool* pool) {
+    for (int cls = 0; cls < BUF_CLASSES; ++cls) {
+        while (pool->free[cls]) {
+            ScriptBuf* b = pool->free[cls];
+            pool->free[cls] = b->next;
+            g_free(b);
+        }
+        pool->nfree[cls] = 0;
+    }
+}
+
+// takes over the caller's reference to b
+static inline ScriptValue bytes_value(ScriptBuf* b, size_t len) {
+    ScriptValue v = { VAL_BYTES, 0, b, b->data, len };
+    return v;
+}
+
+static inline void value_release(ScriptValue* v) {
+    if (v->type == VAL_BYTES) buf_unref(v->buf);
+    memset(v, 0, sizeof(*v));
+}
+
+static inline void value_retain(ScriptValue* v) {
+    if (v->type == VAL_BYTES && v->buf) v->buf->refs++;
+}
+
+// ---------------------------------------------------------------------------
+// bytecode
+// ---------------------------------------------------------------------------
+
+typedef enum {
+    OP_CONST,       // push consts[arg]
+    OP_LOAD,        // push vars[arg]
+    OP_STORE,       // vars[arg] = pop
+    OP_POP,
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD,
+    OP_BAND, OP_BOR, OP_BXOR, OP_SHL, OP_SHR,
+    OP_EQ, OP_NE, OP_LT, OP_LE, OP_GT, OP_GE,
+    OP_NEG, OP_NOT, OP_TRUTH,
+    OP_JMP,         // pc = arg
+    OP_JZ,          // if !pop: pc = arg
+    OP_CALL,        // builtin (arg & 0xff), argc (arg >> 8)
+    OP_HALT
+} OpCode;
+
+typedef struct {
+    uint8_t op;
+    int32_t arg;
+} Insn;
+
+typedef enum {
+    BI_RAND_INT = 0,
+    BI_RAND_BYTES,
+    BI_UDP_SEND,
+    BI_SLEEP,
+    BI_BYTE_AT,
+    BI_CRC16,
+    BI_PRINTF,
+    BI_LEN,
+    BI_SLICE,
+    BI_HEX,
+    BI_RAND_SEED,
+    BI_RAND_POOL,
+    BI_CRC32,
+    BI_CRC32C,
+    BI_COUNT
+} Builtin;
+
+typedef struct {
+    const char* name;
+    int min_args;
+    int max_args;   // -1 = variadic
+} BuiltinInfo;
+
+// names are also listed as keywords in script_lexer.c for highlighting
+static const BuiltinInfo k_builtins[BI_COUNT] = {
+    [BI_RAND_INT]   = { "rand_int",   2, 2 },
+    [BI_RAND_BYTES] = { "rand_bytes", 1, 1 },
+    [BI_UDP_SEND]   = { "udp.send",   1, 1 },
+    [BI_SLEEP]      = { "sleep",      1, 1 },
+    [BI_BYTE_AT]    = { "byte_at",    2, 2 },
+    [BI_CRC16]      = { "crc16",      1, 2 },   // optional variant: "ccitt", "modbus", "ibm"
+    [BI_PRINTF]     = { "printf",     1, -1 },
+    [BI_LEN]        = { "len",        1, 1 },
+    [BI_SLICE]      = { "slice",      3, 3 },
+    [BI_HEX]        = { "hex",        1, 1 },
+    [BI_RAND_SEED]  = { "rand_seed",  1, 1 },
+    [BI_RAND_POOL]  = { "rand_pool",  1, 1 },
+    [BI_CRC32]      = { "crc32",      1, 1 },
+    [BI_CRC32C]     = { "crc32c",     1, 1 },
+};
+
+struct ScriptProgram {
+    Insn* code;
+    int* lines;         // source line per instruction (runtime errors)
+    int* files;         // index into file_names per instruction, -1 = top-level text
+    int ncode;
+    int cap;
+
+    char** file_names;  // included files that produced code
+    int nfiles;
+
+    ScriptValue* consts;
+    int nconsts;
+
+    char** var_names;
+    int nvars;
+};
+
+void script_program_free(ScriptProgram* prog) {
+    if (!prog) return;
+    for (int i = 0; i < prog->nconsts; ++i) value_release(&prog->consts[i]);
+    for (int i = 0; i < prog->nvars; ++i) g_free(prog->var_names[i]);
+    for (int i = 0; i < prog->nfiles; ++i) g_free(prog->file_names[i]);
+    g_free(prog->consts);
+    g_free(prog->var_names);
+    g_free(prog->file_names);
+    g_free(prog->code);
+    g_free(prog->lines);
+    g_free(prog->files);
+    g_free(prog);
+}
+
+// runtime error at instruction at: "line N: msg" or "path:N: msg"
+static void insn_error(const ScriptProgram* p, int at, const char* msg, char* err, size_t err_len) {
+    if (p->files[at] >= 0) snprintf(err, err_len, "%s:%d: %s", p->file_names[p->files[at]], p->lines[at], msg);
+    else snprintf(err, err_len, "line %d: %s", p->lines[at], msg);
+}
+
+// ---------------------------------------------------------------------------
+// value operations, shared by the VM and constant folding
+// ---------------------------------------------------------------------------
+
+static gboolean hex_to_bytes(ScriptBufPool* pool, const ScriptValue* s, ScriptValue* out, size_t* err_off) {
+    ScriptBuf* b = buf_new(pool, s->len / 2 + 1);
+    size_t n = 0;
+    if (hex_decode(b->data, s->len / 2 + 1, (const char*)s->p, s->len, &n, err_off) != HEX_DECODE_OK) {
+        buf_unref(b);
+        return FALSE;
+    }
+    *out = bytes_value(b, n);
+    return TRUE;
+}
+
+// x + y for bytes, copying as little as possible
+static void bytes_concat(ScriptBufPool* pool, ScriptValue* x, const ScriptValue* y) {
+    ScriptBuf* xb = x->buf;
+    if (y->buf == xb && x->p + x->len == y->p) {
+        // neighbouring slices of one block, e.g. slice(d, 0, 4) + slice(d, 4, 8)
+        x->len += y->len;
+        return;
+    }
+    size_t n = x->len + y->len;
+    if (xb->refs == 1 && xb->pool && (size_t)(x->p - xb->data) + n <= xb->cap) {
+        // nobody else sees the block: append in place
+        memcpy(xb->data + (x->p - xb->data) + x->len, y->p, y->len);
+        x->len = n;
+        return;
+    }
+    ScriptBuf* b = buf_new(pool, n);
+    memcpy(b->data, x->p, x->len);
+    memcpy(b->data + x->len, y->p, y->len);
+    buf_unref(xb);
+    *x = bytes_value(b, n);
+}
+
+// x = x op y for the binary opcodes; returns NULL or the runtime error.
+// pool is where concatenation allocates (NULL at compile time).
+static const char* value_binop(ScriptBufPool* pool, OpCode op, ScriptValue* x, const ScriptValue* y) {
+    if (x->type != VAL_INT || y->type != VAL_INT) {
+        if (op != OP_ADD || x->type != VAL_BYTES || y->type != VAL_BYTES) return "operator needs integers";
+        bytes_concat(pool, x, y);
+        return NULL;
+    }
+    // + - * wrap around in two's complement instead of overflowing
+    int64_t a = x->i, b = y->i, r = 0;
+    switch (op) {
+    case OP_ADD: r = (int64_t)((uint64_t)a + (uint64_t)b); break;
+    case OP_SUB: r = (int64_t)((uint64_t)a - (uint64_t)b); break;
+    case OP_MUL: r = (int64_t)((uint64_t)a * (uint64_t)b); break;
+    case OP_DIV:
+    case OP_MOD:
+        if (b == 0) return "division by zero";
+        // INT64_MIN / -1 traps in hardware; it wraps to INT64_MIN like the rest
+        if (b == -1) r = op == OP_DIV ? (int64_t)(0 - (uint64_t)a) : 0;
+        else r = op == OP_DIV ? a / b : a % b;
+        break;
+    case OP_BAND: r = a & b; break;
+    case OP_BOR: r = a | b; break;
+    case OP_BXOR: r = a ^ b; break;
+    case OP_SHL: r = (int64_t)((uint64_t)a << (b & 63)); break;
+    case OP_SHR: r = a >> (b & 63); break;
+    case OP_EQ: r = a == b; break;
+    case OP_NE: r = a != b; break;
+    case OP_LT: r = a < b; break;
+    case OP_LE: r = a <= b; break;
+    case OP_GT: r = a > b; break;
+    case OP_GE: r = a >= b; break;
+    default: break;
+    }
+    x->i = r;
+    return NULL;
+}
+
+// NEG / NOT / TRUTH in place; bytes count by their length
+static void value_unary(OpCode op, ScriptValue* x) {
+    int64_t v = x->type == VAL_INT ? x->i : (int64_t)x->len;
+    value_release(x);
+    x->i = op == OP_NEG ? (int64_t)(0 - (uint64_t)v) : (op == OP_NOT ? !v : !!v);
+}
+
+// builtins whose result depends only on their arguments
+static gboolean builtin_pure(int bi) {
+    return bi == BI_BYTE_AT || bi == BI_CRC16 || bi == BI_CRC32 || bi == BI_CRC32C ||
+           bi == BI_LEN || bi == BI_SLICE || bi == BI_HEX;
+}
+
+#define RT_ERROR(...) do { snprintf(err, err_len, __VA_ARGS__); return FALSE; } while (0)
+
+static gboolean call_pure(ScriptBufPool* pool, int bi, int argc, const ScriptValue* a, ScriptValue* out,
+                          char* err, size_t err_len) {
+    ScriptValue r = { VAL_INT, 0, NULL, NULL, 0 };
+    switch (bi) {
+    case BI_BYTE_AT:
+        if (a[0].type != VAL_BYTES || a[1].type != VAL_INT) RT_ERROR("byte_at expects (bytes, index)");
+        if (a[1].i < 0 || (uint64_t)a[1].i >= a[0].len) RT_ERROR("byte_at index %lld out of range", (long long)a[1].i);
+        r.i = a[0].p[a[1].i];
+        break;
+    case BI_CRC16: {
+        if (a[0].type != VAL_BYTES) RT_ERROR("crc16 expects bytes");
+        CrcKind kind = CRC16_CCITT;
+        if (argc > 1) {
+            if (a[1].type != VAL_BYTES || !crc_kind_from_name((const char*)a[1].p, a[1].len, &kind) ||
+                kind > CRC16_IBM) {
+                RT_ERROR("crc16 variant must be \"ccitt\", \"modbus\" or \"ibm\"");
+            }
+        }
+        r.i = crc_compute(kind, a[0].p, a[0].len);
+        break;
+    }
+    case BI_CRC32:
+    case BI_CRC32C:
+        if (a[0].type != VAL_BYTES) RT_ERROR("%s expects bytes", k_builtins[bi].name);
+        r.i = crc_compute(bi == BI_CRC32 ? CRC32_IEEE : CRC32_C, a[0].p, a[0].len);
+        break;
+    case BI_LEN:
+        r.i = a[0].type == VAL_BYTES ? (int64_t)a[0].len : 0;
+        break;
+    case BI_SLICE: {
+        if (a[0].type != VAL_BYTES || a[1].type != VAL_INT || a[2].type != VAL_INT) RT_ERROR("slice expects (bytes, offset, length)");
+        int64_t off = a[1].i, n = a[2].i;
+        if (off < 0 || n < 0 || (uint64_t)off + (uint64_t)n > a[0].len) RT_ERROR("slice out of range");
+        // shares the block
+        r = a[0];
+        value_retain(&r);
+        r.p += off;
+        r.len = (size_t)n;
+        break;
+    }
+    case BI_HEX: {
+        if (a[0].type != VAL_BYTES) RT_ERROR("hex expects a string");
+        size_t bad = 0;
+        if (!hex_to_bytes(pool, &a[0], &r, &bad)) RT_ERROR("hex: invalid hex string at offset %zu", bad);
+        break;
+    }
+    default:
+        RT_ERROR("unknown builtin %d", bi);
+    }
+    *out = r;
+    return TRUE;
+}
+
+// ---------------------------------------------------------------------------
+// compiler (recursive descent, emits bytecode directly)
+// ---------------------------------------------------------------------------
+
+#define MAX_LOOP_DEPTH 32
+#define MAX_PATCHES    64
+
+typedef struct {
+    int continue_pc;
+    int breaks[MAX_PATCHES];
+    int nbreaks;
+} LoopCtx;
+
+typedef struct {
+    const ScriptToken* toks;    // preprocessed stream, ends with SCRIPT_TK_EOF
+    int ntoks;
+    int pos;                    // next token
+    ScriptToken tok;
+    ScriptProgram* prog;
+    const char* file;           // ScriptToken.file of file_names[file_idx]
+    int file_idx;
+    LoopCtx loops[MAX_LOOP_DEPTH];
+    int nloops;
+    char* err;
+    size_t err_len;
+    gboolean failed;
+    gboolean no_location;       // %set values: the preprocessor prefixes the location
+} Compiler;
+
+static void comp_error(Compiler* c, const char* fmt, ...) G_GNUC_PRINTF(2, 3);
+static void comp_error(Compiler* c, const char* fmt, ...) {
+    if (c->failed) return;
+    c->failed = TRUE;
+    if (!c->err || c->err_len == 0) return;
+    int n = 0;
+    if (c->no_location) c->err[0] = '\0';
+    else if (c->tok.file) n = snprintf(c->err, c->err_len, "%s:%d: ", c->tok.file, c->tok.line);
+    else n = snprintf(c->err, c->err_len, "line %d: ", c->tok.line);
+    if (n < 0 || (size_t)n >= c->err_len) return;
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(c->err + n, c->err_len - (size_t)n, fmt, ap);
+    va_end(ap);
+}
+
+static void advance(Compiler* c) {
+    c->tok = c->toks[c->pos];
+    if (c->pos < c->ntoks - 1) c->pos++;
+    if (c->tok.kind == SCRIPT_TK_ERROR) comp_error(c, "unexpected character '%.*s'", c->tok.len, c->tok.start);
+}
+
+static gboolean is_punct(const Compiler* c, const char* op) {
+    return c->tok.kind == SCRIPT_TK_PUNCT && strcmp(c->tok.op, op) == 0;
+}
+
+static gboolean is_ident(const Compiler* c, const char* name) {
+    return c->tok.kind == SCRIPT_TK_IDENT && (int)strlen(name) == c->tok.len &&
+           strncmp(c->tok.start, name, (size_t)c->tok.len) == 0;
+}
+
+static gboolean peek_is_punct(const Compiler* c, const char* op) {
+    const ScriptToken* t = &c->toks[c->pos];
+    return t->kind == SCRIPT_TK_PUNCT && strcmp(t->op, op) == 0;
+}
+
+static void expect_punct(Compiler* c, const char* op) {
+    if (!is_punct(c, op)) {
+        comp_error(c, "expected '%s' near '%.*s'", op, c->tok.len, c->tok.start);
+        return;
+    }
+    advance(c);
+}
+
+static void skip_newlines(Compiler* c) {
+    while (!c->failed && (c->tok.kind == SCRIPT_TK_NEWLINE || is_punct(c, ";"))) advance(c);
+}
+
+static int file_index(Compiler* c, const char* file) {
+    if (!file) return -1;
+    if (file == c->file) return c->file_idx;
+    ScriptProgram* p = c->prog;
+    int i = 0;
+    while (i < p->nfiles && strcmp(p->file_names[i], file) != 0) ++i;
+    if (i == p->nfiles) {
+        p->file_names = g_renew(char*, p->file_names, p->nfiles + 1);
+        p->file_names[p->nfiles++] = g_strdup(file);
+    }
+    c->file = file;
+    c->file_idx = i;
+    return i;
+}
+
+static int emit(Compiler* c, OpCode op, int32_t arg) {
+    ScriptProgram* p = c->prog;
+    if (p->ncode == p->cap) {
+        p->cap = p->cap ? p->cap * 2 : 64;
+        p->code = g_renew(Insn, p->code, p->cap);
+        p->lines = g_renew(int, p->lines, p->cap);
+        p->files = g_renew(int, p->files, p->cap);
+    }
+    p->code[p->ncode].op = (uint8_t)op;
+    p->code[p->ncode].arg = arg;
+    p->lines[p->ncode] = c->tok.line;
+    p->files[p->ncode] = file_index(c, c->tok.file);
+    return p->ncode++;
+}
+
+static void patch(Compiler* c, int at, int target) {
+    c->prog->code[at].arg = target;
+}
+
+static int add_const(Compiler* c, ScriptValue v) {
+    ScriptProgram* p = c->prog;
+    if (v.type == VAL_INT) {
+        for (int i = 0; i < p->nconsts; ++i) {
+            if (p->consts[i].type == VAL_INT && p->consts[i].i == v.i) return i;
+        }
+    }
+    p->consts = g_renew(ScriptValue, p->consts, p->nconsts + 1);
+    p->consts[p->nconsts] = v;
+    return p->nconsts++;
+}
+
+// TRUE when everything emitted since start is n OP_CONSTs
+static gboolean const_run(const Compiler* c, int start, int n) {
+    const ScriptProgram* p = c->prog;
+    if (p->ncode - start != n) return FALSE;
+    for (int i = start; i < p->ncode; ++i) {
+        if (p->code[i].op != OP_CONST) return FALSE;
+    }
+    return TRUE;
+}
+
+static const ScriptValue* const_operand(const Compiler* c, int at) {
+    return &c->prog->consts[c->prog->code[at].arg];
+}
+
+// replace the code since start (and the constants added since k0) by v
+static void fold_to(Compiler* c, int start, int k0, ScriptValue v) {
+    ScriptProgram* p = c->prog;
+    p->ncode = start;
+    while (p->nconsts > k0) value_release(&p->consts[--p->nconsts]);
+    emit(c, OP_CONST, add_const(c, v));
+}
+
+static int var_slot(Compiler* c, const char* name, int len) {
+    ScriptProgram* p = c->prog;
+    for (int i = 0; i < p->nvars; ++i) {
+        if ((int)strlen(p->var_names[i]) == len && strncmp(p->var_names[i], name, (size_t)len) == 0) return i;
+    }
+    p->var_names = g_renew(char*, p->var_names, p->nvars + 1);
+    p->var_names[p->nvars] = g_strndup(name, (gsize)len);
+    return p->nvars++;
+}
+
+static int find_builtin(const char* name, int len) {
+    for (int i = 0; i < BI_COUNT; ++i) {
+        if ((int)strlen(k_builtins[i].name) == len && strncmp(k_builtins[i].name, name, (size_t)len) == 0) return i;
+    }
+    return -1;
+}
+
+static ScriptValue parse_string_literal(const ScriptToken* t) {
+    // t->start points at the opening quote
+    ScriptBuf* b = buf_new(NULL, (size_t)t->len);
+    size_t n = 0;
+    for (int i = 1; i < t->len - 1; ++i) {
+        char ch = t->start[i];
+        if (ch == '\\' && i + 1 < t->len - 1) {
+            char e = t->start[++i];
+            switch (e) {
+            case 'n': ch = '\n'; break;
+            case 'r': ch = '\r'; break;
+            case 't': ch = '\t'; break;
+            case '0': ch = '\0'; break;
+            case 'x':
+                if (i + 2 < t->len - 1 && isxdigit((unsigned char)t->start[i + 1]) && isxdigit((unsigned char)t->start[i + 2])) {
+                    char hx[3] = { t->start[i + 1], t->start[i + 2], 0 };
+                    ch = (char)strtol(hx, NULL, 16);
+                    i += 2;
+                } else {
+                    ch = 'x';
+                }
+                break;
+            default: ch = e; break;
+            }
+        }
+        b->data[n++] = (uint8_t)ch;
+    }
+    return bytes_value(b, n);
+}
+
+static void parse_expr(Compiler* c);
+
+static void parse_call(Compiler* c, int bi, const ScriptToken* name) {
+    advance(c); // '('
+    int start = c->prog->ncode, k0 = c->prog->nconsts;
+    int argc = 0;
+    if (!is_punct(c, ")")) {
+        for (;;) {
+            parse_expr(c);
+            ++argc;
+            if (c->failed || !is_punct(c, ",")) break;
+            advance(c);
+        }
+    }
+    expect_punct(c, ")");
+    if (c->failed) return;
+    const BuiltinInfo* info = &k_builtins[bi];
+    if (argc < info->min_args || (info->max_args >= 0 && argc > info->max_args)) {
+        comp_error(c, "wrong number of arguments to %.*s (%d)", name->len, name->start, argc);
+        return;
+    }
+    if (builtin_pure(bi) && argc <= 3 && const_run(c, start, argc)) {
+        ScriptValue a[3], r;
+        for (int i = 0; i < argc; ++i) a[i] = *const_operand(c, start + i);
+        char msg[8];
+        // a failing call stays in the code and reports at run time, as before
+        if (call_pure(NULL, bi, argc, a, &r, msg, sizeof(msg))) {
+            fold_to(c, start, k0, r);
+            return;
+        }
+    }
+    emit(c, OP_CALL, (int32_t)(bi | (argc << 8)));
+}
+
+static void parse_primary(Compiler* c) {
+    if (c->failed) return;
+    ScriptToken t = c->tok;
+    if (t.kind == SCRIPT_TK_INT) {
+        ScriptValue v = { VAL_INT, t.ival, NULL, NULL, 0 };
+        emit(c, OP_CONST, add_const(c, v));
+        advance(c);
+    } else if (t.kind == SCRIPT_TK_STR) {
+        emit(c, OP_CONST, add_const(c, parse_string_literal(&t)));
+        advance(c);
+    } else if (t.kind == SCRIPT_TK_IDENT) {
+        advance(c);
+        if (is_punct(c, "(")) {
+            int bi = find_builtin(t.start, t.len);
+            if (bi < 0) {
+                comp_error(c, "unknown function '%.*s'", t.len, t.start);
+                return;
+            }
+            parse_call(c, bi, &t);
+        } else {
+            emit(c, OP_LOAD, var_slot(c, t.start, t.len));
+        }
+    } else if (is_punct(c, "(")) {
+        advance(c);
+        parse_expr(c);
+        expect_punct(c, ")");
+    } else {
+        if (t.kind == SCRIPT_TK_NEWLINE || t.kind == SCRIPT_TK_EOF) comp_error(c, "unexpected end of line in expression");
+        else comp_error(c, "unexpected '%.*s' in expression", t.len, t.start);
+    }
+}
+
+static void parse_unary(Compiler* c) {
+    if (is_punct(c, "-") || is_punct(c, "!")) {
+        OpCode op = is_punct(c, "-") ? OP_NEG : OP_NOT;
+        advance(c);
+        int start = c->prog->ncode, k0 = c->prog->nconsts;
+        parse_unary(c);
+        if (const_run(c, start, 1)) {
+            ScriptValue v = *const_operand(c, start);
+            value_retain(&v);
+            value_unary(op, &v);
+            fold_to(c, start, k0, v);
+        } else {
+            emit(c, op, 0);
+        }
+    } else {
+        parse_primary(c);
+    }
+}
+
+typedef struct {
+    const char* op;
+    int prec;
+    OpCode code;
+} BinOp;
+
+static const BinOp k_binops[] = {
+    { "*", 10, OP_MUL }, { "/", 10, OP_DIV }, { "%", 10, OP_MOD },
+    { "+", 9, OP_ADD },  { "-", 9, OP_SUB },
+    { "<<", 8, OP_SHL }, { ">>", 8, OP_SHR },
+    { "<", 7, OP_LT },   { "<=", 7, OP_LE }, { ">", 7, OP_GT }, { ">=", 7, OP_GE },
+    { "==", 6, OP_EQ },  { "!=", 6, OP_NE },
+    { "&", 5, OP_BAND }, { "^", 4, OP_BXOR }, { "|", 3, OP_BOR },
+    { "&&", 2, OP_HALT }, { "||", 1, OP_HALT },   // short-circuit, handled specially
+};
+
+static const BinOp* current_binop(const Compiler* c) {
+    if (c->tok.kind != SCRIPT_TK_PUNCT) return NULL;
+    for (size_t i = 0; i < G_N_ELEMENTS(k_binops); ++i) {
+        if (strcmp(c->tok.op, k_binops[i].op) == 0) return &k_binops[i];
+    }
+    return NULL;
+}
+
+static void parse_binary(Compiler* c, int min_prec) {
+    int start = c->prog->ncode, k0 = c->prog->nconsts;
+    parse_unary(c);
+    for (;;) {
+        if (c->failed) return;
+        const BinOp* bo = current_binop(c);
+        if (!bo || bo->prec < min_prec) return;
+        advance(c);
+        if (bo->prec == 2 || bo->prec == 1) {
+            // a && b  ->  a; JZ F; b; TRUTH; JMP E; F: 0; E:
+            // a || b  ->  a; NOT; JZ T; b; TRUTH; JMP E; T: 1; E:
+            if (bo->prec == 1) emit(c, OP_NOT, 0);
+            int jz = emit(c, OP_JZ, 0);
+            parse_binary(c, bo->prec + 1);
+            emit(c, OP_TRUTH, 0);
+            int jend = emit(c, OP_JMP, 0);
+            patch(c, jz, c->prog->ncode);
+            ScriptValue v = { VAL_INT, bo->prec == 1 ? 1 : 0, NULL, NULL, 0 };
+            emit(c, OP_CONST, add_const(c, v));
+            patch(c, jend, c->prog->ncode);
+        } else {
+            parse_binary(c, bo->prec + 1);
+            if (const_run(c, start, 2)) {
+                ScriptValue x = *const_operand(c, start);
+                value_retain(&x);
+                if (!value_binop(NULL, bo->code, &x, const_operand(c, start + 1))) {
+                    fold_to(c, start, k0, x);
+                    continue;
+                }
+                // e.g. 1 / 0: left for the VM to report when it is reached
+                value_release(&x);
+            }
+            emit(c, bo->code, 0);
+        }
+    }
+}
+
+static void parse_expr(Compiler* c) {
+    parse_binary(c, 1);
+}
+
+static void parse_block(Compiler* c);
+
+static void end_statement(Compiler* c) {
+    if (c->failed) return;
+    if (c->tok.kind == SCRIPT_TK_NEWLINE || is_punct(c, ";")) {
+        advance(c);
+    } else if (!is_punct(c, "}") && c->tok.kind != SCRIPT_TK_EOF) {
+        comp_error(c, "unexpected '%.*s' after statement", c->tok.len, c->tok.start);
+    }
+}
+
+static LoopCtx* push_loop(Compiler* c, int continue_pc) {
+    if (c->nloops >= MAX_LOOP_DEPTH) {
+        comp_error(c, "loops nested too deeply");
+        return NULL;
+    }
+    LoopCtx* l = &c->loops[c->nloops++];
+    l->continue_pc = continue_pc;
+    l->nbreaks = 0;
+    return l;
+}
+
+static void pop_loop(Compiler* c) {
+    LoopCtx* l = &c->loops[--c->nloops];
+    for (int i = 0; i < l->nbreaks; ++i) patch(c, l->breaks[i], c->prog->ncode);
+}
+
+static void parse_statement(Compiler* c) {
+    if (c->failed) return;
+    ScriptToken t = c->tok;
+
+    if (is_ident(c, "loop")) {
+        advance(c);
+        int top = c->prog->ncode;
+        if (!push_loop(c, top)) return;
+        parse_block(c);
+        emit(c, OP_JMP, top);
+        pop_loop(c);
+    } else if (is_ident(c, "while")) {
+        advance(c);
+        int top = c->prog->ncode;
+        parse_expr(c);
+        int jz = emit(c, OP_JZ, 0);
+        if (!push_loop(c, top)) return;
+        parse_block(c);
+        emit(c, OP_JMP, top);
+        patch(c, jz, c->prog->ncode);
+        pop_loop(c);
+    } else if (is_ident(c, "if")) {
+        advance(c);
+        parse_expr(c);
+        int jz = emit(c, OP_JZ, 0);
+        parse_block(c);
+        if (is_ident(c, "else")) {
+            int jend = emit(c, OP_JMP, 0);
+            patch(c, jz, c->prog->ncode);
+            advance(c);
+            if (is_ident(c, "if")) parse_statement(c);
+            else parse_block(c);
+            patch(c, jend, c->prog->ncode);
+        } else {
+            patch(c, jz, c->prog->ncode);
+        }
+        return;
+    } else if (is_ident(c, "break") || is_ident(c, "continue")) {
+        gboolean is_break = is_ident(c, "break");
+        advance(c);
+        if (c->nloops == 0) {
+            comp_error(c, "'%s' outside of loop", is_break ? "break" : "continue");
+            return;
+        }
+        LoopCtx* l = &c->loops[c->nloops - 1];
+        if (is_break) {
+            if (l->nbreaks >= MAX_PATCHES) {
+                comp_error(c, "too many 'break' in one loop");
+                return;
+            }
+            l->breaks[l->nbreaks++] = emit(c, OP_JMP, 0);
+        } else {
+            emit(c, OP_JMP, l->continue_pc);
+        }
+    } else if (is_ident(c, "return")) {
+        advance(c);
+        emit(c, OP_HALT, 0);
+    } else if (is_ident(c, "fn") || is_ident(c, "for")) {
+        comp_error(c, "'%.*s' is not supported yet", t.len, t.start);
+        return;
+    } else if (t.kind == SCRIPT_TK_IDENT && (is_ident(c, "let") || is_ident(c, "var"))) {
+        advance(c);
+        if (c->tok.kind != SCRIPT_TK_IDENT) {
+            comp_error(c, "expected variable name");
+            return;
+        }
+        ScriptToken name = c->tok;
+        advance(c);
+        expect_punct(c, "=");
+        parse_expr(c);
+        emit(c, OP_STORE, var_slot(c, name.start, name.len));
+    } else if (t.kind == SCRIPT_TK_IDENT && !peek_is_punct(c, "(")) {
+        // assignment: name = expr (builtin names may be reused as variables)
+        advance(c);
+        if (!is_punct(c, "=")) {
+            comp_error(c, "expected '=' after '%.*s'", t.len, t.start);
+            return;
+        }
+        advance(c);
+        parse_expr(c);
+        emit(c, OP_STORE, var_slot(c, t.start, t.len));
+    } else {
+        parse_expr(c);
+        emit(c, OP_POP, 0);
+    }
+    end_statement(c);
+}
+
+static void parse_block(Compiler* c) {
+    if (c->failed) return;
+    expect_punct(c, "{");
+    skip_newlines(c);
+    while (!c->failed && !is_punct(c, "}")) {
+        if (c->tok.kind == SCRIPT_TK_EOF) {
+            comp_error(c, "missing '}'");
+            return;
+        }
+        parse_statement(c);
+        skip_newlines(c);
+    }
+    expect_punct(c, "}");
+}
+
+static void compiler_init(Compiler* c, const ScriptToken* toks, int ntoks, char* err, size_t err_len) {
+    memset(c, 0, sizeof(*c));
+    c->toks = toks;
+    c->ntoks = ntoks;
+    c->prog = g_new0(ScriptProgram, 1);
+    c->file_idx = -1;
+    c->err = err;
+    c->err_len = err_len;
+    advance(c);
+}
+
+static void format_literal(GString* out, const ScriptValue* v) {
+    if (v->type == VAL_INT) {
+        // the lexer has no negative literals; INT64_MIN has no positive one
+        if (v->i == INT64_MIN) g_string_append(out, "(-9223372036854775807 - 1)");
+        else if (v->i < 0) g_string_append_printf(out, "(%lld)", (long long)v->i);
+        else g_string_append_printf(out, "%lld", (long long)v->i);
+        return;
+    }
+    g_string_append_c(out, '"');
+    for (size_t i = 0; i < v->len; ++i) g_string_append_printf(out, "\\x%02x", v->p[i]);
+    g_string_append_c(out, '"');
+}
+
+// %set: evaluate the value expression now and hand it back as a literal
+static char* pp_eval(const ScriptToken* toks, int n, char* err, size_t err_len) {
+    if (n <= 0) {
+        snprintf(err, err_len, "missing value");
+        return NULL;
+    }
+    ScriptToken* buf = g_new(ScriptToken, n + 1);
+    memcpy(buf, toks, sizeof(ScriptToken) * (size_t)n);
+    buf[n] = toks[n - 1];
+    buf[n].kind = SCRIPT_TK_EOF;
+    buf[n].len = 0;
+
+    Compiler c;
+    compiler_init(&c, buf, n + 1, err, err_len);
+    c.no_location = TRUE;
+    parse_expr(&c);
+    if (!c.failed && c.tok.kind != SCRIPT_TK_EOF) comp_error(&c, "unexpected '%.*s'", c.tok.len, c.tok.start);
+    if (!c.failed && !const_run(&c, 0, 1)) comp_error(&c, "value is not a constant expression");
+
+    char* text = NULL;
+    if (!c.failed) {
+        GString* s = g_string_new(NULL);
+        format_literal(s, const_operand(&c, 0));
+        text = g_string_free(s, FALSE);
+    }
+    script_program_free(c.prog);
+    g_free(buf);
+    return text;
+}
+
+ScriptProgram* script_compile(const char* text, const char* base_dir, ScriptIncludeCache* cache,
+                              char* err, size_t err_len) {
+    if (err && err_len) err[0] = '\0';
+    ScriptPp* pp = script_pp_run(text, base_dir, cache, pp_eval, err, err_len);
+    if (!pp) return NULL;
+    int ntoks = 0;
+    const ScriptToken* toks = script_pp_tokens(pp, &ntoks);
+
+    Compiler c;
+    compiler_init(&c, toks, ntoks, err, err_len);
+    skip_newlines(&c);
+    while (!c.failed && c.tok.kind != SCRIPT_TK_EOF) {
+        parse_statement(&c);
+        skip_newlines(&c);
+    }
+    emit(&c, OP_HALT, 0);
+    script_pp_free(pp);
+
+    if (c.failed) {
+        script_program_free(c.prog);
+        return NULL;
+    }
+    return c.prog;
+}
+
+// ---------------------------------------------------------------------------
+// VM
+// ---------------------------------------------------------------------------
+
+#define VM_STACK_MAX   256
+#define VM_SLICE       1024     // instructions between control checks
+#define VM_POOL_MAX    (64 * 1024 * 1024)
+
+enum { CTL_RUN = 0, CTL_PAUSE, CTL_STOP };
+
+struct ScriptVm {
+    ScriptHost host;
+
+    GMutex lock;
+    GCond cond;
+    GThread* thread;
+    gint ctl;           // CTL_*; read by the worker once per slice
+    gint state;         // ScriptState, for script_vm_state()
+
+    ScriptProgram* prog;
+    ScriptValue* vars;
+    ScriptValue stack[VM_STACK_MAX];
+    int sp;
+    ScriptBufPool bufs;     // recycled byte blocks; worker thread only while running
+    Rng rng;
+
+    // rand_pool(): rand_bytes returns consecutive slices of this block
+    // instead of generating; when the rest is too short it jumps back in
+    ScriptBuf* rand_pool;
+    size_t rand_pos;
+};
+
+ScriptVm* script_vm_new(const ScriptHost* host) {
+    ScriptVm* vm = g_new0(ScriptVm, 1);
+    if (host) vm->host = *host;
+    g_mutex_init(&vm->lock);
+    g_cond_init(&vm->cond);
+    vm->state = SCRIPT_STOPPED;
+    return vm;
+}
+
+static void vm_reset(ScriptVm* vm) {
+    while (vm->sp > 0) value_release(&vm->stack[--vm->sp]);
+    if (vm->prog) {
+        for (int i = 0; i < vm->prog->nvars; ++i) value_release(&vm->vars[i]);
+    }
+    g_free(vm->vars);
+    vm->vars = NULL;
+    script_program_free(vm->prog);
+    vm->prog = NULL;
+    buf_unref(vm->rand_pool);
+    vm->rand_pool = NULL;
+    vm->rand_pos = 0;
+    buf_pool_drain(&vm->bufs);
+}
+
+void script_vm_free(ScriptVm* vm) {
+    if (!vm) return;
+    script_vm_stop(vm);
+    vm_reset(vm);
+    g_cond_clear(&vm->cond);
+    g_mutex_clear(&vm->lock);
+    g_free(vm);
+}
+
+static void vm_log(ScriptVm* vm, const char* fmt, ...) G_GNUC_PRINTF(2, 3);
+static void vm_log(ScriptVm* vm, const char* fmt, ...) {
+    if (!vm->host.log) return;
+    char buf[512];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    vm->host.log(vm->host.user, buf);
+}
+
+// sleep that wakes immediately on stop and is suspended while paused;
+// returns FALSE when the script must stop
+static gboolean vm_sleep_ms(ScriptVm* vm, int64_t ms) {
+    if (ms <= 0) return g_atomic_int_get(&vm->ctl) != CTL_STOP;
+    gint64 now = g_get_monotonic_time();
+    // huge arguments sleep until stopped rather than overflow the deadline
+    gint64 deadline = ms < (G_MAXINT64 - now) / 1000 ? now + ms * 1000 : G_MAXINT64;
+    gboolean ok = TRUE;
+    g_mutex_lock(&vm->lock);
+    for (;;) {
+        if (vm->ctl == CTL_STOP) { ok = FALSE; break; }
+        if (vm->ctl == CTL_PAUSE) {
+            gint64 paused_at = g_get_monotonic_time();
+            while (vm->ctl == CTL_PAUSE) g_cond_wait(&vm->cond, &vm->lock);
+            gint64 paused = g_get_monotonic_time() - paused_at;
+            deadline = deadline < G_MAXINT64 - paused ? deadline + paused : G_MAXINT64;
+            continue;
+        }
+        if (!g_cond_wait_until(&vm->cond, &vm->lock, deadline) && g_get_monotonic_time() >= deadline) break;
+    }
+    g_mutex_unlock(&vm->lock);
+    return ok;
+}
+
+// block while paused; returns FALSE when the script must stop
+static gboolean vm_check_ctl(ScriptVm* vm) {
+    gint ctl = g_atomic_int_get(&vm->ctl);
+    if (G_LIKELY(ctl == CTL_RUN)) return TRUE;
+    if (ctl == CTL_STOP) return FALSE;
+    g_mutex_lock(&vm->lock);
+    while (vm->ctl == CTL_PAUSE) g_cond_wait(&vm->cond, &vm->lock);
+    ctl = vm->ctl;
+    g_mutex_unlock(&vm->lock);
+    return ctl != CTL_STOP;
+}
+
+static void format_printf(GString* out, const ScriptValue* args, int argc) {
+    // args[0] is the format (bytes), the rest are consumed by conversions
+    const uint8_t* f = args[0].p;
+    size_t flen = args[0].len;
+    int ai = 1;
+    for (size_t i = 0; i < flen; ++i) {
+        char ch = (char)f[i];
+        if (ch != '%' || i + 1 >= flen) { g_string_append_c(out, ch); continue; }
+        char conv = (char)f[++i];
+        if (conv == '%') { g_string_append_c(out, '%'); continue; }
+        if (ai >= argc) { g_string_append(out, "<missing>"); continue; }
+        const ScriptValue* a = &args[ai++];
+        if (a->type == VAL_BYTES) {
+            if (conv == 'x' || conv == 'X') {
+                gsize old = out->len;
+                g_string_set_size(out, old + a->len * 2);
+                hex_encode(out->str + old, a->p, a->len, conv == 'X');
+            } else {
+                g_string_append_len(out, (const char*)a->p, (gssize)a->len);
+            }
+        } else {
+            switch (conv) {
+            case 'x': g_string_append_printf(out, "%llx", (unsigned long long)a->i); break;
+            case 'X': g_string_append_printf(out, "%llX", (unsigned long long)a->i); break;
+            case 'u': g_string_append_printf(out, "%llu", (unsigned long long)a->i); break;
+            default:  g_string_append_printf(out, "%lld", (long long)a->i); break;
+            }
+        }
+    }
+}
+
+// run builtin bi with argc args at stack[sp-argc..sp-1]; leaves one result
+static gboolean vm_call(ScriptVm* vm, int bi, int argc, char* err, size_t err_len) {
+    ScriptValue* a = &vm->stack[vm->sp - argc];
+    ScriptValue r = { VAL_INT, 0, NULL, NULL, 0 };
+
+    switch (bi) {
+    case BI_RAND_INT: {
+        if (a[0].type != VAL_INT || a[1].type != VAL_INT) RT_ERROR("rand_int expects integers");
+        int64_t lo = a[0].i, hi = a[1].i;
+        if (hi < lo) { int64_t t = lo; lo = hi; hi = t; }
+        uint64_t span = (uint64_t)hi - (uint64_t)lo + 1;     // 0 = the whole range
+        r.i = (int64_t)((uint64_t)lo + rng_below(&vm->rng, span));
+        break;
+    }
+    case BI_RAND_BYTES: {
+        if (a[0].type != VAL_INT || a[0].i < 0 || a[0].i > 65535) RT_ERROR("rand_bytes length out of range");
+        size_t n = (size_t)a[0].i;
+        ScriptBuf* pool = vm->rand_pool;
+        if (pool && n <= pool->cap) {
+            // restart at a random offset so windows do not repeat in lockstep
+            if (pool->cap - vm->rand_pos < n) vm->rand_pos = (size_t)rng_below(&vm->rng, pool->cap - n + 1);
+            pool->refs++;
+            r = bytes_value(pool, n);
+            r.p += vm->rand_pos;
+            vm->rand_pos += n;
+        } else {
+            ScriptBuf* b = buf_new(&vm->bufs, n);
+            rng_fill(&vm->rng, b->data, n);
+            r = bytes_value(b, n);
+        }
+        break;
+    }
+    case BI_RAND_SEED:
+        if (a[0].type != VAL_INT) RT_ERROR("rand_seed expects an integer");
+        rng_seed(&vm->rng, (uint64_t)a[0].i);
+        vm->rand_pos = 0;
+        break;
+    case BI_RAND_POOL:
+        if (a[0].type != VAL_INT || a[0].i < 0 || a[0].i > VM_POOL_MAX) RT_ERROR("rand_pool size out of range");
+        buf_unref(vm->rand_pool);
+        vm->rand_pool = NULL;
+        vm->rand_pos = 0;
+        if (a[0].i > 0) {
+            // not recycled: cap is exactly the requested size
+            vm->rand_pool = buf_new(NULL, (size_t)a[0].i);
+            rng_fill(&vm->rng, vm->rand_pool->data, vm->rand_pool->cap);
+        }
+        break;
+    case BI_UDP_SEND:
+        if (a[0].type != VAL_BYTES) RT_ERROR("udp.send expects bytes");
+        r.i = vm->host.send ? (vm->host.send(vm->host.user, a[0].p, a[0].len) ? 1 : 0) : 0;
+        break;
+    case BI_SLEEP:
+        if (a[0].type != VAL_INT) RT_ERROR("sleep expects milliseconds");
+        // a stop request during sleep is picked up by the caller's control check
+        vm_sleep_ms(vm, a[0].i);
+        break;
+    case BI_PRINTF: {
+        if (a[0].type != VAL_BYTES) RT_ERROR("printf expects a format string");
+        GString* s = g_string_new(NULL);
+        format_printf(s, a, argc);
+        if (vm->host.log) vm->host.log(vm->host.user, s->str);
+        g_string_free(s, TRUE);
+        break;
+    }
+    default:
+        if (!call_pure(&vm->bufs, bi, argc, a, &r, err, err_len)) return FALSE;
+        break;
+    }
+
+    for (int i = 0; i < argc; ++i) value_release(&a[i]);
+    vm->sp -= argc;
+    vm->stack[vm->sp++] = r;
+    return TRUE;
+}
+
+// executes until HALT, stop or runtime error; returns the final state
+static ScriptState vm_exec(ScriptVm* vm, char* err, size_t err_len) {
+    const ScriptProgram* p = vm->prog;
+    const Insn* code = p->code;
+    ScriptValue* st = vm->stack;
+    int pc = 0;
+
+    for (;;) {
+        if (!vm_check_ctl(vm)) return SCRIPT_STOPPED;
+
+        for (int budget = VM_SLICE; budget > 0; --budget) {
+            const Insn in = code[pc++];
+            switch ((OpCode)in.op) {
+            case OP_CONST:
+                if (vm->sp >= VM_STACK_MAX) goto overflow;
+                st[vm->sp] = p->consts[in.arg];
+                value_retain(&st[vm->sp++]);
+                break;
+            case OP_LOAD:
+                if (vm->sp >= VM_STACK_MAX) goto overflow;
+                st[vm->sp] = vm->vars[in.arg];
+                value_retain(&st[vm->sp++]);
+                break;
+            case OP_STORE:
+                value_release(&vm->vars[in.arg]);
+                vm->vars[in.arg] = st[--vm->sp];
+                break;
+            case OP_POP:
+                value_release(&st[--vm->sp]);
+                break;
+            case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_MOD:
+            case OP_BAND: case OP_BOR: case OP_BXOR: case OP_SHL: case OP_SHR:
+            case OP_EQ: case OP_NE: case OP_LT: case OP_LE: case OP_GT: case OP_GE: {
+                ScriptValue* y = &st[vm->sp - 1];
+                const char* msg = value_binop(&vm->bufs, (OpCode)in.op, &st[vm->sp - 2], y);
+                if (msg) {
+                    insn_error(p, pc - 1, msg, err, err_len);
+                    return SCRIPT_ERROR;
+                }
+                value_release(y);
+                vm->sp--;
+                break;
+            }
+            case OP_NEG:
+            case OP_NOT:
+            case OP_TRUTH:
+                value_unary((OpCode)in.op, &st[vm->sp - 1]);
+                break;
+            case OP_JMP:
+                pc = in.arg;
+                break;
+            case OP_JZ: {
+                ScriptValue* x = &st[--vm->sp];
+                gboolean truth = x->type == VAL_INT ? x->i != 0 : x->len != 0;
+                value_release(x);
+                if (!truth) pc = in.arg;
+                break;
+            }
+            case OP_CALL: {
+                int bi = in.arg & 0xff;
+                char msg[200];
+                if (!vm_call(vm, bi, in.arg >> 8, msg, sizeof(msg))) {
+                    insn_error(p, pc - 1, msg, err, err_len);
+                    return SCRIPT_ERROR;
+                }
+                // sleep may have been interrupted by pause/stop
+                if (bi == BI_SLEEP) budget = 1;
+                break;
+            }
+            case OP_HALT:
+                return SCRIPT_STOPPED;
+            }
+        }
+    }
+
+overflow:
+    insn_error(p, pc - 1, "stack overflow", err, err_len);
+    return SCRIPT_ERROR;
+}
+
+static gpointer vm_thread(gpointer data) {
+    ScriptVm* vm = (ScriptVm*)data;
+    char err[256] = "";
+    gint64 t0 = g_get_monotonic_time();
+    ScriptState st = vm_exec(vm, err, sizeof(err));
+
+    // under the lock so a pause/resume in flight sees either RUNNING or the end
+    g_mutex_lock(&vm->lock);
+    gboolean stopped_by_user = g_atomic_int_get(&vm->ctl) == CTL_STOP;
+    g_atomic_int_set(&vm->state, st);
+    g_mutex_unlock(&vm->lock);
+    if (!stopped_by_user) {
+        if (st == SCRIPT_ERROR) {
+            vm_log(vm, "[SCRIPT] error: %s", err);
+            if (vm->host.state) vm->host.state(vm->host.user, SCRIPT_ERROR, err);
+        } else {
+            vm_log(vm, "[SCRIPT] finished in %.3f s", (double)(g_get_monotonic_time() - t0) / 1e6);
+            if (vm->host.state) vm->host.state(vm->host.user, SCRIPT_STOPPED, "finished");
+        }
+    }
+    return NULL;
+}
+
+gboolean script_vm_start(ScriptVm* vm, ScriptProgram* prog) {
+    if (!vm || !prog) {
+        script_program_free(prog);
+        return FALSE;
+    }
+    script_vm_stop(vm);
+    vm_reset(vm);
+
+    vm->prog = prog;
+    vm->vars = g_new0(ScriptValue, prog->nvars ? prog->nvars : 1);
+    vm->sp = 0;
+    // unseeded runs differ; rand_seed() makes them repeatable
+    rng_seed(&vm->rng, (uint64_t)g_get_real_time() ^ ((uint64_t)(uintptr_t)vm << 16));
+
+    g_atomic_int_set(&vm->ctl, CTL_RUN);
+    g_atomic_int_set(&vm->state, SCRIPT_RUNNING);
+    vm->thread = g_thread_new("script-vm", vm_thread, vm);
+    return TRUE;
+}
+
+static void vm_set_ctl(ScriptVm* vm, gint ctl) {
+    g_mutex_lock(&vm->lock);
+    g_atomic_int_set(&vm->ctl, ctl);
+    g_cond_broadcast(&vm->cond);
+    g_mutex_unlock(&vm->lock);
+}
+
+// state moves only from the expected value, so a program that has already
+// finished keeps its final state
+static gboolean vm_transition(ScriptVm* vm, ScriptState from, ScriptState to, gint ctl) {
+    if (!vm) return FALSE;
+    g_mutex_lock(&vm->lock);
+    gboolean ok = g_atomic_int_compare_and_exchange(&vm->state, from, to);
+    if (ok) {
+        g_atomic_int_set(&vm->ctl, ctl);
+        g_cond_broadcast(&vm->cond);
+    }
+    g_mutex_unlock(&vm->lock);
+    return ok;
+}
+
+gboolean script_vm_pause(ScriptVm* vm) {
+    return vm_transition(vm, SCRIPT_RUNNING, SCRIPT_PAUSED, CTL_PAUSE);
+}
+
+gboolean script_vm_resume(ScriptVm* vm) {
+    return vm_transition(vm, SCRIPT_PAUSED, SCRIPT_RUNNING, CTL_RUN);
+}
+
+void script_vm_stop(ScriptVm* vm) {
+    if (!vm || !vm->thread) return;
+    vm_set_ctl(vm, CTL_STOP);
+    g_thread_join(vm->thread);
+    vm->thread = NULL;
+    g_atomic_int_set(&vm->state, SCRIPT_STOPPED);
+}
+
+ScriptState script_vm_state(ScriptVm* vm) {
+    return vm ? (ScriptState)g_atomic_int_get(&vm->state) : SCRIPT_STOPPED;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "backend_api.h"
+#include "script_pp.h"
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Script engine: the DSL text is compiled once into bytecode (ScriptProgram),
+// then executed by ScriptVm on its own worker thread. Host callbacks are
+// invoked on that worker thread; the host must marshal to the UI itself.
+
+typedef struct ScriptProgram ScriptProgram;
+typedef struct ScriptVm ScriptVm;
+
+typedef gboolean (*script_send_fn)(void* user, const uint8_t* data, size_t len);
+typedef void (*script_log_fn)(void* user, const char* line);
+typedef void (*script_state_fn)(void* user, ScriptState st, const char* detail);
+
+typedef struct {
+    script_send_fn send;
+    script_log_fn log;
+    script_state_fn state;
+    void* user;
+} ScriptHost;
+
+// preprocess and compile script text. %include paths are relative to base_dir
+// (NULL = working directory) and are parsed once per file version in cache
+// (NULL = no reuse across compiles). Constant sub-expressions, including pure
+// builtins such as crc16("..."), are folded into single constants.
+// On failure returns NULL and writes "line N: reason" (or "path:N: reason"
+// inside an included file) to err.
+ScriptProgram* script_compile(const char* text, const char* base_dir, ScriptIncludeCache* cache,
+                              char* err, size_t err_len);
+void script_program_free(ScriptProgram* prog);
+
+ScriptVm* script_vm_new(const ScriptHost* host);
+void script_vm_free(ScriptVm* vm);
+
+// start executing prog on the worker thread (takes ownership of prog)
+gboolean script_vm_start(ScriptVm* vm, ScriptProgram* prog);
+
+// control; each takes effect within one instruction slice (or wakes a sleep).
+// pause/resume return FALSE when the program was not running/paused, which
+// includes one that finished just before the call
+gboolean script_vm_pause(ScriptVm* vm);
+gboolean script_vm_resume(ScriptVm* vm);
+void script_vm_stop(ScriptVm* vm);
+
+ScriptState script_vm_state(ScriptVm* vm);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,926 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE     // accept4()
+#endif
+#include "tcp_io.h"
+#include "pkt_ring.h"
+#include "event_log.h"
+#include "net_metrics.h"
+#include "hexfmt.h"
+#include <string.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#define TCP_USE_EPOLL 1
+#endif
+#endif
+
+// received messages buffered between the event loop and the main loop
+#define TCP_RING_SLOTS 2048
+// messages handed to the UI per frame
+#define TCP_UI_PER_FRAME 256
+// events handled per epoll_wait()
+#define TCP_EVENTS 256
+// bytes read per recv(); a connection gets at most TCP_READS_PER_EVENT reads per wake-up
+#define TCP_READ_CHUNK 65536
+#define TCP_READS_PER_EVENT 4
+// largest framed message; a longer length prefix closes the connection
+#define TCP_MAX_MSG (1u << 20)
+// per-connection send backlog before messages are dropped
+#define TCP_TX_MAX (4u << 20)
+
+typedef struct {
+    size_t len;
+    uint8_t data[];
+} TcpOut;
+
+typedef struct {
+    int fd;
+    gboolean connecting;    // client: non-blocking connect() still in progress
+    gboolean want_out;      // registered for writability
+    uint8_t* rx;            // partial message carried over between reads
+    size_t rx_len;
+    size_t rx_cap;
+    uint8_t* tx;            // bytes the kernel did not take yet
+    size_t tx_off;
+    size_t tx_len;
+    size_t tx_cap;
+    // written by the event loop only: traffic fields with NET_COUNT, so other
+    // threads read them atomically; id, peer and opened_us under io->lock
+    TcpConnStats st;
+} TcpConn;
+
+// what one loop iteration received; summarized in a single log event
+typedef struct {
+    unsigned count;
+    size_t bytes;
+    UdpPeer last_from;
+} TcpRxSummary;
+
+struct TcpIo {
+    tcp_msg_fn msg_cb;
+    void* msg_user;
+
+    // event loop -> main loop hand-off (msg_cb only ever runs on the main loop)
+    PktRing* ring;
+    GSource* ring_src;
+
+    char* local_ip;
+    char* target_ip;
+    int local_port;
+    int target_port;
+    gboolean server;
+    int clients;
+    NetFraming framing;
+    uint8_t delim;
+
+    GMutex lock;            // config, outq, conns (membership) and thread
+    GQueue outq;            // TcpOut* waiting for the event loop
+    GPtrArray* conns;       // TcpConn*, owned by the event loop
+    GThread* thread;
+    gboolean stop;
+    guint next_id;
+    TcpConnStats closed;    // summed counters of connections closed since tcp_io_open
+    NetCounters ctr;        // drops and errors since tcp_io_open (packets/bytes live in st)
+
+    int listen_fd;
+    int ep;
+    int wake_rd;
+    int wake_wr;
+};
+
+static void ring_drain_cb(void* user, const PktDesc* pkt) {
+    TcpIo* io = (TcpIo*)user;
+    if (pkt->len > 0 && io->msg_cb) io->msg_cb(io->msg_user, pkt->data, pkt->len, &pkt->from, pkt->ts_us);
+}
+
+static void ring_overflow_cb(void* user, guint dropped) {
+    (void)user;
+    EVLOG("[TCP] display ring full: %u messages not shown", dropped);
+}
+
+TcpIo* tcp_io_new(tcp_msg_fn msg_cb, void* msg_user) {
+    TcpIo* io = g_new0(TcpIo, 1);
+    io->msg_cb = msg_cb;
+    io->msg_user = msg_user;
+    io->listen_fd = -1;
+    io->ep = -1;
+    io->wake_rd = -1;
+    io->wake_wr = -1;
+    io->clients = 1;
+    io->delim = '\n';
+    g_mutex_init(&io->lock);
+    g_queue_init(&io->outq);
+    io->conns = g_ptr_array_new();
+
+    if (msg_cb) {
+        io->ring = pkt_ring_new(TCP_RING_SLOTS);
+        io->ring_src = pkt_ring_source_new(io->ring, TCP_UI_PER_FRAME, ring_drain_cb, ring_overflow_cb, io);
+        g_source_attach(io->ring_src, NULL);
+    }
+    return io;
+}
+
+static void cfg_clear(TcpIo* io) {
+    g_free(io->local_ip); io->local_ip = NULL;
+    g_free(io->target_ip); io->target_ip = NULL;
+}
+
+gboolean tcp_io_apply_config(TcpIo* io, const NetConfig* cfg) {
+    if (!io || !cfg) return FALSE;
+    g_mutex_lock(&io->lock);
+    cfg_clear(io);
+    io->local_ip = g_strdup(cfg->local_ip ? cfg->local_ip : "0.0.0.0");
+    io->target_ip = g_strdup(cfg->target_ip ? cfg->target_ip : "127.0.0.1");
+    io->local_port = cfg->local_port;
+    io->target_port = cfg->target_port;
+    io->server = cfg->tcp_server != 0;
+    io->clients = cfg->tcp_clients > 0 ? cfg->tcp_clients : 1;
+    io->framing = cfg->framing;
+    io->delim = (uint8_t)cfg->frame_delim;
+    g_mutex_unlock(&io->lock);
+    return TRUE;
+}
+
+guint tcp_io_conn_count(TcpIo* io) {
+    if (!io) return 0;
+    g_mutex_lock(&io->lock);
+    guint n = io->conns->len;
+    g_mutex_unlock(&io->lock);
+    return n;
+}
+
+#define STAT_GET(st, field) ((gsize)g_atomic_pointer_get((gsize*)&(st)->field))
+
+// the event loop may be adding to st meanwhile
+static void stats_add(TcpConnStats* sum, const TcpConnStats* st) {
+    sum->bytes_in += STAT_GET(st, bytes_in);
+    sum->bytes_out += STAT_GET(st, bytes_out);
+    sum->msgs_in += STAT_GET(st, msgs_in);
+    sum->msgs_out += STAT_GET(st, msgs_out);
+    sum->tx_dropped += STAT_GET(st, tx_dropped);
+}
+
+void tcp_io_counters(TcpIo* io, NetTotals* out) {
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    if (!io) return;
+    g_mutex_lock(&io->lock);
+    TcpConnStats sum = io->closed;
+    for (guint i = 0; i < io->conns->len; ++i) stats_add(&sum, &((TcpConn*)g_ptr_array_index(io->conns, i))->st);
+    g_mutex_unlock(&io->lock);
+    out->rx_packets = sum.msgs_in;
+    out->rx_bytes = sum.bytes_in;
+    out->tx_packets = sum.msgs_out;
+    out->tx_bytes = sum.bytes_out;
+    out->tx_dropped = sum.tx_dropped;
+    net_counters_read(&io->ctr, out);
+}
+
+guint tcp_io_conn_stats(TcpIo* io, TcpConnStats* out, guint max) {
+    if (!io || !out) return 0;
+    g_mutex_lock(&io->lock);
+    guint n = MIN(max, io->conns->len);
+    for (guint i = 0; i < n; ++i) {
+        const TcpConnStats* st = &((TcpConn*)g_ptr_array_index(io->conns, i))->st;
+        memset(&out[i], 0, sizeof(out[i]));
+        out[i].id = st->id;
+        out[i].peer = st->peer;
+        out[i].opened_us = st->opened_us;
+        stats_add(&out[i], st);
+    }
+    g_mutex_unlock(&io->lock);
+    return n;
+}
+
+#ifndef _WIN32
+
+// room for one outgoing message of up to cap payload bytes: write the
+// payload at out_payload(), then out_frame() adds the framing
+static TcpOut* out_alloc(NetFraming framing, size_t cap) {
+    size_t extra = framing == NET_FRAME_LEN32 ? 4 : framing == NET_FRAME_DELIM ? 1 : 0;
+    return g_malloc(sizeof(TcpOut) + cap + extra);
+}
+
+static uint8_t* out_payload(TcpOut* o, NetFraming framing) {
+    return o->data + (framing == NET_FRAME_LEN32 ? 4 : 0);
+}
+
+static void out_frame(TcpOut* o, NetFraming framing, uint8_t delim, size_t len) {
+    o->len = len;
+    if (framing == NET_FRAME_LEN32) {
+        o->data[0] = (uint8_t)(len >> 24);
+        o->data[1] = (uint8_t)(len >> 16);
+        o->data[2] = (uint8_t)(len >> 8);
+        o->data[3] = (uint8_t)len;
+        o->len += 4;
+    } else if (framing == NET_FRAME_DELIM) {
+        o->data[o->len++] = delim;
+    }
+}
+
+// framed copy of one outgoing message
+static TcpOut* out_new(NetFraming framing, uint8_t delim, const uint8_t* data, size_t len) {
+    TcpOut* o = out_alloc(framing, len);
+    memcpy(out_payload(o, framing), data, len);
+    out_frame(o, framing, delim, len);
+    return o;
+}
+
+static gboolean wake_open(TcpIo* io) {
+#ifdef __linux__
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0) return FALSE;
+    io->wake_rd = io->wake_wr = fd;
+#else
+    int fds[2];
+    if (pipe(fds) < 0) return FALSE;
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL, 0) | O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL, 0) | O_NONBLOCK);
+    io->wake_rd = fds[0];
+    io->wake_wr = fds[1];
+#endif
+    return TRUE;
+}
+
+static void wake_signal(TcpIo* io) {
+    if (io->wake_wr < 0) return;
+#ifdef __linux__
+    uint64_t one = 1;
+    ssize_t r = write(io->wake_wr, &one, sizeof(one));
+#else
+    char c = 1;
+    ssize_t r = write(io->wake_wr, &c, 1);
+#endif
+    (void)r;
+}
+
+static void wake_drain(TcpIo* io) {
+    uint8_t buf[64];
+    while (read(io->wake_rd, buf, sizeof(buf)) > 0) {
+    }
+}
+
+static void wake_close(TcpIo* io) {
+    if (io->wake_rd >= 0) close(io->wake_rd);
+    if (io->wake_wr >= 0 && io->wake_wr != io->wake_rd) close(io->wake_wr);
+    io->wake_rd = io->wake_wr = -1;
+}
+
+// --- poller: epoll on Linux, a rebuilt pollfd set elsewhere ---------------
+
+// epoll user data for the two non-connection fds
+static char tag_wake, tag_listen;
+
+static void poll_add(TcpIo* io, int fd, void* tag, gboolean out) {
+#ifdef TCP_USE_EPOLL
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP | (out ? EPOLLOUT : 0), .data.ptr = tag };
+    epoll_ctl(io->ep, EPOLL_CTL_ADD, fd, &ev);
+#else
+    (void)io; (void)fd; (void)tag; (void)out;
+#endif
+}
+
+static void conn_want_out(TcpIo* io, TcpConn* c, gboolean out) {
+    if (c->want_out == out) return;
+    c->want_out = out;
+#ifdef TCP_USE_EPOLL
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP | (out ? EPOLLOUT : 0), .data.ptr = c };
+    epoll_ctl(io->ep, EPOLL_CTL_MOD, c->fd, &ev);
+#else
+    (void)io;
+#endif
+}
+
+static void sock_tune(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+// --- connections (event-loop thread only) ---------------------------------
+
+static TcpConn* conn_add(TcpIo* io, int fd, const struct sockaddr_in* peer, gboolean connecting) {
+    TcpConn* c = g_new0(TcpConn, 1);
+    c->fd = fd;
+    c->connecting = connecting;
+    c->st.peer.addr = peer->sin_addr.s_addr;
+    c->st.peer.port = peer->sin_port;
+    c->st.opened_us = g_get_real_time();
+    g_mutex_lock(&io->lock);
+    c->st.id = ++io->next_id;
+    g_ptr_array_add(io->conns, c);
+    g_mutex_unlock(&io->lock);
+    c->want_out = connecting;
+    poll_add(io, fd, c, connecting);
+    return c;
+}
+
+static void conn_close(TcpIo* io, TcpConn* c, const char* why) {
+    if (!c->connecting) {
+        EVLOG("[TCP] #%u %a closed (%s), %zu messages dropped", c->st.id, EV_PEER(&c->st.peer),
+              EV_STR(why), c->st.tx_dropped);
+        EVLOG("[TCP] #%u in %zu bytes/%zu msgs, out %zu bytes/%zu msgs", c->st.id,
+              c->st.bytes_in, c->st.msgs_in, c->st.bytes_out, c->st.msgs_out);
+    } else {
+        EVLOG("[TCP] #%u connect to %a failed (%s)", c->st.id, EV_PEER(&c->st.peer), EV_STR(why));
+    }
+    // closing the fd also removes it from the epoll set
+    close(c->fd);
+    g_mutex_lock(&io->lock);
+    g_ptr_array_remove_fast(io->conns, c);
+    stats_add(&io->closed, &c->st);
+    g_mutex_unlock(&io->lock);
+    g_free(c->rx);
+    g_free(c->tx);
+    g_free(c);
+}
+
+static void deliver(TcpIo* io, TcpConn* c, TcpRxSummary* sum, const uint8_t* data, size_t len, gint64 ts_us) {
+    sum->count++;
+    sum->bytes += len;
+    sum->last_from = c->st.peer;
+    if (len == 0 || !io->ring) return;
+
+    // never block here: a full ring drops the message and counts it
+    PktDesc* d = pkt_ring_reserve(io->ring);
+    if (!d) {
+        NET_COUNT(&io->ctr, rx_dropped, 1);
+        return;
+    }
+    d->ts_us = ts_us;
+    d->from = c->st.peer;
+    d->len = (uint32_t)MIN(len, (size_t)PKT_RING_SLOT);
+    d->truncated = len > PKT_RING_SLOT;
+    if (d->truncated) NET_COUNT(&io->ctr, rx_truncated, 1);
+    memcpy(d->data, data, d->len);
+}
+
+// split p[0..n) into messages; returns bytes consumed or -1 on a framing error
+static gssize frame_split(TcpIo* io, TcpConn* c, TcpRxSummary* sum, const uint8_t* p, size_t n, gint64 ts_us) {
+    size_t off = 0;
+    if (io->framing == NET_FRAME_LEN32) {
+        while (n - off >= 4) {
+            size_t len = (size_t)p[off] << 24 | (size_t)p[off + 1] << 16 | (size_t)p[off + 2] << 8 | p[off + 3];
+            if (len > TCP_MAX_MSG) return -1;
+            if (n - off - 4 < len) break;
+            deliver(io, c, sum, p + off + 4, len, ts_us);
+            off += 4 + len;
+        }
+    } else if (io->framing == NET_FRAME_DELIM) {
+        const uint8_t* e;
+        while ((e = memchr(p + off, io->delim, n - off)) != NULL) {
+            deliver(io, c, sum, p + off, (size_t)(e - (p + off)), ts_us);
+            off = (size_t)(e - p) + 1;
+        }
+        // an unterminated run this long is passed on as it is
+        if (n - off >= TCP_MAX_MSG) {
+            deliver(io, c, sum, p + off, n - off, ts_us);
+            off = n;
+        }
+    } else {
+        deliver(io, c, sum, p, n, ts_us);
+        off = n;
+    }
+    return (gssize)off;
+}
+
+static gboolean conn_input(TcpIo* io, TcpConn* c, TcpRxSummary* sum, const uint8_t* buf, size_t n, gint64 ts_us) {
+    NET_COUNT(&c->st, bytes_in, n);
+    const uint8_t* p = buf;
+    size_t len = n;
+    if (c->rx_len > 0) {
+        // finish the carried-over partial message first
+        if (c->rx_len + n > c->rx_cap) {
+            c->rx_cap = MAX(c->rx_cap * 2, c->rx_len + n);
+            c->rx = g_realloc(c->rx, c->rx_cap);
+        }
+        memcpy(c->rx + c->rx_len, buf, n);
+        c->rx_len += n;
+        p = c->rx;
+        len = c->rx_len;
+    }
+
+    // messages counted once per read, not per message
+    unsigned before = sum->count;
+    gssize used = frame_split(io, c, sum, p, len, ts_us);
+    NET_COUNT(&c->st, msgs_in, sum->count - before);
+    if (used < 0) return FALSE;
+
+    size_t rest = len - (size_t)used;
+    if (rest > 0 && p == buf) {
+        if (rest > c->rx_cap) {
+            c->rx_cap = MAX(rest, (size_t)4096);
+            c->rx = g_realloc(c->rx, c->rx_cap);
+        }
+        memcpy(c->rx, buf + used, rest);
+    } else if (rest > 0 && used > 0) {
+        memmove(c->rx, c->rx + used, rest);
+    }
+    c->rx_len = rest;
+    return TRUE;
+}
+
+// returns FALSE when the connection is finished
+static gboolean conn_read(TcpIo* io, TcpConn* c, TcpRxSummary* sum, uint8_t* buf, const char** why) {
+    for (int k = 0; k < TCP_READS_PER_EVENT; ++k) {
+        ssize_t r = recv(c->fd, buf, TCP_READ_CHUNK, 0);
+        if (r > 0) {
+            if (!conn_input(io, c, sum, buf, (size_t)r, g_get_real_time())) {
+                *why = "bad length prefix";
+                NET_COUNT(&io->ctr, rx_errors, 1);
+                return FALSE;
+            }
+            if (r < TCP_READ_CHUNK) return TRUE;
+            continue;
+        }
+        if (r == 0) {
+            *why = "peer closed";
+            return FALSE;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return TRUE;
+        *why = g_strerror(errno);
+        NET_COUNT(&io->ctr, rx_errors, 1);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// write as much of the backlog as the kernel takes
+static gboolean conn_flush(TcpIo* io, TcpConn* c, const char** why) {
+    while (c->tx_off < c->tx_len) {
+        ssize_t w = send(c->fd, c->tx + c->tx_off, c->tx_len - c->tx_off, MSG_NOSIGNAL);
+        if (w > 0) {
+            c->tx_off += (size_t)w;
+            NET_COUNT(&c->st, bytes_out, w);
+            continue;
+        }
+        if (w < 0 && errno == EINTR) continue;
+        if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        *why = w < 0 ? g_strerror(errno) : "send failed";
+        NET_COUNT(&io->ctr, tx_errors, 1);
+        return FALSE;
+    }
+    if (c->tx_off == c->tx_len) c->tx_off = c->tx_len = 0;
+    conn_want_out(io, c, c->tx_len > 0);
+    return TRUE;
+}
+
+// o holds nmsgs framed messages back to back
+static gboolean conn_queue(TcpIo* io, TcpConn* c, const TcpOut* o, guint nmsgs, const char** why) {
+    size_t pending = c->tx_len - c->tx_off;
+    if (pending + o->len > TCP_TX_MAX) {
+        NET_COUNT(&c->st, tx_dropped, nmsgs);
+        return TRUE;
+    }
+    NET_COUNT(&c->st, msgs_out, nmsgs);
+    const uint8_t* p = o->data;
+    size_t len = o->len;
+    if (pending == 0 && !c->connecting) {
+        // common case: nothing queued, hand the message straight to the kernel
+        while (len > 0) {
+            ssize_t w = send(c->fd, p, len, MSG_NOSIGNAL);
+            if (w > 0) {
+                p += w;
+                len -= (size_t)w;
+                NET_COUNT(&c->st, bytes_out, w);
+                continue;
+            }
+            if (w < 0 && errno == EINTR) continue;
+            if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            *why = w < 0 ? g_strerror(errno) : "send failed";
+            NET_COUNT(&io->ctr, tx_errors, 1);
+            return FALSE;
+        }
+        if (len == 0) return TRUE;
+    }
+    if (c->tx_off > 0 && c->tx_off == c->tx_len) c->tx_off = c->tx_len = 0;
+    if (c->tx_len + len > c->tx_cap) {
+        if (c->tx_off > 0) {
+            memmove(c->tx, c->tx + c->tx_off, c->tx_len - c->tx_off);
+            c->tx_len -= c->tx_off;
+            c->tx_off = 0;
+        }
+        if (c->tx_len + len > c->tx_cap) {
+            c->tx_cap = MAX(c->tx_cap * 2, c->tx_len + len);
+            c->tx = g_realloc(c->tx, c->tx_cap);
+        }
+    }
+    memcpy(c->tx + c->tx_len, p, len);
+    c->tx_len += len;
+    if (!c->connecting) conn_want_out(io, c, TRUE);
+    return TRUE;
+}
+
+// client: a non-blocking connect() completed (or failed)
+static gboolean conn_connected(TcpIo* io, TcpConn* c, const char** why) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0) err = errno;
+    if (err) {
+        *why = g_strerror(err);
+        NET_COUNT(&io->ctr, tx_errors, 1);
+        return FALSE;
+    }
+    c->connecting = FALSE;
+    g_mutex_lock(&io->lock);
+    c->st.opened_us = g_get_real_time();
+    g_mutex_unlock(&io->lock);
+    EVLOG("[TCP] #%u connected to %a", c->st.id, EV_PEER(&c->st.peer));
+    return conn_flush(io, c, why);
+}
+
+static void accept_all(TcpIo* io) {
+    while (TRUE) {
+        struct sockaddr_in peer;
+        socklen_t plen = sizeof(peer);
+#ifdef __linux__
+        int fd = accept4(io->listen_fd, (struct sockaddr*)&peer, &plen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+        int fd = accept(io->listen_fd, (struct sockaddr*)&peer, &plen);
+#endif
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) EVLOG("[TCP] accept failed: errno=%d", errno);
+            return;
+        }
+        sock_tune(fd);
+        TcpConn* c = conn_add(io, fd, &peer, FALSE);
+        EVLOG("[TCP] #%u accepted from %a", c->st.id, EV_PEER(&c->st.peer));
+    }
+}
+
+// hand every queued message to every connected peer; messages queued since
+// the last wake-up are coalesced so each connection costs one send()
+static void outq_drain(TcpIo* io) {
+    g_mutex_lock(&io->lock);
+    GQueue q = io->outq;
+    g_queue_init(&io->outq);
+    g_mutex_unlock(&io->lock);
+    if (g_queue_is_empty(&q)) return;
+
+    guint nmsgs = q.length;
+    TcpOut* all = g_queue_pop_head(&q);
+    if (nmsgs > 1) {
+        size_t total = all->len;
+        for (GList* l = q.head; l; l = l->next) total += ((TcpOut*)l->data)->len;
+        all = g_realloc(all, sizeof(TcpOut) + total);
+        TcpOut* o;
+        while ((o = g_queue_pop_head(&q)) != NULL) {
+            memcpy(all->data + all->len, o->data, o->len);
+            all->len += o->len;
+            g_free(o);
+        }
+    }
+
+    for (guint i = 0; i < io->conns->len;) {
+        TcpConn* c = g_ptr_array_index(io->conns, i);
+        const char* why = NULL;
+        if (!conn_queue(io, c, all, nmsgs, &why)) {
+            conn_close(io, c, why);     // removal moves the last entry into slot i
+            continue;
+        }
+        ++i;
+    }
+    g_free(all);
+}
+
+// one event for a connection; FALSE when it has to be closed
+static gboolean conn_event(TcpIo* io, TcpConn* c, gboolean in, gboolean out, gboolean err,
+                           TcpRxSummary* sum, uint8_t* buf, const char** why) {
+    if (c->connecting) {
+        if (!out && !err) return TRUE;
+        return conn_connected(io, c, why);
+    }
+    if (in && !conn_read(io, c, sum, buf, why)) return FALSE;
+    if (out && !conn_flush(io, c, why)) return FALSE;
+    if (err && !in) {
+        *why = "socket error";
+        NET_COUNT(&io->ctr, rx_errors, 1);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void rx_log_summary(const TcpRxSummary* sum) {
+    if (sum->count == 0) return;
+    if (sum->count == 1) {
+        EVLOG("[TCP] %zu bytes from %a", sum->bytes, EV_PEER(&sum->last_from));
+    } else {
+        EVLOG("[TCP] %u messages, %zu bytes, last from %a", sum->count, sum->bytes, EV_PEER(&sum->last_from));
+    }
+}
+
+static gpointer loop_thread(gpointer data) {
+    TcpIo* io = (TcpIo*)data;
+    uint8_t* buf = g_malloc(TCP_READ_CHUNK);
+#ifdef TCP_USE_EPOLL
+    struct epoll_event evs[TCP_EVENTS];
+#else
+    struct pollfd* pfds = NULL;
+    TcpConn** pconn = NULL;
+    guint pcap = 0;
+#endif
+
+    while (!g_atomic_int_get(&io->stop)) {
+        TcpRxSummary sum;
+        memset(&sum, 0, sizeof(sum));
+        gboolean woke = FALSE;
+
+#ifdef TCP_USE_EPOLL
+        int n = epoll_wait(io->ep, evs, TCP_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            EVLOG("[TCP] epoll_wait failed: errno=%d", errno);
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            void* tag = evs[i].data.ptr;
+            uint32_t e = evs[i].events;
+            if (tag == &tag_wake) {
+                woke = TRUE;
+            } else if (tag == &tag_listen) {
+                accept_all(io);
+            } else {
+                TcpConn* c = (TcpConn*)tag;
+                const char* why = NULL;
+                if (!conn_event(io, c, (e & EPOLLIN) != 0, (e & EPOLLOUT) != 0,
+                                (e & (EPOLLERR | EPOLLHUP)) != 0, &sum, buf, &why)) {
+                    conn_close(io, c, why);
+                }
+            }
+        }
+#else
+        // fallback: rebuild the pollfd set every iteration
+        guint need = io->conns->len + 2;
+        if (need > pcap) {
+            pcap = need * 2;
+            pfds = g_renew(struct pollfd, pfds, pcap);
+            pconn = g_renew(TcpConn*, pconn, pcap);
+        }
+        guint np = 0;
+        pfds[np] = (struct pollfd){ .fd = io->wake_rd, .events = POLLIN };
+        pconn[np++] = NULL;
+        if (io->listen_fd >= 0) {
+            pfds[np] = (struct pollfd){ .fd = io->listen_fd, .events = POLLIN };
+            pconn[np++] = NULL;
+        }
+        for (guint i = 0; i < io->conns->len; ++i) {
+            TcpConn* c = g_ptr_array_index(io->conns, i);
+            pfds[np] = (struct pollfd){ .fd = c->fd, .events = POLLIN | (c->want_out ? POLLOUT : 0) };
+            pconn[np++] = c;
+        }
+        if (poll(pfds, np, -1) < 0) {
+            if (errno == EINTR) continue;
+            EVLOG("[TCP] poll failed: errno=%d", errno);
+            break;
+        }
+        if (pfds[0].revents) woke = TRUE;
+        if (io->listen_fd >= 0 && pfds[1].revents) accept_all(io);
+        for (guint i = io->listen_fd >= 0 ? 2 : 1; i < np; ++i) {
+            short e = pfds[i].revents;
+            if (!e) continue;
+            const char* why = NULL;
+            if (!conn_event(io, pconn[i], (e & POLLIN) != 0, (e & POLLOUT) != 0,
+                            (e & (POLLERR | POLLHUP)) != 0, &sum, buf, &why)) {
+                conn_close(io, pconn[i], why);
+            }
+        }
+#endif
+        if (io->ring) pkt_ring_publish(io->ring);
+        rx_log_summary(&sum);
+        if (woke) {
+            wake_drain(io);
+            outq_drain(io);
+        }
+    }
+
+    while (io->conns->len > 0) conn_close(io, g_ptr_array_index(io->conns, io->conns->len - 1), "closed locally");
+#ifndef TCP_USE_EPOLL
+    g_free(pfds);
+    g_free(pconn);
+#endif
+    g_free(buf);
+    return NULL;
+}
+
+// many client sockets need more descriptors than the usual soft limit of 1024
+static void raise_fd_limit(guint need) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0 || rl.rlim_cur >= need) return;
+    rl.rlim_cur = rl.rlim_max == RLIM_INFINITY || rl.rlim_max >= need ? need : rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+}
+
+static int listen_open(TcpIo* io) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)io->local_port);
+    inet_pton(AF_INET, io->local_ip, &addr.sin_addr);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
+}
+
+// start tcp_clients non-blocking connects; returns how many are in flight
+static guint clients_open(TcpIo* io) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)io->target_port);
+    inet_pton(AF_INET, io->target_ip, &addr.sin_addr);
+
+    raise_fd_limit((guint)io->clients + 64);
+    guint opened = 0;
+    for (int i = 0; i < io->clients; ++i) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) {
+            EVLOG("[TCP] socket() failed after %u clients: errno=%d", opened, errno);
+            break;
+        }
+        sock_tune(fd);
+        if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+            UdpPeer to = { addr.sin_addr.s_addr, addr.sin_port };
+            EVLOG("[TCP] connect to %a failed: errno=%d", EV_PEER(&to), errno);
+            NET_COUNT(&io->ctr, tx_errors, 1);
+            close(fd);
+            break;
+        }
+        conn_add(io, fd, &addr, TRUE);
+        opened++;
+    }
+    return opened;
+}
+
+gboolean tcp_io_open(TcpIo* io) {
+    if (!io) return FALSE;
+    tcp_io_close(io);
+    g_mutex_lock(&io->lock);
+    memset(&io->closed, 0, sizeof(io->closed));
+    net_counters_reset(&io->ctr);
+    g_mutex_unlock(&io->lock);
+
+#ifdef TCP_USE_EPOLL
+    io->ep = epoll_create1(EPOLL_CLOEXEC);
+    if (io->ep < 0) {
+        EVLOG("[TCP] epoll_create1 failed: errno=%d", errno);
+        return FALSE;
+    }
+#endif
+    if (!wake_open(io)) {
+        EVLOG("[TCP] create wake fd failed");
+        tcp_io_close(io);
+        return FALSE;
+    }
+    poll_add(io, io->wake_rd, &tag_wake, FALSE);
+
+    // the loop thread is not running yet, so the connection table is ours
+    if (io->server) {
+        io->listen_fd = listen_open(io);
+        if (io->listen_fd < 0) {
+            EVLOG("[TCP] listen failed on %S:%d: errno=%d", EV_DUP(io->local_ip), io->local_port, errno);
+            tcp_io_close(io);
+            return FALSE;
+        }
+        poll_add(io, io->listen_fd, &tag_listen, FALSE);
+        EVLOG("[TCP] listening on %S:%d (framing %d)", EV_DUP(io->local_ip), io->local_port, (int)io->framing);
+    } else {
+        guint n = clients_open(io);
+        if (n == 0) {
+            tcp_io_close(io);
+            return FALSE;
+        }
+        EVLOG("[TCP] connecting %u client(s) to %S:%d (framing %d)", n, EV_DUP(io->target_ip),
+              io->target_port, (int)io->framing);
+    }
+
+    g_mutex_lock(&io->lock);
+    io->stop = FALSE;
+    io->thread = g_thread_new("tcp-loop", loop_thread, io);
+    g_mutex_unlock(&io->lock);
+    return TRUE;
+}
+
+void tcp_io_close(TcpIo* io) {
+    if (!io) return;
+    g_mutex_lock(&io->lock);
+    GThread* th = io->thread;
+    io->thread = NULL;
+    g_atomic_int_set(&io->stop, TRUE);
+    wake_signal(io);
+    g_mutex_unlock(&io->lock);
+    if (th) g_thread_join(th);
+
+    // connections opened before the loop started (failed open) are closed here
+    while (io->conns->len > 0) conn_close(io, g_ptr_array_index(io->conns, io->conns->len - 1), "closed locally");
+    if (io->listen_fd >= 0) close(io->listen_fd);
+    io->listen_fd = -1;
+    if (io->ep >= 0) close(io->ep);
+    io->ep = -1;
+    wake_close(io);
+
+    g_mutex_lock(&io->lock);
+    TcpOut* o;
+    while ((o = g_queue_pop_head(&io->outq)) != NULL) g_free(o);
+    g_mutex_unlock(&io->lock);
+}
+
+gboolean tcp_io_send(TcpIo* io, const uint8_t* data, size_t len, int is_hex_mode) {
+    if (!io) return FALSE;
+    if (!data) { EVLOG("[SEND] empty payload skipped"); return FALSE; }
+
+    if (!is_hex_mode && len > TCP_MAX_MSG) {
+        EVLOG("[SEND] message exceeds %u bytes", TCP_MAX_MSG);
+        return FALSE;
+    }
+
+    g_mutex_lock(&io->lock);
+    NetFraming framing = io->framing;
+    uint8_t delim = io->delim;
+    g_mutex_unlock(&io->lock);
+
+    TcpOut* o;
+    if (is_hex_mode) {
+        // decode straight into the message; two digits per byte at most
+        size_t cap = MIN(len / 2, (size_t)TCP_MAX_MSG);
+        size_t err_off = 0;
+        o = out_alloc(framing, cap);
+        HexDecodeStatus st = hex_decode(out_payload(o, framing), cap, (const char*)data, len, &len, &err_off);
+        if (st != HEX_DECODE_OK) {
+            hex_decode_log(st, (const char*)data, err_off, TCP_MAX_MSG);
+            g_free(o);
+            return FALSE;
+        }
+        out_frame(o, framing, delim, len);
+    } else {
+        o = out_new(framing, delim, data, len);
+    }
+
+    g_mutex_lock(&io->lock);
+    gboolean running = io->thread != NULL;
+    guint conns = io->conns->len;
+    if (running) g_queue_push_tail(&io->outq, o);
+    wake_signal(io);
+    g_mutex_unlock(&io->lock);
+
+    if (!running) {
+        g_free(o);
+        EVLOG("[SEND] TCP not open; apply config first");
+        return FALSE;
+    }
+    EVLOG("[SEND] TCP len=%zu mode=%s -> %u connection(s)", len, EV_STR(is_hex_mode ? "HEX" : "ASCII"), conns);
+    return TRUE;
+}
+
+#else   // _WIN32
+
+gboolean tcp_io_open(TcpIo* io) {
+    (void)io;
+    EVLOG("[TCP] not supported on Windows yet");
+    return FALSE;
+}
+
+void tcp_io_close(TcpIo* io) {
+    (void)io;
+}
+
+gboolean tcp_io_send(TcpIo* io, const uint8_t* data, size_t len, int is_hex_mode) {
+    (void)io; (void)data; (void)len; (void)is_hex_mode;
+    EVLOG("[SEND] TCP not supported on Windows yet");
+    return FALSE;
+}
+
+#endif
+
+void tcp_io_free(TcpIo* io) {
+    if (!io) return;
+    tcp_io_close(io);
+    if (io->ring_src) {
+        g_source_destroy(io->ring_src);
+        g_source_unref(io->ring_src);
+    }
+    pkt_ring_free(io->ring);
+    g_ptr_array_free(io->conns, TRUE);
+    cfg_clear(io);
+    g_mutex_clear(&io->lock);
+    g_free(io);
+}
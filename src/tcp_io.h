@@ -0,0 +1,58 @@
+#pragma once
+#include "backend_api.h"
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// TCP counterpart of UdpIo. One event-loop thread (epoll on Linux, poll()
+// elsewhere) owns the listening socket and every connection, so thousands of
+// concurrent connections cost one thread. In client mode tcp_clients
+// connections are opened to the target at once, which makes soak tests from a
+// single process possible. Received bytes are split into messages according
+// to NetConfig.framing and handed to the main loop like UDP datagrams.
+
+// msg_fn is always invoked on the main loop, never on the event-loop thread
+typedef void (*tcp_msg_fn)(void* user, const uint8_t* data, size_t len,
+                           const UdpPeer* from, int64_t ts_us);
+
+typedef struct TcpIo TcpIo;
+
+// per-connection counters, kept by the event loop. The traffic fields are
+// pointer-sized like NetCounters, so on 32-bit builds they wrap at 4 GiB.
+typedef struct {
+    guint id;
+    UdpPeer peer;
+    gint64 opened_us;       // g_get_real_time() when connected/accepted
+    gsize bytes_in;
+    gsize bytes_out;
+    gsize msgs_in;
+    gsize msgs_out;
+    gsize tx_dropped;       // messages not queued because the send buffer was full
+} TcpConnStats;
+
+// status and errors are recorded in the event log (event_log.h)
+TcpIo* tcp_io_new(tcp_msg_fn msg_cb, void* msg_user);
+void tcp_io_free(TcpIo* io);
+
+// store/copy config (strings are duplicated)
+gboolean tcp_io_apply_config(TcpIo* io, const NetConfig* cfg);
+
+// server: listen on local_ip:local_port; client: connect tcp_clients sockets to the target
+gboolean tcp_io_open(TcpIo* io);
+void tcp_io_close(TcpIo* io);
+
+// queue one message (framed per config) to every open connection; any thread
+gboolean tcp_io_send(TcpIo* io, const uint8_t* data, size_t len, int is_hex_mode);
+
+guint tcp_io_conn_count(TcpIo* io);
+// copy up to max connection stats; returns how many were written
+guint tcp_io_conn_stats(TcpIo* io, TcpConnStats* out, guint max);
+// traffic counters since tcp_io_open, summed over every connection including
+// closed ones; packets are framed messages. Any thread.
+void tcp_io_counters(TcpIo* io, NetTotals* out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,10 +1,18 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE     // recvmmsg(), sendmmsg(), pthread_setaffinity_np()
+#endif
 #include "udp_io.h"
+#include "pkt_ring.h"
+#include "event_log.h"
+#include "hexfmt.h"
+#include "pcapng_writer.h"
+#include "net_metrics.h"
+#include "rtt_probe.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
 #include <ctype.h>
-#include <stdarg.h>
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -18,70 +26,184 @@
 #include <sys/socket.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#endif
 #define closesocket close
 #endif
 
-struct UdpIo {
-    udp_log_fn log_cb;
-    void* log_user;
+// bytes per receive buffer; larger datagrams are reported as truncated
+#define UDP_RX_SLOT 2048
+#define UDP_RX_BATCH_DEFAULT 32
+#define UDP_RX_BATCH_MAX 256
+// datagrams handed to one sendmmsg() call
+#define UDP_TX_BATCH 64
+// received datagrams buffered between the receive threads and the main loop,
+// and handed to the UI per frame; both are split evenly between shards
+#define UDP_RING_SLOTS 2048
+#define UDP_UI_PER_FRAME 256
+// largest IPv4 UDP payload; hex input is decoded into a per-thread buffer this size
+#define UDP_MAX_PAYLOAD 65507
+
+// SO_REUSEPORT spreads datagrams over the shard sockets by flow hash; other
+// systems either lack it or do not balance, so they always use one socket
+#if defined(__linux__) && defined(SO_REUSEPORT)
+#define UDP_HAVE_SHARDS 1
+#endif
+
+// kernel (and NIC) timestamps for the RTT probe; elsewhere it uses clock_gettime()
+#if defined(__linux__) && defined(SO_TIMESTAMPING)
+#define UDP_HAVE_TIMESTAMPING 1
+// receive stamps on every datagram while enabled; transmit stamps only for the
+// sends that ask for them (udp_io_send_probe), keyed 0, 1, 2, ... by OPT_ID
+#define UDP_TS_SOCKET (SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_RX_HARDWARE | \
+                       SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_RAW_HARDWARE | \
+                       SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY)
+#define UDP_TS_TX (SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_TX_HARDWARE)
+// control buffer per received datagram: one scm_timestamping
+#define UDP_RX_CTRL 128
+#endif
+
+// one receive socket with its own thread and display ring
+typedef struct {
+    UdpIo* io;
+    int index;
+    int sock;
+    GThread* thread;
+
+    // receive thread -> main loop hand-off (pkt_cb only ever runs on the main loop)
+    PktRing* ring;
+    GSource* ring_src;
+    guint ring_slots;
+    gboolean reflect;       // echo datagrams back instead of showing them
+
+    // added by the receive thread once per wake-up: rx_* fields, and tx_*
+    // for what it reflected
+    NetCounters ctr;
+} UdpShard;
+
+// udp_io_send_raw state, touched only by the one thread that sends raw
+typedef struct {
+    gint gen;                   // io->tx_gen the cached target belongs to
+    int sock;
+    struct sockaddr_in addr;
+    UdpPeer local;
+    // totals not yet logged, since log_at
+    size_t pkts;
+    size_t bytes;
+    size_t failed;
+    int err;
+    gint64 log_at;
+} UdpRawTx;
 
+struct UdpIo {
     udp_packet_fn pkt_cb;
     void* pkt_user;
 
+    // shards[0] is also the send socket; shards live until udp_io_free
+    UdpShard* shards[NET_MAX_RX_SHARDS];
+    int nshards;            // shards opened by the last udp_io_open
+
+    // optional pcapng capture of everything sent and received
+    PcapngWriter* cap;
+
+    // RTT probe fed by the receive threads; set once before the first open
+    RttProbe* probe;
+    gboolean timestamping;  // kernel timestamps requested (udp_io_timestamping)
+    gint tx_stamps;         // probe sends ask for transmit stamps
+
     char* local_ip;
     char* target_ip;
     int local_port;
     int target_port;
     int rx_hex;
     int tx_hex;
+    int rx_batch;
+    int rx_shards;
+    gboolean reflect;
+    struct sockaddr_in target_addr;     // resolved once per config
+    UdpPeer local_peer;                 // bound address, for capture headers
 
-    int sock;
-    GThread* thread;
+    int sock;               // shards[0]->sock, for senders
+    gint tx_gen;            // bumped under lock whenever sock or target_addr changes
+    UdpRawTx raw;
     GMutex lock;
+
+    // tx_* fields since udp_io_open, added once per send call by any sender
+    NetCounters tx;
     gboolean stop;
+
+    // wake-up channel for the blocked receiver (eventfd, or a self-pipe)
+    int wake_rd;
+    int wake_wr;
 };
 
-typedef struct {
-    udp_log_fn fn;
-    void* user;
-    char* msg;
-} UdpLogTask;
 
-UdpIo* udp_io_new(udp_log_fn log_cb, void* log_user,
-                  udp_packet_fn pkt_cb, void* pkt_user) {
+static void ring_drain_cb(void* user, const PktDesc* pkt) {
+    UdpIo* io = ((UdpShard*)user)->io;
+    if (pkt->len > 0 && io->pkt_cb) io->pkt_cb(io->pkt_user, pkt->data, pkt->len, &pkt->from, pkt->ts_us);
+}
+
+static void ring_overflow_cb(void* user, guint dropped) {
+    UdpShard* sh = (UdpShard*)user;
+    EVLOG("[RECV] display ring %d full: %u datagrams not shown", sh->index, dropped);
+}
+
+static void shard_ring_free(UdpShard* sh) {
+    if (sh->ring_src) {
+        g_source_destroy(sh->ring_src);
+        g_source_unref(sh->ring_src);
+        sh->ring_src = NULL;
+    }
+    pkt_ring_free(sh->ring);
+    sh->ring = NULL;
+}
+
+// (re)create the display ring sized for nshards; the receiver must not be running
+static void shard_ring_prepare(UdpShard* sh, int nshards) {
+    UdpIo* io = sh->io;
+    if (!io->pkt_cb) return;
+    guint slots = MAX(UDP_RING_SLOTS / (guint)nshards, 128u);
+    if (sh->ring && sh->ring_slots == slots) return;
+    shard_ring_free(sh);
+    sh->ring = pkt_ring_new(slots);
+    sh->ring_src = pkt_ring_source_new(sh->ring, MAX(UDP_UI_PER_FRAME / (guint)nshards, 16u),
+                                       ring_drain_cb, ring_overflow_cb, sh);
+    sh->ring_slots = slots;
+    g_source_attach(sh->ring_src, NULL);
+}
+
+static UdpShard* shard_get(UdpIo* io, int index) {
+    UdpShard* sh = io->shards[index];
+    if (!sh) {
+        sh = g_new0(UdpShard, 1);
+        sh->io = io;
+        sh->index = index;
+        sh->sock = -1;
+        io->shards[index] = sh;
+    }
+    return sh;
+}
+
+UdpIo* udp_io_new(udp_packet_fn pkt_cb, void* pkt_user) {
     UdpIo* io = g_new0(UdpIo, 1);
-    io->log_cb = log_cb;
-    io->log_user = log_user;
     io->pkt_cb = pkt_cb;
     io->pkt_user = pkt_user;
     io->sock = -1;
+    io->tx_gen = 1;
+    io->wake_rd = -1;
+    io->wake_wr = -1;
     g_mutex_init(&io->lock);
+    io->cap = pcapng_writer_new();
+    shard_ring_prepare(shard_get(io, 0), 1);
     return io;
 }
 
-static gboolean log_idle_cb(gpointer data) {
-    UdpLogTask* t = (UdpLogTask*)data;
-    if (t && t->fn && t->msg) {
-        t->fn(t->user, t->msg);
-    }
-    if (t) g_free(t->msg);
-    g_free(t);
-    return G_SOURCE_REMOVE;
-}
-
-static void log_async(UdpIo* io, const char* fmt, ...) {
-    if (!io || !io->log_cb) return;
-    char buf[512];
-    va_list ap;
-    va_start(ap, fmt);
-    vsnprintf(buf, sizeof(buf), fmt, ap);
-    va_end(ap);
-    UdpLogTask* t = g_new0(UdpLogTask, 1);
-    t->fn = io->log_cb;
-    t->user = io->log_user;
-    t->msg = g_strdup(buf);
-    g_idle_add(log_idle_cb, t);
-}
 
 static void cfg_clear(UdpIo* io) {
     if (!io) return;
@@ -98,6 +220,29 @@ static void cfg_set(UdpIo* io, const NetConfig* cfg) {
     io->target_port = cfg->target_port;
     io->rx_hex = cfg->rx_hex;
     io->tx_hex = cfg->tx_hex;
+    io->rx_batch = cfg->rx_batch > 0 ? MIN(cfg->rx_batch, UDP_RX_BATCH_MAX) : UDP_RX_BATCH_DEFAULT;
+    io->rx_shards = CLAMP(cfg->rx_shards, 1, NET_MAX_RX_SHARDS);
+    io->reflect = cfg->reflect != 0;
+
+    memset(&io->target_addr, 0, sizeof(io->target_addr));
+    io->target_addr.sin_family = AF_INET;
+    io->target_addr.sin_port = htons((uint16_t)io->target_port);
+    inet_pton(AF_INET, io->target_ip, &io->target_addr.sin_addr);
+    g_atomic_int_inc(&io->tx_gen);
+}
+
+const char* udp_peer_format(const UdpPeer* peer, char* buf, size_t len) {
+    if (!buf || len == 0) return "";
+    if (!peer) {
+        buf[0] = '\0';
+        return buf;
+    }
+    struct in_addr a;
+    a.s_addr = peer->addr;
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &a, ip, sizeof(ip));
+    snprintf(buf, len, "%s:%u", ip, (unsigned)ntohs(peer->port));
+    return buf;
 }
 
 static gboolean ensure_winsock(void) {
@@ -111,67 +256,505 @@ static gboolean ensure_winsock(void) {
     return TRUE;
 }
 
-static gboolean parse_hex_string(const char* s, uint8_t** out, size_t* out_len) {
-    if (!s || !out || !out_len) return FALSE;
-    size_t len = strlen(s);
-    uint8_t* buf = g_new(uint8_t, len / 2 + 1);
-    size_t bi = 0;
-    int hi = -1;
-    for (size_t i = 0; i < len; ++i) {
-        char c = s[i];
-        if (c == ' ' || c == '\n' || c == '\r' || c == '\t') continue;
-        int v;
-        if (c >= '0' && c <= '9') v = c - '0';
-        else if (c >= 'a' && c <= 'f') v = 10 + (c - 'a');
-        else if (c >= 'A' && c <= 'F') v = 10 + (c - 'A');
-        else { g_free(buf); return FALSE; }
-
-        if (hi < 0) hi = v;
-        else { buf[bi++] = (uint8_t)((hi << 4) | v); hi = -1; }
-    }
-    if (hi >= 0) { g_free(buf); return FALSE; }
-    *out = buf;
-    *out_len = bi;
+// hex text -> payload in a buffer owned by the calling thread (allocated once)
+static GPrivate tx_hex_scratch = G_PRIVATE_INIT(g_free);
+
+static const uint8_t* decode_hex_payload(const char* s, size_t len, size_t* out_len) {
+    uint8_t* buf = g_private_get(&tx_hex_scratch);
+    if (!buf) {
+        buf = g_malloc(UDP_MAX_PAYLOAD);
+        g_private_set(&tx_hex_scratch, buf);
+    }
+    size_t err_off = 0;
+    HexDecodeStatus st = hex_decode(buf, UDP_MAX_PAYLOAD, s, len, out_len, &err_off);
+    if (st == HEX_DECODE_OK) return buf;
+    hex_decode_log(st, s, err_off, UDP_MAX_PAYLOAD);
+    return NULL;
+}
+
+#ifndef _WIN32
+static gboolean wake_open(UdpIo* io) {
+#ifdef __linux__
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0) return FALSE;
+    io->wake_rd = io->wake_wr = fd;
+#else
+    int fds[2];
+    if (pipe(fds) < 0) return FALSE;
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL, 0) | O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL, 0) | O_NONBLOCK);
+    io->wake_rd = fds[0];
+    io->wake_wr = fds[1];
+#endif
     return TRUE;
 }
 
-static gpointer recv_thread(gpointer data) {
-    UdpIo* io = (UdpIo*)data;
-    uint8_t buf[2048];
+static void wake_signal(UdpIo* io) {
+    if (io->wake_wr < 0) return;
+#ifdef __linux__
+    uint64_t one = 1;
+    ssize_t r = write(io->wake_wr, &one, sizeof(one));
+#else
+    char one = 1;
+    ssize_t r = write(io->wake_wr, &one, 1);
+#endif
+    (void)r;
+}
+
+static void wake_close(UdpIo* io) {
+    if (io->wake_rd >= 0) close(io->wake_rd);
+    if (io->wake_wr >= 0 && io->wake_wr != io->wake_rd) close(io->wake_wr);
+    io->wake_rd = io->wake_wr = -1;
+}
+#endif
+
+#ifndef _WIN32
+// wait briefly for send buffer space on the non-blocking socket
+static gboolean tx_wait_writable(int sock) {
+    struct pollfd pfd = { .fd = sock, .events = POLLOUT };
+    return poll(&pfd, 1, 100) > 0;
+}
+#endif
+
+// preallocated receive buffers, reused for every batch of one receiver
+typedef struct {
+    int batch;
+    uint8_t* bufs;                  // batch * UDP_RX_SLOT bytes
+    struct sockaddr_in* from;
+#ifdef __linux__
+    struct mmsghdr* msgs;
+    struct iovec* iov;
+    // reflector only: the same buffers, sized to what arrived, addressed to the sender
+    struct mmsghdr* out;
+    struct iovec* out_iov;
+#endif
+#ifdef UDP_HAVE_TIMESTAMPING
+    uint8_t* ctrl;                  // batch * UDP_RX_CTRL bytes
+#endif
+} UdpRxPool;
+
+// what one drain pass (one wake-up) received; summarized in a single log line
+typedef struct {
+    unsigned count;
+    unsigned truncated;
+    unsigned dropped;           // display ring full
+    unsigned refused;           // ICMP port unreachable for an earlier send
+    size_t bytes;
+    unsigned reflected;         // reflector: sent back, dropped (send buffer full), failed
+    size_t reflected_bytes;
+    unsigned reflect_dropped;
+    unsigned reflect_errors;
+    size_t last_len;
+    UdpPeer last_from;
+} UdpRxSummary;
+
+static UdpRxPool* rx_pool_new(int batch, gboolean reflect) {
+    UdpRxPool* p = g_new0(UdpRxPool, 1);
+    p->batch = batch;
+    p->bufs = g_new(uint8_t, (gsize)batch * UDP_RX_SLOT);
+    p->from = g_new0(struct sockaddr_in, batch);
+#ifdef __linux__
+    p->msgs = g_new0(struct mmsghdr, batch);
+    p->iov = g_new0(struct iovec, batch);
+    for (int i = 0; i < batch; ++i) {
+        p->iov[i].iov_base = p->bufs + (size_t)i * UDP_RX_SLOT;
+        p->iov[i].iov_len = UDP_RX_SLOT;
+        p->msgs[i].msg_hdr.msg_iov = &p->iov[i];
+        p->msgs[i].msg_hdr.msg_iovlen = 1;
+        p->msgs[i].msg_hdr.msg_name = &p->from[i];
+    }
+    if (reflect) {
+        p->out = g_new0(struct mmsghdr, batch);
+        p->out_iov = g_new0(struct iovec, batch);
+        for (int i = 0; i < batch; ++i) {
+            p->out_iov[i].iov_base = p->iov[i].iov_base;
+            p->out[i].msg_hdr.msg_iov = &p->out_iov[i];
+            p->out[i].msg_hdr.msg_iovlen = 1;
+            p->out[i].msg_hdr.msg_name = &p->from[i];
+        }
+    }
+#else
+    (void)reflect;
+#endif
+#ifdef UDP_HAVE_TIMESTAMPING
+    p->ctrl = g_new(uint8_t, (gsize)batch * UDP_RX_CTRL);
+#endif
+    return p;
+}
+
+static void rx_pool_free(UdpRxPool* p) {
+    if (!p) return;
+#ifdef __linux__
+    g_free(p->msgs);
+    g_free(p->iov);
+    g_free(p->out);
+    g_free(p->out_iov);
+#endif
+#ifdef UDP_HAVE_TIMESTAMPING
+    g_free(p->ctrl);
+#endif
+    g_free(p->from);
+    g_free(p->bufs);
+    g_free(p);
+}
+
+static void rx_deliver(UdpShard* sh, UdpRxSummary* sum, const uint8_t* data, size_t len,
+                       const struct sockaddr_in* from, gboolean truncated, gint64 ts_us) {
+    sum->count++;
+    sum->bytes += len;
+    sum->last_len = len;
+    sum->last_from.addr = from->sin_addr.s_addr;
+    sum->last_from.port = from->sin_port;
+    if (truncated) sum->truncated++;
+    if (len == 0 || !sh->ring || sh->reflect) return;
+
+    // never block here: a full ring drops the datagram and counts it
+    PktDesc* d = pkt_ring_reserve(sh->ring);
+    if (!d) {
+        sum->dropped++;
+        return;
+    }
+    d->ts_us = ts_us;
+    d->from = sum->last_from;
+    d->len = (uint32_t)MIN(len, (size_t)PKT_RING_SLOT);
+    d->truncated = truncated;
+    memcpy(d->data, data, d->len);
+}
+
+static void rx_capture_one(PcapngPkt* pkt, const uint8_t* data, size_t len, const struct sockaddr_in* from) {
+    pkt->data = data;
+    pkt->len = (uint32_t)MIN(len, (size_t)UDP_RX_SLOT);
+    pkt->peer.addr = from->sin_addr.s_addr;
+    pkt->peer.port = from->sin_port;
+}
+
+#ifdef UDP_HAVE_TIMESTAMPING
+static gint64 ts_ns(const struct timespec* ts) {
+    return (gint64)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+// kernel timestamps from a datagram's control messages
+static void rx_stamp(struct msghdr* mh, RttStamp* st) {
+    for (struct cmsghdr* c = CMSG_FIRSTHDR(mh); c; c = CMSG_NXTHDR(mh, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SO_TIMESTAMPING) continue;
+        struct scm_timestamping ts;
+        memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+        st->sw_ns = ts_ns(&ts.ts[0]);
+        st->hw_ns = ts_ns(&ts.ts[2]);
+    }
+}
+
+// transmit timestamps the kernel queued for probes sent through this socket
+static void rx_drain_errqueue(int sock, RttProbe* probe) {
+    uint8_t ctrl[256];
+    uint8_t data[64];
+    while (TRUE) {
+        struct iovec iov = { data, sizeof(data) };
+        struct msghdr mh;
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+        mh.msg_control = ctrl;
+        mh.msg_controllen = sizeof(ctrl);
+        if (recvmsg(sock, &mh, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        RttStamp st = { 0, 0 };
+        gboolean keyed = FALSE;
+        uint32_t key = 0;
+        rx_stamp(&mh, &st);
+        for (struct cmsghdr* c = CMSG_FIRSTHDR(&mh); c; c = CMSG_NXTHDR(&mh, c)) {
+            if (c->cmsg_level != IPPROTO_IP || c->cmsg_type != IP_RECVERR) continue;
+            struct sock_extended_err ee;
+            memcpy(&ee, CMSG_DATA(c), sizeof(ee));
+            if (ee.ee_errno == ENOMSG && ee.ee_origin == SO_EE_ORIGIN_TIMESTAMPING) {
+                key = ee.ee_data;
+                keyed = TRUE;
+            }
+        }
+        if (keyed && probe) rtt_probe_on_tx_stamp(probe, key, &st);
+    }
+}
+#endif
+
+static void reflect_capture(UdpIo* io, const UdpPeer* local, const uint8_t* const* data, const size_t* lens,
+                            const struct sockaddr_in* to, size_t n) {
+    PcapngPkt pkts[UDP_RX_BATCH_MAX];
+    for (size_t i = 0; i < n; ++i) rx_capture_one(&pkts[i], data[i], lens[i], &to[i]);
+    pcapng_writer_add(io->cap, PCAPNG_OUT, pcapng_now_ns(), local, pkts, n);
+}
+
+#ifdef __linux__
+// send the first n datagrams of the batch back to their senders with one
+// sendmmsg() per pass, straight from the receive buffers
+static void rx_reflect_batch(UdpShard* sh, UdpRxPool* pool, int n, UdpRxSummary* sum, const UdpPeer* local) {
+    for (int i = 0; i < n; ++i) {
+        pool->out_iov[i].iov_len = MIN(pool->msgs[i].msg_len, (unsigned)UDP_RX_SLOT);
+        pool->out[i].msg_hdr.msg_namelen = pool->msgs[i].msg_hdr.msg_namelen;
+    }
+    int done = 0;
+    while (done < n) {
+        int r = sendmmsg(sh->sock, pool->out + done, (unsigned)(n - done), MSG_DONTWAIT);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+                if (tx_wait_writable(sh->sock)) continue;
+                // drop the rest; done stays at what went out
+                sum->reflect_dropped += (unsigned)(n - done);
+                break;
+            }
+            // the first datagram was refused (e.g. unroutable sender); skip it
+            sum->reflect_errors++;
+            done++;
+            continue;
+        }
+        for (int i = done; i < done + r; ++i) sum->reflected_bytes += pool->out_iov[i].iov_len;
+        sum->reflected += (unsigned)r;
+        done += r;
+    }
+    if (pcapng_writer_active(sh->io->cap)) {
+        const uint8_t* data[UDP_RX_BATCH_MAX];
+        size_t lens[UDP_RX_BATCH_MAX];
+        for (int i = 0; i < done; ++i) {
+            data[i] = pool->out_iov[i].iov_base;
+            lens[i] = pool->out_iov[i].iov_len;
+        }
+        if (done > 0) reflect_capture(sh->io, local, data, lens, pool->from, (size_t)done);
+    }
+}
+#endif
+
+// send one datagram back to its sender (one-at-a-time receive path)
+static void rx_reflect_one(UdpShard* sh, const uint8_t* data, size_t len, const struct sockaddr_in* to,
+                           UdpRxSummary* sum, const UdpPeer* local) {
+    int r = sendto(sh->sock, (const char*)data, (int)len, 0, (const struct sockaddr*)to, sizeof(*to));
+#ifndef _WIN32
+    if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) && tx_wait_writable(sh->sock))
+        r = sendto(sh->sock, (const char*)data, (int)len, 0, (const struct sockaddr*)to, sizeof(*to));
+    if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)) {
+        sum->reflect_dropped++;
+        return;
+    }
+#endif
+    if (r < 0) {
+        sum->reflect_errors++;
+        return;
+    }
+    sum->reflected++;
+    sum->reflected_bytes += (size_t)r;
+    if (pcapng_writer_active(sh->io->cap)) reflect_capture(sh->io, local, &data, &len, to, 1);
+}
+
+// receive until the socket queue is empty; returns FALSE on a fatal error
+static gboolean rx_drain(UdpShard* sh, UdpRxPool* pool, UdpRxSummary* sum, const UdpPeer* local, RttProbe* probe) {
+    UdpIo* io = sh->io;
+    int sock = sh->sock;
+    // probe replies are matched here, on the receive thread, with their kernel stamps
+    gboolean probing = rtt_probe_active(probe);
+#ifdef __linux__
+    if (pool->batch > 1) {
+        while (TRUE) {
+            for (int i = 0; i < pool->batch; ++i) {
+                pool->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+#ifdef UDP_HAVE_TIMESTAMPING
+                pool->msgs[i].msg_hdr.msg_control = pool->ctrl + (size_t)i * UDP_RX_CTRL;
+                pool->msgs[i].msg_hdr.msg_controllen = UDP_RX_CTRL;
+#endif
+            }
+            int n = recvmmsg(sock, pool->msgs, (unsigned)pool->batch, MSG_DONTWAIT, NULL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == ECONNREFUSED) sum->refused++;
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNREFUSED) return TRUE;
+                return FALSE;
+            }
+            gint64 now_ns = pcapng_now_ns();
+            for (int i = 0; i < n; ++i) {
+                const uint8_t* data = pool->bufs + (size_t)i * UDP_RX_SLOT;
+                gint64 ts_us = now_ns / 1000;
+                if (probing && rtt_probe_is_reply(data, pool->msgs[i].msg_len)) {
+                    RttStamp st = { 0, 0 };
+#ifdef UDP_HAVE_TIMESTAMPING
+                    rx_stamp(&pool->msgs[i].msg_hdr, &st);
+                    if (st.sw_ns) ts_us = st.sw_ns / 1000;
+#endif
+                    rtt_probe_on_reply(probe, data, pool->msgs[i].msg_len, &st, now_ns);
+                }
+                rx_deliver(sh, sum, data, pool->msgs[i].msg_len, &pool->from[i],
+                           (pool->msgs[i].msg_hdr.msg_flags & MSG_TRUNC) != 0, ts_us);
+            }
+            if (sh->ring) pkt_ring_publish(sh->ring);
+            if (pool->out) rx_reflect_batch(sh, pool, n, sum, local);
+            if (pcapng_writer_active(io->cap)) {
+                PcapngPkt pkts[UDP_RX_BATCH_MAX];
+                for (int i = 0; i < n; ++i) {
+                    rx_capture_one(&pkts[i], pool->bufs + (size_t)i * UDP_RX_SLOT, pool->msgs[i].msg_len,
+                                   &pool->from[i]);
+                }
+                pcapng_writer_add(io->cap, PCAPNG_IN, now_ns, local, pkts, (size_t)n);
+            }
+            // a short batch means the queue is empty
+            if (n < pool->batch) return TRUE;
+        }
+    }
+#endif
     while (TRUE) {
-        g_mutex_lock(&io->lock);
-        gboolean stop = io->stop;
-        int sock = io->sock;
-        g_mutex_unlock(&io->lock);
-        if (stop || sock < 0) break;
-
-        struct sockaddr_in from;
-        socklen_t flen = sizeof(from);
-        int n = recvfrom(sock, (char*)buf, sizeof(buf), 0, (struct sockaddr*)&from, &flen); // Ensure recv uses current vars
-        if (n > 0) {
-            char addr[64];
-            inet_ntop(AF_INET, &from.sin_addr, addr, sizeof(addr));
-            log_async(io, "[RECV] %d bytes from %s:%d", n, addr, ntohs(from.sin_port));
-            if (io->pkt_cb) io->pkt_cb(io->pkt_user, buf, (size_t)n);
-        } else {
+        socklen_t flen = sizeof(pool->from[0]);
+        int n = recvfrom(sock, (char*)pool->bufs, UDP_RX_SLOT, 0, (struct sockaddr*)&pool->from[0], &flen);
+        if (n >= 0) {
+            gint64 now_ns = pcapng_now_ns();
+            // one at a time: no control messages, so the probe gets the user-space clock
+            if (probing && rtt_probe_is_reply(pool->bufs, (size_t)n))
+                rtt_probe_on_reply(probe, pool->bufs, (size_t)n, NULL, now_ns);
+            rx_deliver(sh, sum, pool->bufs, (size_t)n, &pool->from[0], FALSE, now_ns / 1000);
+            if (sh->ring) pkt_ring_publish(sh->ring);
+            if (pcapng_writer_active(io->cap)) {
+                PcapngPkt pkt;
+                rx_capture_one(&pkt, pool->bufs, (size_t)n, &pool->from[0]);
+                pcapng_writer_add(io->cap, PCAPNG_IN, now_ns, local, &pkt, 1);
+            }
+            if (sh->reflect) rx_reflect_one(sh, pool->bufs, (size_t)n, &pool->from[0], sum, local);
 #ifdef _WIN32
-            int err = WSAGetLastError();
-            if (err == WSAEINTR || err == WSAEWOULDBLOCK) continue;
-            if (io->stop) break;
+            // blocking socket: return to the caller after every datagram
+            return TRUE;
 #else
-            if (errno == EINTR || errno == EAGAIN) continue;
-            if (io->stop) break;
+            continue;
+#endif
+        }
+#ifdef _WIN32
+        // blocking socket: closesocket() in udp_io_close() makes this fail
+        int err = WSAGetLastError();
+        if (err == WSAEINTR || err == WSAECONNRESET || err == WSAEMSGSIZE) return TRUE;
+        return g_atomic_int_get(&io->stop) ? TRUE : FALSE;
+#else
+        if (errno == EINTR) continue;
+        if (errno == ECONNREFUSED) sum->refused++;
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNREFUSED) return TRUE;
+        return FALSE;
+#endif
+    }
+}
+
+// one binary event per wake-up; formatted only if someone looks at it
+static void rx_log_summary(const UdpRxSummary* sum) {
+    if (sum->count == 0) return;
+    if (sum->count == 1) {
+        EVLOG("[RECV] %u bytes from %a%s", sum->last_len, EV_PEER(&sum->last_from),
+              EV_STR(sum->truncated ? " (truncated)" : ""));
+    } else {
+        EVLOG("[RECV] %u datagrams, %zu bytes, last from %a (%u truncated)", sum->count,
+              sum->bytes, EV_PEER(&sum->last_from), sum->truncated);
+    }
+}
+
+#ifdef UDP_HAVE_SHARDS
+// pin the calling receiver to the index-th CPU this process may run on
+static void shard_pin(int index) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return;
+    int ncpu = CPU_COUNT(&allowed);
+    if (ncpu <= 1) return;
+    int want = index % ncpu;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (!CPU_ISSET(cpu, &allowed) || want-- > 0) continue;
+        cpu_set_t one;
+        CPU_ZERO(&one);
+        CPU_SET(cpu, &one);
+        int r = pthread_setaffinity_np(pthread_self(), sizeof(one), &one);
+        if (r != 0) EVLOG("[RECV] shard %d: pinning to cpu %d failed: errno=%d", index, cpu, r);
+        return;
+    }
+}
 #endif
-            log_async(io, "[RECV] error, exiting loop");
+
+static gpointer recv_thread(gpointer data) {
+    UdpShard* sh = (UdpShard*)data;
+    UdpIo* io = sh->io;
+
+    // sock and wake fds are fixed for the lifetime of this thread
+    g_mutex_lock(&io->lock);
+    int sock = sh->sock;
+    int batch = io->rx_batch;
+    gboolean sharded = io->nshards > 1;
+    UdpPeer local = io->local_peer;
+    RttProbe* probe = io->probe;
+#ifndef _WIN32
+    int wake = io->wake_rd;
+#endif
+    g_mutex_unlock(&io->lock);
+    if (sock < 0) return NULL;
+
+#ifdef UDP_HAVE_SHARDS
+    if (sharded) shard_pin(sh->index);
+#else
+    (void)sharded;
+#endif
+    UdpRxPool* pool = rx_pool_new(batch, sh->reflect);
+
+    while (TRUE) {
+#ifndef _WIN32
+        // sleep in the kernel until data arrives or udp_io_close() signals the wake fd
+        struct pollfd pfd[2] = {
+            { .fd = sock, .events = POLLIN },
+            { .fd = wake, .events = POLLIN },
+        };
+        int pr = poll(pfd, 2, -1);
+        if (pr < 0) {
+            if (errno == EINTR) continue;
+            EVLOG("[RECV] poll failed: errno=%d", errno);
+            NET_COUNT(&sh->ctr, rx_errors, 1);
             break;
         }
+        if (pfd[1].revents) break;
+        if (!(pfd[0].revents & (POLLIN | POLLERR))) continue;
+#ifdef UDP_HAVE_TIMESTAMPING
+        // a non-empty error queue keeps POLLERR raised, so drain it every time
+        if (pfd[0].revents & POLLERR) rx_drain_errqueue(sock, probe);
+#endif
+#endif
+
+        UdpRxSummary sum;
+        memset(&sum, 0, sizeof(sum));
+        gboolean ok = rx_drain(sh, pool, &sum, &local, probe);
+        rx_log_summary(&sum);
+        if (sum.count) {
+            NET_COUNT(&sh->ctr, rx_packets, sum.count);
+            NET_COUNT(&sh->ctr, rx_bytes, sum.bytes);
+            if (sum.truncated) NET_COUNT(&sh->ctr, rx_truncated, sum.truncated);
+            if (sum.dropped) NET_COUNT(&sh->ctr, rx_dropped, sum.dropped);
+        }
+        if (sum.reflected) {
+            NET_COUNT(&sh->ctr, tx_packets, sum.reflected);
+            NET_COUNT(&sh->ctr, tx_bytes, sum.reflected_bytes);
+        }
+        if (sum.reflect_dropped) NET_COUNT(&sh->ctr, tx_dropped, sum.reflect_dropped);
+        if (sum.reflect_errors) NET_COUNT(&sh->ctr, tx_errors, sum.reflect_errors);
+        // the kernel reports a rejected send on the next receive
+        if (sum.refused) NET_COUNT(&io->tx, tx_errors, sum.refused);
+        if (!ok) {
+            EVLOG("[RECV] error, exiting loop");
+            NET_COUNT(&sh->ctr, rx_errors, 1);
+            break;
+        }
+#ifdef _WIN32
+        if (g_atomic_int_get(&io->stop)) break;
+#endif
     }
+
+    rx_pool_free(pool);
     return NULL;
 }
 
 void udp_io_free(UdpIo* io) {
     if (!io) return;
     udp_io_close(io);
+    pcapng_writer_free(io->cap);
+    for (int i = 0; i < NET_MAX_RX_SHARDS; ++i) {
+        if (!io->shards[i]) continue;
+        shard_ring_free(io->shards[i]);
+        g_free(io->shards[i]);
+    }
     cfg_clear(io);
     g_mutex_clear(&io->lock);
     g_free(io);
@@ -179,43 +762,129 @@ void udp_io_free(UdpIo* io) {
 
 gboolean udp_io_apply_config(UdpIo* io, const NetConfig* cfg) {
     if (!io || !cfg) return FALSE;
+    g_mutex_lock(&io->lock);
     cfg_set(io, cfg);
+    g_mutex_unlock(&io->lock);
     return TRUE;
 }
 
+// merged counters, logged when a sharded receiver stops
+static void rx_log_shards(UdpIo* io, int nshards) {
+    if (nshards <= 1) return;
+    gsize total = 0, lo = G_MAXSIZE, hi = 0;
+    for (int i = 0; i < nshards; ++i) {
+        gsize n = (gsize)g_atomic_pointer_get(&io->shards[i]->ctr.rx_packets);
+        total += n;
+        lo = MIN(lo, n);
+        hi = MAX(hi, n);
+    }
+    EVLOG("[RECV] %d shards received %zu datagrams (per shard min %zu, max %zu)",
+          nshards, total, lo, hi);
+}
+
 void udp_io_close(UdpIo* io) {
     if (!io) return;
     g_mutex_lock(&io->lock);
-    if (io->sock >= 0) {
-        io->stop = TRUE;
-        closesocket(io->sock);
+    int nshards = io->nshards;
+    g_atomic_int_set(&io->stop, TRUE);
+#ifdef _WIN32
+    // a blocking recvfrom() only returns once the socket is closed
+    for (int i = 0; i < nshards; ++i) {
+        if (io->shards[i]->sock >= 0) closesocket(io->shards[i]->sock);
     }
+#else
+    // every receiver polls the same wake fd, so one signal stops them all
+    wake_signal(io);
+#endif
     g_mutex_unlock(&io->lock);
 
-    if (io->thread) {
-        g_thread_join(io->thread);
-        io->thread = NULL;
+    for (int i = 0; i < nshards; ++i) {
+        UdpShard* sh = io->shards[i];
+        if (sh->thread) {
+            g_thread_join(sh->thread);
+            sh->thread = NULL;
+        }
     }
+    rx_log_shards(io, nshards);
 
     g_mutex_lock(&io->lock);
+    for (int i = 0; i < nshards; ++i) {
+#ifndef _WIN32
+        // the receivers have exited, so the fds can no longer be in use
+        if (io->shards[i]->sock >= 0) closesocket(io->shards[i]->sock);
+#endif
+        io->shards[i]->sock = -1;
+    }
+#ifndef _WIN32
+    wake_close(io);
+#endif
     io->sock = -1;
+    g_atomic_int_inc(&io->tx_gen);
+    io->nshards = 0;
     g_mutex_unlock(&io->lock);
 }
 
+// enabling restarts the transmit stamp keys at 0; FALSE when the kernel refuses
+static gboolean sock_timestamping(int sock, gboolean on) {
+#ifdef UDP_HAVE_TIMESTAMPING
+    int off = 0;
+    int flags = UDP_TS_SOCKET;
+    if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING, &off, sizeof(off)) < 0) return FALSE;
+    return !on || setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0;
+#else
+    (void)sock; (void)on;
+    return FALSE;
+#endif
+}
+
+// bind one receive socket; reuse lets several shards share the address
+static int shard_socket(const struct sockaddr_in* addr, gboolean reuse) {
+    int sock = (int)socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        EVLOG("[NET] create socket failed");
+        return -1;
+    }
+#ifdef UDP_HAVE_SHARDS
+    int one = 1;
+    if (reuse && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+        EVLOG("[NET] SO_REUSEPORT failed: errno=%d", errno);
+        closesocket(sock);
+        return -1;
+    }
+#else
+    (void)reuse;
+#endif
+    if (bind(sock, (const struct sockaddr*)addr, sizeof(*addr)) < 0) {
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &addr->sin_addr, ip, sizeof(ip));
+        EVLOG("[NET] bind failed for %S:%d", EV_DUP(ip), ntohs(addr->sin_port));
+        closesocket(sock);
+        return -1;
+    }
+#ifndef _WIN32
+    // non-blocking so the receiver can drain the queue and return to poll()
+    int flags = fcntl(sock, F_GETFL, 0);
+    fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+#endif
+    return sock;
+}
+
 gboolean udp_io_open(UdpIo* io) {
     if (!io) return FALSE;
     if (!ensure_winsock()) {
-        log_async(io, "[NET] WSAStartup failed");
+        EVLOG("[NET] WSAStartup failed");
         return FALSE;
     }
 
     udp_io_close(io);
 
-    int sock = (int)socket(AF_INET, SOCK_DGRAM, 0);
-    if (sock < 0) {
-        log_async(io, "[NET] create socket failed");
-        return FALSE;
+    int nshards = io->rx_shards > 0 ? io->rx_shards : 1;
+#ifndef UDP_HAVE_SHARDS
+    if (nshards > 1) {
+        EVLOG("[NET] receive shards need SO_REUSEPORT load balancing; using one socket");
+        nshards = 1;
     }
+#endif
 
     struct sockaddr_in addr;
     memset(&addr, 0, sizeof(addr));
@@ -223,71 +892,399 @@ gboolean udp_io_open(UdpIo* io) {
     addr.sin_port = htons((uint16_t)io->local_port);
     inet_pton(AF_INET, io->local_ip ? io->local_ip : "0.0.0.0", &addr.sin_addr);
 
-    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-        log_async(io, "[NET] bind failed for %s:%d", io->local_ip ? io->local_ip : "0.0.0.0", io->local_port);
-        closesocket(sock);
-        return FALSE;
+    int socks[NET_MAX_RX_SHARDS];
+    struct sockaddr_in bound = addr;
+    for (int i = 0; i < nshards; ++i) {
+        socks[i] = shard_socket(&bound, nshards > 1);
+        if (socks[i] < 0) {
+            while (i-- > 0) closesocket(socks[i]);
+            return FALSE;
+        }
+        if (i == 0) {
+            // with port 0 the other shards must join the port the kernel picked
+            socklen_t blen = sizeof(bound);
+            getsockname(socks[0], (struct sockaddr*)&bound, &blen);
+        }
     }
 
 #ifndef _WIN32
-    int flags = fcntl(sock, F_GETFL, 0);
-    fcntl(sock, F_SETFL, flags | O_NONBLOCK);
-#else
-    u_long nb = 1;
-    ioctlsocket(sock, FIONBIO, &nb);
+    if (!wake_open(io)) {
+        EVLOG("[NET] create wake fd failed");
+        for (int i = 0; i < nshards; ++i) closesocket(socks[i]);
+        return FALSE;
+    }
 #endif
 
+    // receivers are stopped, so the display rings can be resized for the shard count
+    for (int i = 0; i < nshards; ++i) {
+        UdpShard* sh = shard_get(io, i);
+        shard_ring_prepare(sh, nshards);
+        net_counters_reset(&sh->ctr);
+        sh->reflect = io->reflect;
+    }
+
     g_mutex_lock(&io->lock);
-    io->sock = sock;
+    if (io->timestamping) {
+        gboolean ok = TRUE;
+        for (int i = 0; i < nshards; ++i) ok = sock_timestamping(socks[i], TRUE) && ok;
+        g_atomic_int_set(&io->tx_stamps, ok);
+    }
+    io->sock = socks[0];
+    g_atomic_int_inc(&io->tx_gen);
+    io->local_peer.addr = bound.sin_addr.s_addr;
+    io->local_peer.port = bound.sin_port;
+    io->nshards = nshards;
+    net_counters_reset(&io->tx);
     io->stop = FALSE;
-    io->thread = g_thread_new("udp-recv", recv_thread, io);
+    for (int i = 0; i < nshards; ++i) {
+        char name[16];
+        snprintf(name, sizeof(name), i == 0 ? "udp-recv" : "udp-recv-%d", i);
+        io->shards[i]->sock = socks[i];
+        io->shards[i]->thread = g_thread_new(name, recv_thread, io->shards[i]);
+    }
     g_mutex_unlock(&io->lock);
 
-    log_async(io, "[NET] UDP bound at %s:%d", io->local_ip ? io->local_ip : "0.0.0.0", io->local_port);
+    if (nshards > 1) {
+        EVLOG("[NET] UDP bound at %S:%d, %d receive shards", EV_DUP(io->local_ip ? io->local_ip : "0.0.0.0"),
+              ntohs(bound.sin_port), nshards);
+    } else {
+        EVLOG("[NET] UDP bound at %S:%d", EV_DUP(io->local_ip ? io->local_ip : "0.0.0.0"), io->local_port);
+    }
+    if (io->reflect) EVLOG("[NET] reflector: every datagram goes back to its sender, none are shown");
+    return TRUE;
+}
+
+static gboolean tx_target(UdpIo* io, int* sock, struct sockaddr_in* addr, UdpPeer* local) {
+    g_mutex_lock(&io->lock);
+    *sock = io->sock;
+    *addr = io->target_addr;
+    *local = io->local_peer;
+    g_mutex_unlock(&io->lock);
+    if (*sock < 0) {
+        EVLOG("[SEND] socket not ready; apply config first");
+        return FALSE;
+    }
     return TRUE;
 }
 
 gboolean udp_io_send(UdpIo* io, const uint8_t* data, size_t len, int is_hex_mode) {
     if (!io) return FALSE;
-    if (!data) { log_async(io, "[SEND] empty payload skipped"); return FALSE; }
+    if (!data) { EVLOG("[SEND] empty payload skipped"); return FALSE; }
 
     const uint8_t* payload = data;
     size_t payload_len = len;
-    uint8_t* hex_buf = NULL;
     if (is_hex_mode) {
-        if (!parse_hex_string((const char*)data, &hex_buf, &payload_len)) {
-            log_async(io, "[SEND] hex parse failed");
-            return FALSE;
+        payload = decode_hex_payload((const char*)data, len, &payload_len);
+        if (!payload) return FALSE;
+    }
+
+    int sock;
+    struct sockaddr_in addr;
+    UdpPeer local;
+    if (!tx_target(io, &sock, &addr, &local)) return FALSE;
+
+    int sent = sendto(sock, (const char*)payload, (int)payload_len, 0, (struct sockaddr*)&addr, sizeof(addr));
+    if (sent < 0) {
+        EVLOG("[SEND] failed: errno=%d", errno);
+        NET_COUNT(&io->tx, tx_errors, 1);
+    } else {
+        UdpPeer to = { addr.sin_addr.s_addr, addr.sin_port };
+        NET_COUNT(&io->tx, tx_packets, 1);
+        NET_COUNT(&io->tx, tx_bytes, sent);
+        if (pcapng_writer_active(io->cap)) {
+            PcapngPkt pkt = { payload, (uint32_t)payload_len, to };
+            pcapng_writer_add(io->cap, PCAPNG_OUT, pcapng_now_ns(), &local, &pkt, 1);
         }
-        payload = hex_buf;
+        EVLOG("[SEND] manual len=%zu mode=%s -> %a", payload_len,
+              EV_STR(is_hex_mode ? "HEX" : "ASCII"), EV_PEER(&to));
     }
 
+    return sent >= 0;
+}
+
+void udp_io_set_probe(UdpIo* io, RttProbe* probe) {
+    if (!io) return;
+    g_mutex_lock(&io->lock);
+    io->probe = probe;
+    g_mutex_unlock(&io->lock);
+}
+
+gboolean udp_io_timestamping(UdpIo* io, gboolean on) {
+    if (!io) return FALSE;
     g_mutex_lock(&io->lock);
-    int sock = io->sock;
+    io->timestamping = on;
+    gboolean ok = io->nshards > 0;
+    for (int i = 0; i < io->nshards; ++i) ok = sock_timestamping(io->shards[i]->sock, on) && ok;
+    g_atomic_int_set(&io->tx_stamps, on && ok);
     g_mutex_unlock(&io->lock);
+    return on && ok;
+}
 
-    if (sock < 0) {
-        log_async(io, "[SEND] socket not ready; apply config first");
-        if (hex_buf) g_free(hex_buf);
-        return FALSE;
-    }
+#ifdef UDP_HAVE_TIMESTAMPING
+// sendto() that asks the kernel for this datagram's transmit timestamps
+static int send_stamped(int sock, const struct sockaddr_in* addr, const uint8_t* data, size_t len) {
+    struct iovec iov = { (void*)data, len };
+    union {
+        char buf[CMSG_SPACE(sizeof(uint32_t))];
+        struct cmsghdr align;
+    } ctrl;
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_name = (void*)addr;
+    mh.msg_namelen = sizeof(*addr);
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = ctrl.buf;
+    mh.msg_controllen = sizeof(ctrl.buf);
+    struct cmsghdr* c = CMSG_FIRSTHDR(&mh);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SO_TIMESTAMPING;
+    c->cmsg_len = CMSG_LEN(sizeof(uint32_t));
+    uint32_t flags = UDP_TS_TX;
+    memcpy(CMSG_DATA(c), &flags, sizeof(flags));
+    return (int)sendmsg(sock, &mh, 0);
+}
+#endif
 
+int udp_io_send_probe(UdpIo* io, const uint8_t* data, size_t len) {
+    int sock;
     struct sockaddr_in addr;
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons((uint16_t)io->target_port);
-    inet_pton(AF_INET, io->target_ip ? io->target_ip : "127.0.0.1", &addr.sin_addr);
+    UdpPeer local;
+    if (!io || !data) return EINVAL;
+    if (!tx_target(io, &sock, &addr, &local)) return ENOTCONN;
 
-    int sent = sendto(sock, (const char*)payload, (int)payload_len, 0, (struct sockaddr*)&addr, sizeof(addr));
+    int sent = -1;
+    gboolean tried = FALSE;
+#ifdef UDP_HAVE_TIMESTAMPING
+    if (g_atomic_int_get(&io->tx_stamps)) {
+        sent = send_stamped(sock, &addr, data, len);
+        tried = TRUE;
+        // kernels without per-send timestamp requests: carry on with the send clock
+        if (sent < 0 && errno == EINVAL) {
+            EVLOG("[PROBE] kernel rejects per-send timestamps; using the send clock");
+            g_atomic_int_set(&io->tx_stamps, 0);
+            tried = FALSE;
+        }
+    }
+#endif
+    if (!tried) sent = sendto(sock, (const char*)data, (int)len, 0, (struct sockaddr*)&addr, sizeof(addr));
     if (sent < 0) {
-        log_async(io, "[SEND] failed: errno=%d", errno);
+        int err = errno;
+        if (err != EAGAIN && err != EWOULDBLOCK && err != ENOBUFS && err != EINTR) NET_COUNT(&io->tx, tx_errors, 1);
+        return err;
+    }
+    NET_COUNT(&io->tx, tx_packets, 1);
+    NET_COUNT(&io->tx, tx_bytes, sent);
+    if (pcapng_writer_active(io->cap)) {
+        PcapngPkt pkt = { data, (uint32_t)len, { addr.sin_addr.s_addr, addr.sin_port } };
+        pcapng_writer_add(io->cap, PCAPNG_OUT, pcapng_now_ns(), &local, &pkt, 1);
+    }
+    return 0;
+}
+
+// submit up to n datagrams to addr; returns how many the kernel accepted, -1 on error
+static int tx_submit(int sock, const struct sockaddr_in* addr,
+                     const uint8_t* const* data, const size_t* lens, size_t n) {
+#ifdef __linux__
+    struct mmsghdr msgs[UDP_TX_BATCH];
+    struct iovec iov[UDP_TX_BATCH];
+    if (n > UDP_TX_BATCH) n = UDP_TX_BATCH;
+    memset(msgs, 0, sizeof(msgs[0]) * n);
+    for (size_t i = 0; i < n; ++i) {
+        iov[i].iov_base = (void*)data[i];
+        iov[i].iov_len = lens[i];
+        msgs[i].msg_hdr.msg_name = (void*)addr;
+        msgs[i].msg_hdr.msg_namelen = sizeof(*addr);
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    return sendmmsg(sock, msgs, (unsigned)n, 0);
+#else
+    (void)n;
+    int r = sendto(sock, (const char*)data[0], (int)lens[0], 0, (const struct sockaddr*)addr, sizeof(*addr));
+    return r < 0 ? -1 : 1;
+#endif
+}
+
+// copy n datagrams just sent to addr into the pcapng capture
+static void tx_capture(UdpIo* io, const struct sockaddr_in* addr, const UdpPeer* local,
+                       const uint8_t* const* data, const size_t* lens, size_t n) {
+    PcapngPkt pkts[UDP_TX_BATCH];
+    UdpPeer to = { addr->sin_addr.s_addr, addr->sin_port };
+    for (size_t i = 0; i < n; ++i) {
+        pkts[i].data = data[i];
+        pkts[i].len = (uint32_t)lens[i];
+        pkts[i].peer = to;
+    }
+    pcapng_writer_add(io->cap, PCAPNG_OUT, pcapng_now_ns(), local, pkts, n);
+}
+
+// send all datagrams, waiting for buffer space when needed; returns how many went out
+static size_t tx_all(UdpIo* io, int sock, const struct sockaddr_in* addr, const UdpPeer* local,
+                     const uint8_t* const* data, const size_t* lens, size_t count, size_t* bytes, int* err) {
+    size_t done = 0;
+    size_t start_bytes = *bytes;
+    while (done < count) {
+        int n = tx_submit(sock, addr, data + done, lens + done, count - done);
+        if (n < 0) {
+#ifndef _WIN32
+            if (errno == EINTR) continue;
+            if ((errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) && tx_wait_writable(sock)) continue;
+#endif
+            *err = errno;
+            break;
+        }
+        for (int i = 0; i < n; ++i) *bytes += lens[done + (size_t)i];
+        if (pcapng_writer_active(io->cap)) tx_capture(io, addr, local, data + done, lens + done, (size_t)n);
+        done += (size_t)n;
+    }
+    if (done) {
+        NET_COUNT(&io->tx, tx_packets, done);
+        NET_COUNT(&io->tx, tx_bytes, *bytes - start_bytes);
+    }
+    if (*err) NET_COUNT(&io->tx, tx_errors, 1);
+    return done;
+}
+
+// what must be a string literal
+static void tx_log_batch(const char* what, const struct sockaddr_in* addr,
+                         size_t done, size_t count, size_t bytes, int err) {
+    UdpPeer to = { addr->sin_addr.s_addr, addr->sin_port };
+    if (err) {
+        EVLOG("[SEND] %s %zu/%zu datagrams, %zu bytes -> %a, failed: errno=%d", EV_STR(what),
+              done, count, bytes, EV_PEER(&to), err);
     } else {
-        log_async(io, "[SEND] manual len=%u mode=%s -> %s:%d", (unsigned)payload_len,
-                  is_hex_mode ? "HEX" : "ASCII",
-                  io->target_ip ? io->target_ip : "127.0.0.1",
-                  io->target_port);
+        EVLOG("[SEND] %s %zu datagrams, %zu bytes -> %a", EV_STR(what), done, bytes, EV_PEER(&to));
+    }
+}
+
+size_t udp_io_send_batch(UdpIo* io, const uint8_t* const* data, const size_t* lens, size_t count) {
+    if (!io || !data || !lens || count == 0) return 0;
+    int sock;
+    struct sockaddr_in addr;
+    UdpPeer local;
+    if (!tx_target(io, &sock, &addr, &local)) return 0;
+
+    size_t bytes = 0;
+    int err = 0;
+    size_t done = tx_all(io, sock, &addr, &local, data, lens, count, &bytes, &err);
+    tx_log_batch("batch", &addr, done, count, bytes, err);
+    return done;
+}
+
+size_t udp_io_send_many(UdpIo* io, const uint8_t* const* data, const size_t* lens, size_t count, int* err) {
+    if (err) *err = 0;
+    if (!io || !data || !lens || count == 0) return 0;
+    int sock;
+    struct sockaddr_in addr;
+    UdpPeer local;
+    if (!tx_target(io, &sock, &addr, &local)) {
+        if (err) *err = ENOTCONN;
+        return 0;
+    }
+    size_t bytes = 0;
+    int e = 0;
+    size_t done = tx_all(io, sock, &addr, &local, data, lens, count, &bytes, &e);
+    if (err) *err = e;
+    return done;
+}
+
+void udp_io_send_raw_flush(UdpIo* io) {
+    if (!io) return;
+    UdpRawTx* rt = &io->raw;
+    if (rt->pkts == 0 && rt->failed == 0) return;
+    tx_log_batch("script", &rt->addr, rt->pkts, rt->pkts + rt->failed, rt->bytes, rt->err);
+    rt->pkts = rt->bytes = rt->failed = 0;
+    rt->err = 0;
+}
+
+gboolean udp_io_send_raw(UdpIo* io, const uint8_t* data, size_t len) {
+    if (!io || !data) return FALSE;
+    UdpRawTx* rt = &io->raw;
+    gint gen = g_atomic_int_get(&io->tx_gen);
+    if (gen != rt->gen) {
+        // totals so far went to the old target
+        udp_io_send_raw_flush(io);
+        rt->gen = gen;
+        if (!tx_target(io, &rt->sock, &rt->addr, &rt->local)) return FALSE;
     }
+    if (rt->sock < 0) return FALSE;
 
-    if (hex_buf) g_free(hex_buf);
-    return sent >= 0;
+    const uint8_t* ptrs[1] = { data };
+    size_t lens[1] = { len };
+    size_t bytes = 0;
+    int err = 0;
+    size_t done = tx_all(io, rt->sock, &rt->addr, &rt->local, ptrs, lens, 1, &bytes, &err);
+
+    gint64 now = g_get_monotonic_time();
+    if (rt->pkts == 0 && rt->failed == 0) rt->log_at = now;
+    rt->pkts += done;
+    rt->bytes += bytes;
+    if (err) {
+        rt->failed++;
+        rt->err = err;
+    }
+    if (now - rt->log_at >= G_USEC_PER_SEC) udp_io_send_raw_flush(io);
+    return done == 1;
+}
+
+size_t udp_io_send_burst(UdpIo* io, const uint8_t* data, size_t len, size_t count) {
+    if (!io || !data || count == 0) return 0;
+    int sock;
+    struct sockaddr_in addr;
+    UdpPeer local;
+    if (!tx_target(io, &sock, &addr, &local)) return 0;
+
+    const uint8_t* ptrs[UDP_TX_BATCH];
+    size_t lens[UDP_TX_BATCH];
+    for (size_t i = 0; i < UDP_TX_BATCH; ++i) {
+        ptrs[i] = data;
+        lens[i] = len;
+    }
+    size_t done = 0;
+    size_t bytes = 0;
+    int err = 0;
+    while (done < count && !err) {
+        size_t chunk = MIN(count - done, (size_t)UDP_TX_BATCH);
+        done += tx_all(io, sock, &addr, &local, ptrs, lens, chunk, &bytes, &err);
+    }
+    tx_log_batch("burst", &addr, done, count, bytes, err);
+    return done;
+}
+
+gboolean udp_io_capture_start(UdpIo* io, const char* path, GError** error) {
+    if (!io) return FALSE;
+    if (!pcapng_writer_start(io->cap, path, error)) return FALSE;
+    EVLOG("[CAP] capturing to %S", EV_DUP(path));
+    return TRUE;
+}
+
+void udp_io_capture_stop(UdpIo* io) {
+    if (!io || !pcapng_writer_stop(io->cap)) return;
+    PcapngStats st;
+    pcapng_writer_stats(io->cap, &st);
+    EVLOG("[CAP] stopped: %zu packets, %zu bytes written, %zu dropped%s", (size_t)st.packets,
+          (size_t)st.bytes, (size_t)st.dropped, EV_STR(st.failed ? " (write failed)" : ""));
+}
+
+gboolean udp_io_capturing(UdpIo* io) {
+    return io && pcapng_writer_active(io->cap);
+}
+
+int udp_io_counters(UdpIo* io, NetTotals* total, NetTotals* per_shard, int max) {
+    if (total) memset(total, 0, sizeof(*total));
+    if (!io) return 0;
+    g_mutex_lock(&io->lock);
+    int n = io->nshards;
+    for (int i = 0; i < n; ++i) {
+        const NetCounters* ctr = &io->shards[i]->ctr;
+        net_counters_read(ctr, total);
+        if (per_shard && i < max) {
+            memset(&per_shard[i], 0, sizeof(per_shard[i]));
+            net_counters_read(ctr, &per_shard[i]);
+        }
+    }
+    net_counters_read(&io->tx, total);
+    g_mutex_unlock(&io->lock);
+    return n;
 }
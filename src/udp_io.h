@@ -6,25 +6,75 @@
 extern "C" {
 #endif
 
-typedef void (*udp_log_fn)(void* user, const char* line);
-typedef void (*udp_packet_fn)(void* user, const uint8_t* data, size_t len);
+// pkt_fn is always invoked on the main loop (default GMainContext), never on the receive thread
+typedef void (*udp_packet_fn)(void* user, const uint8_t* data, size_t len,
+                              const UdpPeer* from, int64_t ts_us);
 
 typedef struct UdpIo UdpIo;
 
-UdpIo* udp_io_new(udp_log_fn log_cb, void* log_user,
-				  udp_packet_fn pkt_cb, void* pkt_user);
+const char* udp_peer_format(const UdpPeer* peer, char* buf, size_t len);
+
+// status and errors are recorded in the event log (event_log.h)
+UdpIo* udp_io_new(udp_packet_fn pkt_cb, void* pkt_user);
 void udp_io_free(UdpIo* io);
 
 // store/copy config (strings are duplicated)
 gboolean udp_io_apply_config(UdpIo* io, const NetConfig* cfg);
 
-// open/close socket for current config
+// open/close socket for current config. With rx_shards > 1 (Linux) that many
+// sockets share local_ip:local_port via SO_REUSEPORT, each drained by its own
+// thread pinned to a core. Call from the main loop (display rings are resized).
+// With NetConfig.reflect the receive threads send every datagram straight back
+// to its sender from the receive buffer (sendmmsg per batch on Linux) and skip
+// the display; datagrams over the receive slot (2 KiB) come back truncated.
 gboolean udp_io_open(UdpIo* io);
 void udp_io_close(UdpIo* io);
 
 // send payload (hex parsing when is_hex_mode=1)
 gboolean udp_io_send(UdpIo* io, const uint8_t* data, size_t len, int is_hex_mode);
 
+// send count raw payloads to the configured target; the destination is
+// resolved once and datagrams go out via sendmmsg() where available.
+// Logs one line per call; returns the number of datagrams sent.
+size_t udp_io_send_batch(UdpIo* io, const uint8_t* const* data, const size_t* lens, size_t count);
+
+// like udp_io_send_batch but without the log line, for callers that report
+// their own totals (replay); *err receives the errno of a failed send
+size_t udp_io_send_many(UdpIo* io, const uint8_t* const* data, const size_t* lens, size_t count, int* err);
+
+// send one raw payload to the configured target for a load generator (the
+// script VM): the target is cached until the next apply_config/open/close,
+// a full send buffer is waited out as in the batch sends, and the totals are
+// logged once a second rather than per datagram. One thread at a time;
+// udp_io_send_raw_flush logs what is left once that thread is done.
+gboolean udp_io_send_raw(UdpIo* io, const uint8_t* data, size_t len);
+void udp_io_send_raw_flush(UdpIo* io);
+
+// send the same raw payload count times (load generation)
+size_t udp_io_send_burst(UdpIo* io, const uint8_t* data, size_t len, size_t count);
+
+// stream every datagram received or sent to a pcapng file (pcapng_writer.h);
+// capture survives udp_io_open/close and stops on udp_io_capture_stop/udp_io_free
+gboolean udp_io_capture_start(UdpIo* io, const char* path, GError** error);
+void udp_io_capture_stop(UdpIo* io);
+gboolean udp_io_capturing(UdpIo* io);
+
+// traffic counters since udp_io_open: total gets every shard plus the send
+// side, per_shard (optional) up to max receive-only entries. Returns the
+// number of shards open (0 when closed). Any thread; never blocks the I/O.
+int udp_io_counters(UdpIo* io, NetTotals* total, NetTotals* per_shard, int max);
+
+// RTT probe (rtt_probe.h) whose replies the receive threads match; set it
+// while closed, it is picked up by the next udp_io_open
+struct RttProbe;
+void udp_io_set_probe(UdpIo* io, struct RttProbe* probe);
+// SO_TIMESTAMPING on every socket, kept across reopen; returns TRUE when the
+// kernel accepted it (never on non-Linux, where the probe uses clock_gettime)
+gboolean udp_io_timestamping(UdpIo* io, gboolean on);
+// send one probe to the target, with transmit stamps while timestamping;
+// no log event. Returns 0 or the errno of the failed send.
+int udp_io_send_probe(UdpIo* io, const uint8_t* data, size_t len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,9 +1,18 @@
 #include "ui_main.h"
 #include <string.h>
+#include "pkt_list_model.h"
+#include "hexfmt.h"
+#include "event_log.h"
+#include "log_list_model.h"
+#include "script_highlight.h"
 #if defined(HAVE_GTK_SOURCE) || defined(HAVE_GTK_SOURCE_5)
 #include <gtksourceview/gtksource.h>
 #endif
 
+// script highlighting: lines per rescan and time allowed per idle pass
+#define SCRIPT_HL_SLICE_LINES 256
+#define SCRIPT_HL_BUDGET_US 4000
+
 struct UIMain {
     GtkApplication* app;
     GtkWindow* win;
@@ -13,6 +22,11 @@ struct UIMain {
 
     // ÿؼֻؼ
     GtkDropDown* dd_proto;
+    GtkDropDown* dd_tcp_role;
+    GtkSpinButton* sp_tcp_clients;
+    GtkDropDown* dd_framing;
+    GtkSpinButton* sp_rx_shards;
+    GtkCheckButton* ck_reflect;
     GtkEntry*    ent_local_ip;
     GtkSpinButton* sp_local_port;
 
@@ -23,11 +37,30 @@ struct UIMain {
     GtkToggleButton* tg_tx_hex;
 
     // Ҳ־/ű
-    GtkTextView* tv_log;
-    GtkTextBuffer* buf_log;
-
-    GtkTextView* tv_pkt;
-    GtkTextBuffer* buf_pkt;
+    // event log history; rows are rendered from binary events on bind
+    LogListModel* log_model;
+    GtkListView* lv_log;
+    GtkScrolledWindow* sc_log;
+    GtkToggleButton* tg_capture;
+    gboolean capture_syncing;   // set while the toggle is updated programmatically
+    GtkSpinButton* sp_replay_speed;
+    GtkToggleButton* tg_probe;
+    gboolean probe_syncing;
+    GtkSpinButton* sp_probe_rate;
+
+    // status bar: per-second traffic readout and the metrics export toggle
+    GtkLabel* lb_metrics;
+    GtkToggleButton* tg_metrics;
+    gboolean metrics_syncing;
+
+    // captured packets: compact store behind a virtualized list; hexdump
+    // text is only produced for rows the list view binds
+    PktStore* pkt_store;
+    PktListModel* pkt_model;
+    GtkListView* lv_pkt;
+    GtkScrolledWindow* sc_pkt;
+    guint pkt_sync_id;          // pending model sync (one per main-loop iteration)
+    gboolean pkt_full_logged;
 
     GtkTextView* tv_script;
     GtkTextBuffer* buf_script;
@@ -39,6 +72,12 @@ struct UIMain {
     GtkTextTag* tag_num;
     GtkTextTag* tag_pp;
     GtkTextTag* tag_op;
+    // lines edited since the last highlighting pass, kept between two marks so
+    // later edits shift them; rescanned from an idle source in timed slices
+    GtkTextMark* hl_dirty_start;
+    GtkTextMark* hl_dirty_end;
+    guint hl_idle_id;
+    int gutter_lines;           // numbers currently shown in the gutter
 
     // ű۵ʡԣͬһ־
     GtkLabel* lb_script_state;
@@ -57,39 +96,108 @@ struct UIMain {
     GtkButton* btn_stop;
 };
 
-static void apply_script_highlight(UIMain* ui);
+static gboolean list_at_bottom(GtkScrolledWindow* sc) {
+    GtkAdjustment* adj = gtk_scrolled_window_get_vadjustment(sc);
+    return gtk_adjustment_get_value(adj) + gtk_adjustment_get_page_size(adj)
+           >= gtk_adjustment_get_upper(adj) - 4.0;
+}
 
-static void append_text(GtkTextBuffer* b, const char* s) {
-    GtkTextIter end;
-    gtk_text_buffer_get_end_iter(b, &end);
-    gtk_text_buffer_insert(b, &end, s, -1);
-    gtk_text_buffer_insert(b, &end, "\n", -1);
+static void list_scroll_to_end(GtkListView* lv, GtkScrolledWindow* sc, guint n_items) {
+    if (n_items == 0) return;
+#if GTK_CHECK_VERSION(4, 12, 0)
+    (void)sc;
+    gtk_list_view_scroll_to(lv, n_items - 1, GTK_LIST_SCROLL_NONE, NULL);
+#else
+    (void)lv;
+    GtkAdjustment* adj = gtk_scrolled_window_get_vadjustment(sc);
+    gtk_adjustment_set_value(adj, gtk_adjustment_get_upper(adj));
+#endif
 }
 
-static void append_hexdump(GtkTextBuffer* b, const uint8_t* data, size_t len) {
-    if (!b || !data || len == 0) return;
-    GString* out = g_string_new(NULL);
-    for (size_t i = 0; i < len; i += 16) {
-        g_string_append_printf(out, "%08zx  ", i);
-        for (size_t j = 0; j < 16; ++j) {
-            if (i + j < len) g_string_append_printf(out, "%02x ", data[i + j]);
-            else g_string_append(out, "   ");
-            if (j == 7) g_string_append(out, " ");
-        }
-        g_string_append(out, " | ");
-        size_t ascii_count = (len - i) < 16 ? (len - i) : 16;
-        for (size_t j = 0; j < ascii_count; ++j) {
-            uint8_t c = data[i + j];
-            g_string_append_c(out, (c >= 32 && c <= 126) ? (char)c : '.');
-        }
-        for (size_t j = ascii_count; j < 16; ++j) g_string_append_c(out, ' ');
-        g_string_append(out, " |");
-        g_string_append(out, "\n");
+// one packet row: "#idx  time  peer  len" header followed by the hexdump
+static void format_packet_row(GString* out, guint idx, const PktRecord* rec, const uint8_t* data) {
+    const uint8_t* ip = (const uint8_t*)&rec->addr;
+    const uint8_t* port = (const uint8_t*)&rec->port;
+    GDateTime* dt = g_date_time_new_from_unix_local(rec->ts_us / G_USEC_PER_SEC);
+    char* hms = dt ? g_date_time_format(dt, "%H:%M:%S") : NULL;
+    g_string_append_printf(out, "#%u  %s.%06u  %u.%u.%u.%u:%u  %u bytes\n",
+                           idx + 1, hms ? hms : "--:--:--",
+                           (unsigned)(rec->ts_us % G_USEC_PER_SEC),
+                           ip[0], ip[1], ip[2], ip[3], (unsigned)((port[0] << 8) | port[1]),
+                           (unsigned)rec->len);
+    g_free(hms);
+    if (dt) g_date_time_unref(dt);
+    hexdump_append(out, data, rec->len);
+    if (out->len > 0 && out->str[out->len - 1] == '\n') g_string_truncate(out, out->len - 1);
+}
+
+static void on_pkt_row_setup(GtkSignalListItemFactory* f, GtkListItem* item, gpointer user_data) {
+    (void)f; (void)user_data;
+    GtkWidget* lb = gtk_label_new(NULL);
+    gtk_label_set_xalign(GTK_LABEL(lb), 0.0f);
+    gtk_widget_add_css_class(lb, "monospace");
+    gtk_widget_set_margin_start(lb, 6);
+    gtk_widget_set_margin_end(lb, 6);
+    gtk_widget_set_margin_bottom(lb, 4);
+    gtk_list_item_set_child(item, lb);
+}
+
+static void on_pkt_row_bind(GtkSignalListItemFactory* f, GtkListItem* item, gpointer user_data) {
+    (void)f;
+    UIMain* ui = (UIMain*)user_data;
+    GtkLabel* lb = GTK_LABEL(gtk_list_item_get_child(item));
+    guint idx = pkt_row_index(PKT_ROW(gtk_list_item_get_item(item)));
+    const PktRecord* rec = pkt_store_get(ui->pkt_store, idx);
+    const uint8_t* data = pkt_store_data(ui->pkt_store, rec);
+    if (!rec || !data) {
+        gtk_label_set_text(lb, "");
+        return;
     }
-    append_text(b, out->str);
+    GString* out = g_string_sized_new(96 + HEXDUMP_SIZE((gsize)rec->len));
+    format_packet_row(out, idx, rec, data);
+    gtk_label_set_text(lb, out->str);
     g_string_free(out, TRUE);
 }
 
+// publish packets stored since the last sync; keeps following the tail
+// while the view is scrolled to the bottom
+static gboolean pkt_sync_idle_cb(gpointer data) {
+    UIMain* ui = (UIMain*)data;
+    ui->pkt_sync_id = 0;
+
+    gboolean follow = list_at_bottom(ui->sc_pkt);
+    if (pkt_list_model_sync(ui->pkt_model) > 0 && follow)
+        list_scroll_to_end(ui->lv_pkt, ui->sc_pkt, pkt_store_count(ui->pkt_store));
+    return G_SOURCE_REMOVE;
+}
+
+static void on_log_row_setup(GtkSignalListItemFactory* f, GtkListItem* item, gpointer user_data) {
+    (void)f; (void)user_data;
+    GtkWidget* lb = gtk_label_new(NULL);
+    gtk_label_set_xalign(GTK_LABEL(lb), 0.0f);
+    gtk_widget_add_css_class(lb, "monospace");
+    gtk_widget_set_margin_start(lb, 6);
+    gtk_widget_set_margin_end(lb, 6);
+    gtk_list_item_set_child(item, lb);
+}
+
+static void on_log_row_bind(GtkSignalListItemFactory* f, GtkListItem* item, gpointer user_data) {
+    (void)f; (void)user_data;
+    GtkLabel* lb = GTK_LABEL(gtk_list_item_get_child(item));
+    GString* out = g_string_sized_new(128);
+    evlog_format(log_row_seq(LOG_ROW(gtk_list_item_get_item(item))), out);
+    gtk_label_set_text(lb, out->str);
+    g_string_free(out, TRUE);
+}
+
+// event log collected a batch (main loop, at most once per frame)
+static void on_evlog_changed(void* user, guint removed, guint added) {
+    UIMain* ui = (UIMain*)user;
+    gboolean follow = list_at_bottom(ui->sc_log);
+    log_list_model_apply(ui->log_model, removed, added);
+    if (added && follow) list_scroll_to_end(ui->lv_log, ui->sc_log, evlog_count());
+}
+
 static NetConfig ui_collect_cfg(UIMain* ui) {
     NetConfig c;
     memset(&c, 0, sizeof(c));
@@ -102,6 +210,14 @@ static NetConfig ui_collect_cfg(UIMain* ui) {
 
     c.rx_hex = gtk_toggle_button_get_active(ui->tg_rx_hex) ? 1 : 0;
     c.tx_hex = gtk_toggle_button_get_active(ui->tg_tx_hex) ? 1 : 0;
+
+    c.proto = gtk_drop_down_get_selected(ui->dd_proto) == 1 ? NET_PROTO_TCP : NET_PROTO_UDP;
+    c.tcp_server = gtk_drop_down_get_selected(ui->dd_tcp_role) == 1 ? 1 : 0;
+    c.tcp_clients = (int)gtk_spin_button_get_value(ui->sp_tcp_clients);
+    c.framing = (NetFraming)gtk_drop_down_get_selected(ui->dd_framing);
+    c.frame_delim = '\n';
+    c.rx_shards = (int)gtk_spin_button_get_value(ui->sp_rx_shards);
+    c.reflect = gtk_check_button_get_active(ui->ck_reflect) ? 1 : 0;
     return c;
 }
 
@@ -116,10 +232,188 @@ static void on_apply_clicked(GtkButton* b, gpointer user_data) {
 static void on_clear_log_clicked(GtkButton* b, gpointer user_data) {
     (void)b;
     UIMain* ui = (UIMain*)user_data;
-    gtk_text_buffer_set_text(ui->buf_log, "", -1);
+    evlog_clear();
     if (ui->api && ui->api->on_clear_log) ui->api->on_clear_log(ui->api_user);
 }
 
+static void export_log_to(const char* path) {
+    GError* err = NULL;
+    if (evlog_export(path, &err)) {
+        EVLOG("[UI] log exported to %S (%u events)", EV_DUP(path), evlog_count());
+    } else {
+        EVLOG("[UI] log export failed: %S", EV_DUP(err ? err->message : path));
+        g_clear_error(&err);
+    }
+}
+
+#if GTK_CHECK_VERSION(4,10,0)
+static void on_export_dialog_done(GObject* source_object, GAsyncResult* res, gpointer user_data) {
+    (void)user_data;
+    GFile* file = gtk_file_dialog_save_finish(GTK_FILE_DIALOG(source_object), res, NULL);
+    if (!file) return;
+    char* path = g_file_get_path(file);
+    if (path) export_log_to(path);
+    g_free(path);
+    g_object_unref(file);
+}
+#endif
+
+static void on_export_log_clicked(GtkButton* b, gpointer user_data) {
+    (void)b;
+    UIMain* ui = (UIMain*)user_data;
+#if GTK_CHECK_VERSION(4,10,0)
+    GtkFileDialog* dlg = gtk_file_dialog_new();
+    gtk_file_dialog_set_initial_name(dlg, "netassist_log.txt");
+    gtk_file_dialog_save(dlg, GTK_WINDOW(ui->win), NULL, (GAsyncReadyCallback)on_export_dialog_done, ui);
+    g_object_unref(dlg);
+#else
+    (void)ui;
+    export_log_to("netassist_log.txt");
+#endif
+}
+
+static void capture_toggle_set(UIMain* ui, gboolean on) {
+    ui->capture_syncing = TRUE;
+    gtk_toggle_button_set_active(ui->tg_capture, on);
+    ui->capture_syncing = FALSE;
+}
+
+static void capture_start_to(UIMain* ui, const char* path) {
+    int ok = ui->api && ui->api->on_capture_start && ui->api->on_capture_start(ui->api_user, path);
+    capture_toggle_set(ui, ok ? TRUE : FALSE);
+}
+
+#if GTK_CHECK_VERSION(4,10,0)
+static void on_capture_dialog_done(GObject* source_object, GAsyncResult* res, gpointer user_data) {
+    UIMain* ui = (UIMain*)user_data;
+    GFile* file = gtk_file_dialog_save_finish(GTK_FILE_DIALOG(source_object), res, NULL);
+    char* path = file ? g_file_get_path(file) : NULL;
+    if (path) capture_start_to(ui, path);
+    else capture_toggle_set(ui, FALSE);
+    g_free(path);
+    if (file) g_object_unref(file);
+}
+#endif
+
+static void on_capture_toggled(GtkToggleButton* b, gpointer user_data) {
+    UIMain* ui = (UIMain*)user_data;
+    if (ui->capture_syncing) return;
+    if (!gtk_toggle_button_get_active(b)) {
+        if (ui->api && ui->api->on_capture_stop) ui->api->on_capture_stop(ui->api_user);
+        return;
+    }
+#if GTK_CHECK_VERSION(4,10,0)
+    GtkFileDialog* dlg = gtk_file_dialog_new();
+    gtk_file_dialog_set_initial_name(dlg, "netassist_capture.pcapng");
+    gtk_file_dialog_save(dlg, GTK_WINDOW(ui->win), NULL, (GAsyncReadyCallback)on_capture_dialog_done, ui);
+    g_object_unref(dlg);
+#else
+    capture_start_to(ui, "netassist_capture.pcapng");
+#endif
+}
+
+static void metrics_toggle_set(UIMain* ui, gboolean on) {
+    ui->metrics_syncing = TRUE;
+    gtk_toggle_button_set_active(ui->tg_metrics, on);
+    ui->metrics_syncing = FALSE;
+}
+
+static void metrics_start_to(UIMain* ui, const char* path) {
+    int ok = ui->api && ui->api->on_metrics_export_start && ui->api->on_metrics_export_start(ui->api_user, path);
+    metrics_toggle_set(ui, ok ? TRUE : FALSE);
+}
+
+#if GTK_CHECK_VERSION(4,10,0)
+static void on_metrics_dialog_done(GObject* source_object, GAsyncResult* res, gpointer user_data) {
+    UIMain* ui = (UIMain*)user_data;
+    GFile* file = gtk_file_dialog_save_finish(GTK_FILE_DIALOG(source_object), res, NULL);
+    char* path = file ? g_file_get_path(file) : NULL;
+    if (path) metrics_start_to(ui, path);
+    else metrics_toggle_set(ui, FALSE);
+    g_free(path);
+    if (file) g_object_unref(file);
+}
+#endif
+
+static void on_metrics_toggled(GtkToggleButton* b, gpointer user_data) {
+    UIMain* ui = (UIMain*)user_data;
+    if (ui->metrics_syncing) return;
+    if (!gtk_toggle_button_get_active(b)) {
+        if (ui->api && ui->api->on_metrics_export_stop) ui->api->on_metrics_export_stop(ui->api_user);
+        return;
+    }
+#if GTK_CHECK_VERSION(4,10,0)
+    GtkFileDialog* dlg = gtk_file_dialog_new();
+    gtk_file_dialog_set_initial_name(dlg, "netassist_metrics.csv");
+    gtk_file_dialog_save(dlg, GTK_WINDOW(ui->win), NULL, (GAsyncReadyCallback)on_metrics_dialog_done, ui);
+    g_object_unref(dlg);
+#else
+    metrics_start_to(ui, "netassist_metrics.csv");
+#endif
+}
+
+static void probe_toggle_set(UIMain* ui, gboolean on) {
+    ui->probe_syncing = TRUE;
+    gtk_toggle_button_set_active(ui->tg_probe, on);
+    ui->probe_syncing = FALSE;
+}
+
+static void on_probe_toggled(GtkToggleButton* b, gpointer user_data) {
+    UIMain* ui = (UIMain*)user_data;
+    if (ui->probe_syncing) return;
+    if (!gtk_toggle_button_get_active(b)) {
+        if (ui->api && ui->api->on_probe_stop) ui->api->on_probe_stop(ui->api_user);
+        return;
+    }
+    // runs until toggled off; the distribution shows in the status bar
+    ProbeConfig cfg = { (unsigned)gtk_spin_button_get_value_as_int(ui->sp_probe_rate), 0, 0 };
+    int ok = ui->api && ui->api->on_probe_start && ui->api->on_probe_start(ui->api_user, &cfg);
+    if (!ok) probe_toggle_set(ui, FALSE);
+}
+
+static void replay_start_from(UIMain* ui, const char* path) {
+    double speed = gtk_spin_button_get_value(ui->sp_replay_speed);
+    if (ui->api && ui->api->on_replay_start) ui->api->on_replay_start(ui->api_user, path, speed);
+}
+
+#if GTK_CHECK_VERSION(4,10,0)
+static void on_replay_dialog_done(GObject* source_object, GAsyncResult* res, gpointer user_data) {
+    UIMain* ui = (UIMain*)user_data;
+    GFile* file = gtk_file_dialog_open_finish(GTK_FILE_DIALOG(source_object), res, NULL);
+    if (!file) return;
+    char* path = g_file_get_path(file);
+    if (path) replay_start_from(ui, path);
+    g_free(path);
+    g_object_unref(file);
+}
+#endif
+
+static void on_replay_clicked(GtkButton* b, gpointer user_data) {
+    (void)b;
+    UIMain* ui = (UIMain*)user_data;
+#if GTK_CHECK_VERSION(4,10,0)
+    GtkFileDialog* dlg = gtk_file_dialog_new();
+    gtk_file_dialog_open(dlg, GTK_WINDOW(ui->win), NULL, (GAsyncReadyCallback)on_replay_dialog_done, ui);
+    g_object_unref(dlg);
+#else
+    replay_start_from(ui, "netassist_capture.pcapng");
+#endif
+}
+
+static void on_replay_stop_clicked(GtkButton* b, gpointer user_data) {
+    (void)b;
+    UIMain* ui = (UIMain*)user_data;
+    if (ui->api && ui->api->on_replay_stop) ui->api->on_replay_stop(ui->api_user);
+}
+
+static void on_clear_pkt_clicked(GtkButton* b, gpointer user_data) {
+    (void)b;
+    UIMain* ui = (UIMain*)user_data;
+    pkt_store_clear(ui->pkt_store);
+    pkt_list_model_reset(ui->pkt_model);
+    ui->pkt_full_logged = FALSE;
+}
+
 static void on_send_clicked(GtkButton* b, gpointer user_data) {
     (void)b;
     UIMain* ui = (UIMain*)user_data;
@@ -165,85 +459,150 @@ static void on_script_stop(GtkButton* b, gpointer user_data) {
     if (ui->api && ui->api->on_script_stop) ui->api->on_script_stop(ui->api_user);
 }
 
-static void on_script_buffer_changed(GtkTextBuffer* buf, gpointer user_data) {
-    UIMain* ui = (UIMain*)user_data;
-    // if custom gutter exists, update it; otherwise rely on GtkSourceView's line numbers
-    if (ui->tv_script_gutter) {
-        int lines = gtk_text_buffer_get_line_count(buf);
+// append or drop only the numbers for lines added or removed
+static void script_gutter_sync(UIMain* ui) {
+    if (!ui->tv_script_gutter) return;
+    int lines = gtk_text_buffer_get_line_count(ui->buf_script);
+    GtkTextBuffer* gb = gtk_text_view_get_buffer(ui->tv_script_gutter);
+    if (lines > ui->gutter_lines) {
         GString* s = g_string_new(NULL);
-        for (int i = 1; i <= lines; ++i) g_string_append_printf(s, "%d\n", i);
-        GtkTextBuffer* gb = gtk_text_view_get_buffer(ui->tv_script_gutter);
-        if (gb) gtk_text_buffer_set_text(gb, s->str, -1);
+        for (int i = ui->gutter_lines + 1; i <= lines; ++i) g_string_append_printf(s, "%d\n", i);
+        GtkTextIter end;
+        gtk_text_buffer_get_end_iter(gb, &end);
+        gtk_text_buffer_insert(gb, &end, s->str, (int)s->len);
         g_string_free(s, TRUE);
+    } else if (lines < ui->gutter_lines) {
+        // gutter line k shows number k+1: keep lines 0..lines-1
+        GtkTextIter from, end;
+        gtk_text_buffer_get_iter_at_line(gb, &from, lines);
+        gtk_text_buffer_get_end_iter(gb, &end);
+        gtk_text_buffer_delete(gb, &from, &end);
     }
+    ui->gutter_lines = lines;
+}
+
+static void on_script_buffer_changed(GtkTextBuffer* buf, gpointer user_data) {
+    (void)buf;
+    // if custom gutter exists, update it; otherwise rely on GtkSourceView's line numbers
+    script_gutter_sync((UIMain*)user_data);
+}
 
-    apply_script_highlight(ui);
+// spans of one slice of whole lines; offsets are bytes into the slice text
+typedef struct {
+    UIMain* ui;
+    int first_line;
+    const int* line_start;      // byte offset of each line in the slice
+    int nlines;
+} HlSlice;
+
+static int slice_line_of(const HlSlice* hs, int off) {
+    int lo = 0, hi = hs->nlines - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (hs->line_start[mid] <= off) lo = mid;
+        else hi = mid - 1;
+    }
+    return lo;
 }
 
-/* simple regex-based highlighting for our DSL (works in both GtkSourceView and plain TextView) */
-static void apply_script_highlight(UIMain* ui) {
-    if (!ui || !ui->buf_script) return;
+static void on_highlight_span(void* user, ScriptHlKind kind, int start, int end) {
+    HlSlice* hs = (HlSlice*)user;
+    UIMain* ui = hs->ui;
+    GtkTextTag* tags[SCRIPT_HL_COUNT] = {
+        ui->tag_kw, ui->tag_str, ui->tag_comment, ui->tag_num, ui->tag_pp, ui->tag_op,
+    };
+    if (!tags[kind] || end <= start) return;
+    int ls = slice_line_of(hs, start), le = slice_line_of(hs, end - 1);
+    GtkTextIter ts, te;
+    gtk_text_buffer_get_iter_at_line_index(ui->buf_script, &ts, hs->first_line + ls, start - hs->line_start[ls]);
+    gtk_text_buffer_get_iter_at_line_index(ui->buf_script, &te, hs->first_line + le, end - hs->line_start[le]);
+    gtk_text_buffer_apply_tag(ui->buf_script, tags[kind], &ts, &te);
+}
 
+// retag lines [first, last]
+static void script_highlight_lines(UIMain* ui, int first, int last) {
     GtkTextIter start, end;
-    gtk_text_buffer_get_bounds(ui->buf_script, &start, &end);
-    // clear previous tags
-    gtk_text_buffer_remove_tag(ui->buf_script, ui->tag_kw, &start, &end);
-    gtk_text_buffer_remove_tag(ui->buf_script, ui->tag_str, &start, &end);
-    gtk_text_buffer_remove_tag(ui->buf_script, ui->tag_comment, &start, &end);
-    gtk_text_buffer_remove_tag(ui->buf_script, ui->tag_num, &start, &end);
-    gtk_text_buffer_remove_tag(ui->buf_script, ui->tag_pp, &start, &end);
-    gtk_text_buffer_remove_tag(ui->buf_script, ui->tag_op, &start, &end);
-
-    // compile regexes once
-    static GRegex* re_kw = NULL;
-    static GRegex* re_str = NULL;
-    static GRegex* re_comment = NULL;
-    static GRegex* re_num = NULL;
-    static GRegex* re_pp = NULL;
-    static GRegex* re_op = NULL;
-    if (!re_kw) {
-        re_kw = g_regex_new("\\b(loop|break|continue|if|else|return|fn|let|var|while|for|sleep|udp\\.send|rand_int|rand_bytes|byte_at|crc16|printf)\\b", G_REGEX_OPTIMIZE | G_REGEX_MULTILINE, 0, NULL);
-        re_str = g_regex_new("\"([^\"\\\\]|\\\\.)*\"", G_REGEX_OPTIMIZE | G_REGEX_MULTILINE, 0, NULL);
-        re_comment = g_regex_new("//.*$", G_REGEX_OPTIMIZE | G_REGEX_MULTILINE, 0, NULL);
-        re_num = g_regex_new("\\b[0-9]+(\\.[0-9]+)?\\b", G_REGEX_OPTIMIZE | G_REGEX_MULTILINE, 0, NULL);
-        re_pp = g_regex_new("^\\s*(#\\w+|%define|%set|%include).*$", G_REGEX_OPTIMIZE | G_REGEX_MULTILINE, 0, NULL);
-        re_op = g_regex_new("[\\(\\)\\{\\}\\[\\]\\+\\-\\*/=<>!]+", G_REGEX_OPTIMIZE | G_REGEX_MULTILINE, 0, NULL);
-    }
+    gtk_text_buffer_get_iter_at_line(ui->buf_script, &start, first);
+    gtk_text_buffer_get_iter_at_line(ui->buf_script, &end, last);
+    if (!gtk_text_iter_ends_line(&end)) gtk_text_iter_forward_to_line_end(&end);
 
-    char* text = gtk_text_buffer_get_text(ui->buf_script, &start, &end, FALSE);
-    if (!text) return;
+    GtkTextTag* tags[] = { ui->tag_kw, ui->tag_str, ui->tag_comment, ui->tag_num, ui->tag_pp, ui->tag_op };
+    for (guint i = 0; i < G_N_ELEMENTS(tags); ++i)
+        gtk_text_buffer_remove_tag(ui->buf_script, tags[i], &start, &end);
 
-    GMatchInfo* info = NULL;
-    // helper macro to avoid repetition
-#define APPLY_TAG(re, tagptr) \
-    do { \
-        if ((re) && (tagptr)) { \
-            g_regex_match((re), text, G_REGEX_MATCH_NOTEMPTY, &info); \
-            while (info && g_match_info_matches(info)) { \
-                int s = 0, e = 0; \
-                if (g_match_info_fetch_pos(info, 0, &s, &e)) { \
-                    GtkTextIter ts, te; \
-                    gtk_text_buffer_get_iter_at_offset(ui->buf_script, &ts, s); \
-                    gtk_text_buffer_get_iter_at_offset(ui->buf_script, &te, e); \
-                    gtk_text_buffer_apply_tag(ui->buf_script, (tagptr), &ts, &te); \
-                } \
-                g_match_info_next(info, NULL); \
-            } \
-            if (info) { g_match_info_free(info); info = NULL; } \
-        } \
-    } while (0)
-
-    APPLY_TAG(re_kw, ui->tag_kw);
-    APPLY_TAG(re_str, ui->tag_str);
-    APPLY_TAG(re_comment, ui->tag_comment);
-    APPLY_TAG(re_num, ui->tag_num);
-    APPLY_TAG(re_pp, ui->tag_pp);
-    APPLY_TAG(re_op, ui->tag_op);
-
-#undef APPLY_TAG
+    // the slice keeps one byte per byte of the buffer line, so offsets map to line indexes
+    char* text = gtk_text_buffer_get_slice(ui->buf_script, &start, &end, TRUE);
+    if (!text) return;
+    int nlines = last - first + 1;
+    int* line_start = g_new(int, nlines);
+    line_start[0] = 0;
+    int n = 1;
+    for (const char* p = text; *p && n < nlines; ++p)
+        if (*p == '\n') line_start[n++] = (int)(p - text) + 1;
+    HlSlice hs = { ui, first, line_start, n };
+    script_highlight_scan(text, on_highlight_span, &hs);
+    g_free(line_start);
     g_free(text);
 }
 
+// one timed slice of the pending highlighting; the rest waits for the next idle
+static gboolean script_highlight_idle(gpointer user_data) {
+    UIMain* ui = (UIMain*)user_data;
+    gint64 deadline = g_get_monotonic_time() + SCRIPT_HL_BUDGET_US;
+    GtkTextIter it;
+    gtk_text_buffer_get_iter_at_mark(ui->buf_script, &it, ui->hl_dirty_start);
+    int line = gtk_text_iter_get_line(&it);
+    gtk_text_buffer_get_iter_at_mark(ui->buf_script, &it, ui->hl_dirty_end);
+    int last = gtk_text_iter_get_line(&it);
+
+    while (line <= last) {
+        int upto = MIN(line + SCRIPT_HL_SLICE_LINES - 1, last);
+        script_highlight_lines(ui, line, upto);
+        line = upto + 1;
+        if (g_get_monotonic_time() >= deadline) break;
+    }
+    if (line <= last) {
+        gtk_text_buffer_get_iter_at_line(ui->buf_script, &it, line);
+        gtk_text_buffer_move_mark(ui->buf_script, ui->hl_dirty_start, &it);
+        return G_SOURCE_CONTINUE;
+    }
+    ui->hl_idle_id = 0;
+    return G_SOURCE_REMOVE;
+}
+
+// queue the whole lines touching [a, b] for highlighting
+static void script_highlight_invalidate(UIMain* ui, const GtkTextIter* a, const GtkTextIter* b) {
+    if (!ui->hl_dirty_start) return;
+    GtkTextIter from = *a, to = *b;
+    gtk_text_iter_set_line_offset(&from, 0);
+    if (ui->hl_idle_id) {
+        GtkTextIter cur;
+        gtk_text_buffer_get_iter_at_mark(ui->buf_script, &cur, ui->hl_dirty_start);
+        if (gtk_text_iter_compare(&cur, &from) < 0) from = cur;
+        gtk_text_buffer_get_iter_at_mark(ui->buf_script, &cur, ui->hl_dirty_end);
+        if (gtk_text_iter_compare(&cur, &to) > 0) to = cur;
+    }
+    gtk_text_buffer_move_mark(ui->buf_script, ui->hl_dirty_start, &from);
+    gtk_text_buffer_move_mark(ui->buf_script, ui->hl_dirty_end, &to);
+    // below redraw priority, so typing is drawn before it is recoloured
+    if (!ui->hl_idle_id) ui->hl_idle_id = g_idle_add(script_highlight_idle, ui);
+}
+
+// both connected after the default handler
+static void on_script_insert_text(GtkTextBuffer* buf, GtkTextIter* location, char* text, int len, gpointer user_data) {
+    (void)buf;
+    // location now sits after the inserted text
+    GtkTextIter start = *location;
+    gtk_text_iter_backward_chars(&start, (int)g_utf8_strlen(text, len));
+    script_highlight_invalidate((UIMain*)user_data, &start, location);
+}
+
+static void on_script_delete_range(GtkTextBuffer* buf, GtkTextIter* start, GtkTextIter* end, gpointer user_data) {
+    (void)buf;
+    // start == end: the point where the two remaining lines were joined
+    script_highlight_invalidate((UIMain*)user_data, start, end);
+}
+
 /* forward decl for async file dialog callback (GTK>=4.10) */
 static void on_file_dialog_opened(GObject* source_object, GAsyncResult* res, gpointer user_data);
 
@@ -283,6 +642,19 @@ static void on_script_load_clicked(GtkButton* b, gpointer user_data) {
 #endif
 }
 
+// TCP-only widgets are greyed out while UDP is selected
+static void on_proto_changed(GObject* obj, GParamSpec* pspec, gpointer user_data) {
+    (void)obj; (void)pspec;
+    UIMain* ui = (UIMain*)user_data;
+    gboolean tcp = gtk_drop_down_get_selected(ui->dd_proto) == 1;
+    gboolean client = gtk_drop_down_get_selected(ui->dd_tcp_role) == 0;
+    gtk_widget_set_sensitive(GTK_WIDGET(ui->dd_tcp_role), tcp);
+    gtk_widget_set_sensitive(GTK_WIDGET(ui->sp_tcp_clients), tcp && client);
+    gtk_widget_set_sensitive(GTK_WIDGET(ui->dd_framing), tcp);
+    gtk_widget_set_sensitive(GTK_WIDGET(ui->sp_rx_shards), !tcp);
+    gtk_widget_set_sensitive(GTK_WIDGET(ui->ck_reflect), !tcp);
+}
+
 static GtkWidget* build_left_panel(UIMain* ui) {
     GtkWidget* box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 8);
     gtk_widget_set_margin_top(box, 8);
@@ -304,6 +676,33 @@ static GtkWidget* build_left_panel(UIMain* ui) {
     const char* protos[] = {"UDP", "TCP", NULL};
     ui->dd_proto = GTK_DROP_DOWN(gtk_drop_down_new_from_strings(protos));
 
+    GtkWidget* lb_role = gtk_label_new("TCP Role");
+    const char* roles[] = {"Client", "Server", NULL};
+    ui->dd_tcp_role = GTK_DROP_DOWN(gtk_drop_down_new_from_strings(roles));
+
+    GtkWidget* lb_clients = gtk_label_new("Clients");
+    ui->sp_tcp_clients = GTK_SPIN_BUTTON(gtk_spin_button_new_with_range(1, 20000, 1));
+    gtk_spin_button_set_value(ui->sp_tcp_clients, 1);
+    gtk_widget_set_tooltip_text(GTK_WIDGET(ui->sp_tcp_clients), "TCP client connections opened at once (soak testing)");
+
+    GtkWidget* lb_framing = gtk_label_new("Framing");
+    const char* framings[] = {"None", "Length (4 bytes)", "Delimiter (\\n)", NULL};
+    ui->dd_framing = GTK_DROP_DOWN(gtk_drop_down_new_from_strings(framings));
+
+    GtkWidget* lb_shards = gtk_label_new("RX Shards");
+    ui->sp_rx_shards = GTK_SPIN_BUTTON(gtk_spin_button_new_with_range(1, NET_MAX_RX_SHARDS, 1));
+    gtk_spin_button_set_value(ui->sp_rx_shards, 1);
+    gtk_widget_set_tooltip_text(GTK_WIDGET(ui->sp_rx_shards),
+                                "UDP sockets sharing the local port (SO_REUSEPORT), one receive thread per core");
+
+    ui->ck_reflect = GTK_CHECK_BUTTON(gtk_check_button_new_with_label("Reflect"));
+    gtk_widget_set_tooltip_text(GTK_WIDGET(ui->ck_reflect),
+                                "Echo every received datagram back to its sender instead of showing it (loopback benchmarking)");
+
+    g_signal_connect(ui->dd_proto, "notify::selected", G_CALLBACK(on_proto_changed), ui);
+    g_signal_connect(ui->dd_tcp_role, "notify::selected", G_CALLBACK(on_proto_changed), ui);
+    on_proto_changed(NULL, NULL, ui);
+
     GtkWidget* lb_lip = gtk_label_new("Local IP");
     ui->ent_local_ip = GTK_ENTRY(gtk_entry_new());
     gtk_editable_set_text(GTK_EDITABLE(ui->ent_local_ip), "127.0.0.1");
@@ -327,15 +726,24 @@ static GtkWidget* build_left_panel(UIMain* ui) {
 
     gtk_grid_attach(GTK_GRID(grid), lb_proto, 0, 0, 1, 1);
     gtk_grid_attach(GTK_GRID(grid), GTK_WIDGET(ui->dd_proto), 1, 0, 1, 1);
-    gtk_grid_attach(GTK_GRID(grid), lb_lip, 0, 1, 1, 1);
-    gtk_grid_attach(GTK_GRID(grid), GTK_WIDGET(ui->ent_local_ip), 1, 1, 1, 1);
-    gtk_grid_attach(GTK_GRID(grid), lb_lport, 0, 2, 1, 1);
-    gtk_grid_attach(GTK_GRID(grid), GTK_WIDGET(ui->sp_local_port), 1, 2, 1, 1);
-    gtk_grid_attach(GTK_GRID(grid), lb_tip, 0, 3, 1, 1);
-    gtk_grid_attach(GTK_GRID(grid), GTK_WIDGET(ui->ent_target_ip), 1, 3, 1, 1);
-    gtk_grid_attach(GTK_GRID(grid), lb_tport, 0, 4, 1, 1);
-    gtk_grid_attach(GTK_GRID(grid), GTK_WIDGET(ui->sp_target_port), 1, 4, 1, 1);
-    gtk_grid_attach(GTK_GRID(grid), btn_apply, 0, 5, 2, 1);
+    gtk_grid_attach(GTK_GRID(grid), lb_role, 0, 1, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), GTK_WIDGET(ui->dd_tcp_role), 1, 1, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), lb_lip, 0, 2, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), GTK_WIDGET(ui->ent_local_ip), 1, 2, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), lb_lport, 0, 3, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), GTK_WIDGET(ui->sp_local_port), 1, 3, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), lb_tip, 0, 4, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), GTK_WIDGET(ui->ent_target_ip), 1, 4, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), lb_tport, 0, 5, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), GTK_WIDGET(ui->sp_target_port), 1, 5, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), lb_clients, 0, 6, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), GTK_WIDGET(ui->sp_tcp_clients), 1, 6, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), lb_framing, 0, 7, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), GTK_WIDGET(ui->dd_framing), 1, 7, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), lb_shards, 0, 8, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), GTK_WIDGET(ui->sp_rx_shards), 1, 8, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), GTK_WIDGET(ui->ck_reflect), 1, 9, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), btn_apply, 0, 10, 2, 1);
 
     GtkWidget* fr_mode = gtk_frame_new("IO Settings");
     GtkWidget* v = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
@@ -415,6 +823,37 @@ static GtkWidget* build_log_tab(UIMain* ui) {
     GtkWidget* btn_clear = gtk_button_new_with_label("Clear Log");
     g_signal_connect(btn_clear, "clicked", G_CALLBACK(on_clear_log_clicked), ui);
     gtk_box_append(GTK_BOX(h), btn_clear);
+    GtkWidget* btn_clear_pkt = gtk_button_new_with_label("Clear Packets");
+    g_signal_connect(btn_clear_pkt, "clicked", G_CALLBACK(on_clear_pkt_clicked), ui);
+    gtk_box_append(GTK_BOX(h), btn_clear_pkt);
+    GtkWidget* btn_export = gtk_button_new_with_label("Export Log");
+    g_signal_connect(btn_export, "clicked", G_CALLBACK(on_export_log_clicked), ui);
+    gtk_box_append(GTK_BOX(h), btn_export);
+    ui->tg_capture = GTK_TOGGLE_BUTTON(gtk_toggle_button_new_with_label("Capture"));
+    gtk_widget_set_tooltip_text(GTK_WIDGET(ui->tg_capture), "Write every sent and received datagram to a pcapng file");
+    g_signal_connect(ui->tg_capture, "toggled", G_CALLBACK(on_capture_toggled), ui);
+    gtk_box_append(GTK_BOX(h), GTK_WIDGET(ui->tg_capture));
+    GtkWidget* btn_replay = gtk_button_new_with_label("Replay");
+    gtk_widget_set_tooltip_text(btn_replay, "Send the UDP payloads of a pcap/pcapng file to the target");
+    g_signal_connect(btn_replay, "clicked", G_CALLBACK(on_replay_clicked), ui);
+    gtk_box_append(GTK_BOX(h), btn_replay);
+    ui->sp_replay_speed = GTK_SPIN_BUTTON(gtk_spin_button_new_with_range(0, 1000, 0.5));
+    gtk_spin_button_set_digits(ui->sp_replay_speed, 2);
+    gtk_spin_button_set_value(ui->sp_replay_speed, 1.0);
+    gtk_widget_set_tooltip_text(GTK_WIDGET(ui->sp_replay_speed), "Replay speed: 1 = original timing, 0 = as fast as possible");
+    gtk_box_append(GTK_BOX(h), GTK_WIDGET(ui->sp_replay_speed));
+    GtkWidget* btn_replay_stop = gtk_button_new_with_label("Stop Replay");
+    g_signal_connect(btn_replay_stop, "clicked", G_CALLBACK(on_replay_stop_clicked), ui);
+    gtk_box_append(GTK_BOX(h), btn_replay_stop);
+    ui->tg_probe = GTK_TOGGLE_BUTTON(gtk_toggle_button_new_with_label("RTT Probe"));
+    gtk_widget_set_tooltip_text(GTK_WIDGET(ui->tg_probe),
+                                "Send sequence-numbered probes the target echoes back and measure round-trip latency");
+    g_signal_connect(ui->tg_probe, "toggled", G_CALLBACK(on_probe_toggled), ui);
+    gtk_box_append(GTK_BOX(h), GTK_WIDGET(ui->tg_probe));
+    ui->sp_probe_rate = GTK_SPIN_BUTTON(gtk_spin_button_new_with_range(1, 100000, 10));
+    gtk_spin_button_set_value(ui->sp_probe_rate, 100);
+    gtk_widget_set_tooltip_text(GTK_WIDGET(ui->sp_probe_rate), "Probes per second");
+    gtk_box_append(GTK_BOX(h), GTK_WIDGET(ui->sp_probe_rate));
     {
         // style toolbar with light background to separate from content
         GtkCssProvider* css = gtk_css_provider_new();
@@ -435,20 +874,21 @@ static GtkWidget* build_log_tab(UIMain* ui) {
     gtk_widget_set_margin_bottom(sep, 4);
     gtk_box_append(GTK_BOX(v), sep);
 
-    // system log (compact, ~2-3 lines, scrollable)
-    ui->tv_log = GTK_TEXT_VIEW(gtk_text_view_new());
-    ui->buf_log = gtk_text_view_get_buffer(ui->tv_log);
-    gtk_text_view_set_editable(ui->tv_log, FALSE);
-    gtk_text_view_set_monospace(ui->tv_log, TRUE);
+    // system log (compact, ~2-3 lines, scrollable); a list over the event log history
+    ui->log_model = log_list_model_new();
+    GtkNoSelection* log_sel = gtk_no_selection_new(G_LIST_MODEL(g_object_ref(ui->log_model)));
+    GtkListItemFactory* log_factory = gtk_signal_list_item_factory_new();
+    g_signal_connect(log_factory, "setup", G_CALLBACK(on_log_row_setup), ui);
+    g_signal_connect(log_factory, "bind", G_CALLBACK(on_log_row_bind), ui);
+    ui->lv_log = GTK_LIST_VIEW(gtk_list_view_new(GTK_SELECTION_MODEL(log_sel), log_factory));
 
     GtkWidget* sc_sys = gtk_scrolled_window_new();
-    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(sc_sys), GTK_WIDGET(ui->tv_log));
+    ui->sc_log = GTK_SCROLLED_WINDOW(sc_sys);
+    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(sc_sys), GTK_WIDGET(ui->lv_log));
     gtk_widget_set_margin_start(sc_sys, 8);
     gtk_widget_set_margin_end(sc_sys, 8);
     gtk_widget_set_margin_top(sc_sys, 2);
     gtk_widget_set_margin_bottom(sc_sys, 6);
-    gtk_widget_set_margin_start(GTK_WIDGET(ui->tv_log), 6);
-    gtk_widget_set_margin_end(GTK_WIDGET(ui->tv_log), 6);
     gtk_widget_set_size_request(sc_sys, -1, 64); // about 2-3 lines tall
     {
         GtkCssProvider* css = gtk_css_provider_new();
@@ -461,22 +901,24 @@ static GtkWidget* build_log_tab(UIMain* ui) {
     }
     gtk_box_append(GTK_BOX(v), sc_sys);
 
-    // packet hexdump area (large, takes most space)
-    ui->tv_pkt = GTK_TEXT_VIEW(gtk_text_view_new());
-    ui->buf_pkt = gtk_text_view_get_buffer(ui->tv_pkt);
-    gtk_text_view_set_editable(ui->tv_pkt, FALSE);
-    gtk_text_view_set_monospace(ui->tv_pkt, TRUE);
+    // packet hexdump area (large, takes most space); only visible rows are formatted
+    ui->pkt_store = pkt_store_new();
+    ui->pkt_model = pkt_list_model_new(ui->pkt_store);
+    GtkNoSelection* sel = gtk_no_selection_new(G_LIST_MODEL(g_object_ref(ui->pkt_model)));
+    GtkListItemFactory* factory = gtk_signal_list_item_factory_new();
+    g_signal_connect(factory, "setup", G_CALLBACK(on_pkt_row_setup), ui);
+    g_signal_connect(factory, "bind", G_CALLBACK(on_pkt_row_bind), ui);
+    ui->lv_pkt = GTK_LIST_VIEW(gtk_list_view_new(GTK_SELECTION_MODEL(sel), factory));
 
     GtkWidget* sc_pkt = gtk_scrolled_window_new();
-    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(sc_pkt), GTK_WIDGET(ui->tv_pkt));
+    ui->sc_pkt = GTK_SCROLLED_WINDOW(sc_pkt);
+    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(sc_pkt), GTK_WIDGET(ui->lv_pkt));
     gtk_widget_set_vexpand(sc_pkt, TRUE);
     gtk_widget_set_hexpand(sc_pkt, TRUE);
     gtk_widget_set_margin_start(sc_pkt, 8);
     gtk_widget_set_margin_end(sc_pkt, 8);
     gtk_widget_set_margin_top(sc_pkt, 2);
     gtk_widget_set_margin_bottom(sc_pkt, 4);
-    gtk_widget_set_margin_start(GTK_WIDGET(ui->tv_pkt), 6);
-    gtk_widget_set_margin_end(GTK_WIDGET(ui->tv_pkt), 6);
     gtk_box_append(GTK_BOX(v), sc_pkt);
 
     return v;
@@ -614,10 +1056,20 @@ static GtkWidget* build_script_tab(UIMain* ui) {
     gtk_widget_set_margin_end(GTK_WIDGET(ui->tv_script), 6);
     gtk_box_append(GTK_BOX(v), sc);
 
-    // update highlighting when buffer changes
+    // dirty range for highlighting: the start mark stays before text inserted
+    // at it, the end mark moves past it
+    GtkTextIter buf_start, buf_end;
+    gtk_text_buffer_get_bounds(ui->buf_script, &buf_start, &buf_end);
+    ui->hl_dirty_start = gtk_text_buffer_create_mark(ui->buf_script, NULL, &buf_start, TRUE);
+    ui->hl_dirty_end = gtk_text_buffer_create_mark(ui->buf_script, NULL, &buf_end, FALSE);
+
+    // update gutter and highlighting when the buffer changes
     g_signal_connect(ui->buf_script, "changed", G_CALLBACK(on_script_buffer_changed), ui);
-    // initialize highlighting
+    g_signal_connect_after(ui->buf_script, "insert-text", G_CALLBACK(on_script_insert_text), ui);
+    g_signal_connect_after(ui->buf_script, "delete-range", G_CALLBACK(on_script_delete_range), ui);
+    // initialize gutter and highlighting for the preset
     on_script_buffer_changed(ui->buf_script, ui);
+    script_highlight_invalidate(ui, &buf_start, &buf_end);
 
     return v;
 }
@@ -671,18 +1123,24 @@ static GtkWidget* build_bottom_send(UIMain* ui) {
 }
 
 static GtkWidget* build_statusbar(UIMain* ui) {
-    (void)ui;
     GtkWidget* bar = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 8);
     gtk_widget_set_margin_top(bar, 4);
     gtk_widget_set_margin_bottom(bar, 4);
     gtk_widget_set_margin_start(bar, 8);
     gtk_widget_set_margin_end(bar, 8);
 
-    GtkWidget* lb = gtk_label_new("RX: 0    TX: 0    Script: Stopped");
+    GtkWidget* lb = gtk_label_new("RX: 0 pps    TX: 0 pps");
     gtk_label_set_xalign(GTK_LABEL(lb), 0.0f);
     gtk_widget_set_hexpand(lb, TRUE);
+    ui->lb_metrics = GTK_LABEL(lb);
+
+    ui->tg_metrics = GTK_TOGGLE_BUTTON(gtk_toggle_button_new_with_label("Metrics"));
+    gtk_widget_set_tooltip_text(GTK_WIDGET(ui->tg_metrics),
+                                "Append the per-second counters to a CSV (.csv) or JSON Lines file");
+    g_signal_connect(ui->tg_metrics, "toggled", G_CALLBACK(on_metrics_toggled), ui);
 
     gtk_box_append(GTK_BOX(bar), lb);
+    gtk_box_append(GTK_BOX(bar), GTK_WIDGET(ui->tg_metrics));
     return bar;
 }
 
@@ -741,8 +1199,9 @@ UIMain* ui_main_new(GtkApplication* app, const BackendAPI* api, void* api_user)
     gtk_box_append(GTK_BOX(right), build_bottom_send(ui));
     gtk_box_append(GTK_BOX(root), build_statusbar(ui));
 
-    // initial log
-    append_text(ui->buf_log, "[UI] ready. Use left panel to apply config. Use Script tab to Run.");
+    // initial log; collection starts now that the log view exists
+    evlog_attach(on_evlog_changed, ui);
+    EVLOG("[UI] ready. Use left panel to apply config. Use Script tab to Run.");
 
     gtk_window_present(ui->win);
     return ui;
@@ -751,6 +1210,12 @@ UIMain* ui_main_new(GtkApplication* app, const BackendAPI* api, void* api_user)
 void ui_main_free(UIMain* ui) {
     if (!ui) return;
     // widgets managed by GTK
+    evlog_detach();
+    if (ui->pkt_sync_id) g_source_remove(ui->pkt_sync_id);
+    if (ui->hl_idle_id) g_source_remove(ui->hl_idle_id);
+    g_clear_object(&ui->pkt_model);
+    g_clear_object(&ui->log_model);
+    pkt_store_free(ui->pkt_store);
     g_free(ui);
 }
 
@@ -759,16 +1224,63 @@ GtkWindow* ui_main_window(UIMain* ui) {
 }
 
 // controller -> UI
-void ui_main_log_append(void* ui_user, const char* line) {
+void ui_main_metrics(void* ui_user, const NetSample* s) {
+    UIMain* ui = (UIMain*)ui_user;
+    if (!ui || !s || !ui->lb_metrics) return;
+    const NetTotals* t = &s->total;
+    char* text = g_strdup_printf("RX: %.0f pps %.2f Mbit/s    TX: %.0f pps %.2f Mbit/s    "
+                                 "dropped %" G_GUINT64_FORMAT "  truncated %" G_GUINT64_FORMAT
+                                 "  errors %" G_GUINT64_FORMAT,
+                                 s->rx_pps, s->rx_bps / 1e6, s->tx_pps, s->tx_bps / 1e6,
+                                 (guint64)(t->rx_dropped + t->tx_dropped), (guint64)t->rx_truncated,
+                                 (guint64)(t->rx_errors + t->tx_errors));
+    if (s->conns) {
+        char* more = g_strdup_printf("%s    conns %u", text, s->conns);
+        g_free(text);
+        text = more;
+    }
+    if (s->rtt.sent) {
+        const ProbeStats* r = &s->rtt;
+        char* more = g_strdup_printf("%s    RTT us p50 %.1f p99 %.1f p99.9 %.1f max %.1f (%" G_GUINT64_FORMAT
+                                     "/%" G_GUINT64_FORMAT ")", text, r->p50_ns / 1e3, r->p99_ns / 1e3,
+                                     r->p999_ns / 1e3, r->max_ns / 1e3, (guint64)r->received, (guint64)r->sent);
+        g_free(text);
+        text = more;
+    }
+    // a run that ended by itself (send failure) releases the toggle
+    if (ui->tg_probe && !s->rtt.running && gtk_toggle_button_get_active(ui->tg_probe)) probe_toggle_set(ui, FALSE);
+    gtk_label_set_text(ui->lb_metrics, text);
+    g_free(text);
+}
+
+// text is a LogQueue batch: one event per line, so each gets its own row
+void ui_main_log_append(void* ui_user, const char* text) {
     UIMain* ui = (UIMain*)ui_user;
-    if (!ui || !ui->buf_log || !line) return;
-    append_text(ui->buf_log, line);
+    if (!ui || !text) return;
+    for (const char* p = text;;) {
+        const char* nl = strchr(p, '\n');
+        if (!nl) {
+            evlog_text(p);
+            break;
+        }
+        EVLOG("%S", EV_DUPN(p, (gsize)(nl - p)));
+        p = nl + 1;
+    }
 }
 
-void ui_main_packet_append(void* ui_user, const uint8_t* data, size_t len) {
+void ui_main_packet_append(void* ui_user, const uint8_t* data, size_t len,
+                           const UdpPeer* from, int64_t ts_us) {
     UIMain* ui = (UIMain*)ui_user;
-    if (!ui || !ui->buf_pkt || !data || len == 0) return;
-    append_hexdump(ui->buf_pkt, data, len);
+    if (!ui || !ui->pkt_store || !data || len == 0) return;
+    if (!pkt_store_append(ui->pkt_store, data, len, from, ts_us)) {
+        if (!ui->pkt_full_logged) {
+            EVLOG("[PKT] packet store full at %u packets; new packets are not kept until Clear Packets",
+                  pkt_store_count(ui->pkt_store));
+            ui->pkt_full_logged = TRUE;
+        }
+        return;
+    }
+    if (!ui->pkt_sync_id) ui->pkt_sync_id = g_idle_add(pkt_sync_idle_cb, ui);
 }
 
 void ui_main_set_script_state(void* ui_user, ScriptState st, const char* detail) {
@@ -13,7 +13,9 @@ void ui_main_free(UIMain* ui);
 // controller -> UI ص
 void ui_main_log_append(void* ui_user, const char* line);
 void ui_main_set_script_state(void* ui_user, ScriptState st, const char* detail);
-void ui_main_packet_append(void* ui_user, const uint8_t* data, size_t len);
+void ui_main_packet_append(void* ui_user, const uint8_t* data, size_t len,
+                           const UdpPeer* from, int64_t ts_us);
+void ui_main_metrics(void* ui_user, const NetSample* s);
 
 // ȡö window
 GtkWindow* ui_main_window(UIMain* ui);